@@ -0,0 +1,202 @@
+// Text dump throughput of printDIE on one large compile unit
+// - Compares the original recursive, format()-based printer against printDIE,
+//   and printDIE against ParallelDIEDump on --jobs threads (printDIE again when
+//   that is one thread, as LLVMDwarf_Simple does)
+// - The layout is built without deduplication, so every struct and member
+//   gets its own DIE (--types structs of 4 members, ~5 DIEs each)
+// - All dumps go to --output, and are compared byte for byte in memory first
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/DIEPrinter.h"
+#include "src/DwarfSectionWriter.h"
+#include "src/LayoutDIEBuilder.h"
+#include "src/LayoutTable.h"
+#include "src/ParallelUnitBuilder.h"
+
+using namespace llvm;
+
+cl::opt<unsigned> NumTypes("types", cl::desc("Number of struct types"), cl::init(200000));
+cl::opt<unsigned> Repeats("repeats", cl::desc("Timed dumps per printer (best is reported)"), cl::init(3));
+cl::opt<unsigned> Jobs("jobs", cl::desc("ParallelDIEDump threads (0 = all cores)"), cl::init(0));
+cl::opt<std::string> Output("output", cl::desc("File the timed dumps are written to"), cl::init("/dev/null"));
+
+// The previous recursive printer, kept verbatim as the baseline
+static void legacyPrintDIE(raw_ostream &OS, DIE &die, const SimpleStringPool &stringPool, uint64_t unitOffset,
+                           const DwarfUnitOffsets &unitOffsets, int indent = 0) {
+  std::string indentStr(indent, ' ');
+
+  // Print DIE header
+  OS << indentStr << "0x" << format("%08x", die.getOffset() + unitOffset) << ": ";
+  OS << dwarf::TagString(die.getTag());
+  OS << " [" << die.getAbbrevNumber() << "]";
+
+  if (die.hasChildren()) {
+    OS << " *\n";
+  } else {
+    OS << "\n";
+  }
+
+  // Print attributes
+  for (const auto &V : die.values()) {
+    OS << indentStr << "  " << dwarf::AttributeString(V.getAttribute()) << " = ";
+
+    switch (V.getType()) {
+    case DIEValue::isInteger: {
+      uint64_t val = V.getDIEInteger().getValue();
+
+      // Special handling for string offsets
+      if (V.getForm() == dwarf::DW_FORM_strp) {
+        StringRef str = stringPool.getStringAt(val);
+        OS << "\"" << str << "\" (strp offset: 0x" << format("%08x", val) << ")";
+      } else if (V.getForm() >= dwarf::DW_FORM_strx1 && V.getForm() <= dwarf::DW_FORM_strx4) {
+        StringRef str = stringPool.getStringAt(stringPool.getOffsetOfIndex(val));
+        OS << "\"" << str << "\" (indexed string: 0x" << format("%08x", val) << ")";
+      } else if (V.getAttribute() == dwarf::DW_AT_encoding) {
+        OS << dwarf::AttributeEncodingString(val);
+      } else if (V.getForm() == dwarf::DW_FORM_ref_sig8) {
+        OS << "0x" << format_hex_no_prefix(val, 16);
+      } else if (V.getForm() == dwarf::DW_FORM_ref4) {
+        // Resolved reference to a DIE that is no longer in memory (streaming)
+        OS << "{0x" << format("%08x", val + unitOffset) << "}";
+      } else {
+        OS << "0x";
+        OS.write_hex(val);
+      }
+      break;
+    }
+    case DIEValue::isEntry: {
+      DIE &refDie = V.getDIEEntry().getEntry();
+      uint64_t refUnitOffset = unitOffset;
+      if (V.getForm() == dwarf::DW_FORM_ref_addr)
+        refUnitOffset = unitOffsets.lookup(refDie.getUnitDie());
+      OS << "{0x" << format("%08x", refDie.getOffset() + refUnitOffset) << "}";
+      break;
+    }
+    default:
+      OS << "<unknown type>";
+      break;
+    }
+
+    OS << " [" << dwarf::FormEncodingString(V.getForm()) << "]\n";
+  }
+
+  // Print children recursively
+  for (auto &child : die.children()) {
+    legacyPrintDIE(OS, child, stringPool, unitOffset, unitOffsets, indent + 2);
+  }
+
+  if (die.hasChildren()) {
+    OS << std::string(indent, ' ') << "NULL\n";
+  }
+}
+
+// Base types, a char*, then structs with int/double/char* members and,
+// for every second struct, an earlier struct by value
+static void makeLayout(LayoutTable &table, unsigned numStructs) {
+  table.types.push_back({LayoutTypeKind::Base, "int", 4, dwarf::DW_ATE_signed, 0, {}});
+  table.types.push_back({LayoutTypeKind::Base, "char", 1, dwarf::DW_ATE_signed_char, 0, {}});
+  table.types.push_back({LayoutTypeKind::Base, "double", 8, dwarf::DW_ATE_float, 0, {}});
+  table.types.push_back({LayoutTypeKind::Pointer, "", 8, 0, 1, {}});
+  uint32_t firstStruct = table.types.size();
+  for (unsigned i = 0; i < numStructs; ++i) {
+    LayoutType type{LayoutTypeKind::Struct, table.save("S" + std::to_string(i)), 32, 0, 0, {}};
+    type.members.push_back({"a", 0, 0});
+    type.members.push_back({"b", 2, 8});
+    type.members.push_back({"c", 3, 16});
+    type.members.push_back({"d", i ? firstStruct + i / 2 : 0, 24});
+    table.types.push_back(std::move(type));
+  }
+}
+
+static size_t countDIEs(const DIE &die) {
+  size_t count = 1;
+  for (const DIE &child : die.children())
+    count += countDIEs(child);
+  return count;
+}
+
+template <typename Fn> static double bestOf(Fn dump) {
+  double best = 1e30;
+  for (unsigned r = 0; r < std::max(1u, unsigned(Repeats)); ++r) {
+    int fd;
+    if (std::error_code EC = sys::fs::openFileForWrite(Output, fd)) {
+      errs() << "Cannot open " << Output << ": " << EC.message() << "\n";
+      exit(1);
+    }
+    raw_fd_ostream OS(fd, /*shouldClose=*/true);
+    auto start = std::chrono::steady_clock::now();
+    dump(OS, fd);
+    OS.flush();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "DIE text dump benchmark\n");
+
+  LayoutTable table;
+  makeLayout(table, NumTypes);
+  dwarf::FormParams formParams = {4, 4, dwarf::DWARF32};
+  LayoutUnitPlan plan(table, 1, /*dedupTypes=*/false);
+  LayoutCompileUnits units = buildCompileUnits(plan, DwarfGeneratorOptions());
+  DIE &unitDie = *units.units.front()->unitDie;
+  const SimpleStringPool &stringPool = units.stringPool;
+  DwarfUnitOffsets unitOffsets = computeCompileUnitOffsets(units.getUnitDies(), formParams);
+  size_t numDIEs = countDIEs(unitDie);
+
+  std::string legacyText, newText, parallelText;
+  raw_string_ostream legacyOS(legacyText), newOS(newText), parallelOS(parallelText);
+  legacyPrintDIE(legacyOS, unitDie, stringPool, 0, unitOffsets);
+  printDIE(newOS, unitDie, stringPool, 0, unitOffsets);
+  if (legacyOS.str() != newOS.str()) {
+    errs() << "printDIE output differs from the recursive printer\n";
+    return 1;
+  }
+  bool parallel = ParallelDIEDump::getNumThreads(Jobs) > 1;
+  if (parallel) {
+    ParallelDIEDump dump(Jobs);
+    dump.printDIE(unitDie, stringPool, 0, unitOffsets);
+    dump.writeTo(parallelOS);
+  }
+  if (parallel && parallelOS.str() != newText) {
+    errs() << "ParallelDIEDump output differs from printDIE\n";
+    return 1;
+  }
+
+  double legacyTime = bestOf([&](raw_ostream &OS, int) { legacyPrintDIE(OS, unitDie, stringPool, 0, unitOffsets); });
+  double newTime = bestOf([&](raw_ostream &OS, int) { printDIE(OS, unitDie, stringPool, 0, unitOffsets); });
+  double parallelTime = bestOf([&](raw_ostream &OS, int fd) {
+    if (!parallel) {
+      printDIE(OS, unitDie, stringPool, 0, unitOffsets);
+      return;
+    }
+    ParallelDIEDump dump(Jobs);
+    dump.printDIE(unitDie, stringPool, 0, unitOffsets);
+    if (Error err = dump.writeTo(fd)) {
+      errs() << "Cannot write " << Output << ": " << toString(std::move(err)) << "\n";
+      exit(1);
+    }
+  });
+
+  outs() << "Dump of " << numDIEs << " DIEs, " << format("%.1f", newText.size() / 1048576.0) << " MB of text to " << Output
+         << " (best of " << Repeats << ")\n";
+  outs() << format("  recursive  %9.1f ms  %7.1f ns/DIE  %7.1f MB/s\n", legacyTime * 1e3, legacyTime * 1e9 / numDIEs,
+                   newText.size() / legacyTime / 1048576.0);
+  outs() << format("  printDIE   %9.1f ms  %7.1f ns/DIE  %7.1f MB/s\n", newTime * 1e3, newTime * 1e9 / numDIEs,
+                   newText.size() / newTime / 1048576.0);
+  outs() << format("  parallel   %9.1f ms  %7.1f ns/DIE  %7.1f MB/s\n", parallelTime * 1e3, parallelTime * 1e9 / numDIEs,
+                   newText.size() / parallelTime / 1048576.0);
+  outs() << format("  speedup    %9.2fx printDIE, %.2fx parallel (--jobs=%u)\n", legacyTime / newTime, legacyTime / parallelTime,
+                   unsigned(Jobs));
+  return 0;
+}
@@ -0,0 +1,377 @@
+// End-to-end comparison of the two DWARF generation paths on synthetic layouts
+// - DIBuilder path (LLVMDwarf): IR build, finalize, codegen, object parse, dump
+// - DIE path (LLVMDwarf_Simple): DIE build, offsets, serialize, print
+// - Per phase: best wall time over --repeat runs, heap allocations, bytes
+//   allocated and peak live heap (allocation accounting needs glibc)
+// - Peak RSS is per process, so use --path to measure one path at a time
+// - --shape=chain replaces the nested structs by a linked list of same-named
+//   structs, which stresses type deduplication in the DIE build phase
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/DIBuilderModule.h"
+#include "src/DIEPrinter.h"
+#include "src/DwarfSectionWriter.h"
+#include "src/LayoutDIEBuilder.h"
+#include "src/LayoutTable.h"
+#include "src/ObjectDwarfGenerator.h"
+#include "src/ProcessStats.h"
+#include "src/SimpleStringPool.h"
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+using namespace llvm;
+using namespace llvm::object;
+
+using Clock = std::chrono::steady_clock;
+
+// Heap accounting. Interposing the C allocator also catches SmallVector
+// growth and BumpPtrAllocator slabs, which bypass operator new.
+static std::atomic<uint64_t> numAllocs{0};
+static std::atomic<uint64_t> allocBytes{0};
+static std::atomic<int64_t> liveBytes{0};
+static std::atomic<int64_t> peakLiveBytes{0};
+
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+static void noteAlloc(void *ptr) {
+  if (!ptr)
+    return;
+  size_t size = malloc_usable_size(ptr);
+  numAllocs.fetch_add(1, std::memory_order_relaxed);
+  allocBytes.fetch_add(size, std::memory_order_relaxed);
+  int64_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+  int64_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+  while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+  }
+}
+
+static void noteFree(void *ptr) {
+  if (ptr)
+    liveBytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+}
+
+extern "C" void *malloc(size_t size) noexcept {
+  void *ptr = __libc_malloc(size);
+  noteAlloc(ptr);
+  return ptr;
+}
+
+extern "C" void *calloc(size_t count, size_t size) noexcept {
+  void *ptr = __libc_calloc(count, size);
+  noteAlloc(ptr);
+  return ptr;
+}
+
+extern "C" void *realloc(void *old, size_t size) noexcept {
+  size_t oldSize = old ? malloc_usable_size(old) : 0;
+  void *ptr = __libc_realloc(old, size);
+  if (ptr || !size)
+    liveBytes.fetch_sub(oldSize, std::memory_order_relaxed);
+  noteAlloc(ptr);
+  return ptr;
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size) noexcept {
+  void *ptr = __libc_memalign(alignment, size);
+  noteAlloc(ptr);
+  return ptr;
+}
+
+extern "C" int posix_memalign(void **out, size_t alignment, size_t size) noexcept {
+  void *ptr = __libc_memalign(alignment, size);
+  if (!ptr)
+    return ENOMEM;
+  noteAlloc(ptr);
+  *out = ptr;
+  return 0;
+}
+
+extern "C" void free(void *ptr) noexcept {
+  noteFree(ptr);
+  __libc_free(ptr);
+}
+#endif
+
+namespace {
+
+struct PhaseStats {
+  const char *name;
+  double seconds = std::numeric_limits<double>::max();
+  uint64_t allocs = 0;
+  uint64_t bytes = 0;
+  int64_t peakHeap = 0;
+};
+
+// Measures consecutive phases; each stop() closes one and opens the next
+class PhaseMeter {
+  Clock::time_point start;
+  uint64_t startAllocs = 0;
+  uint64_t startBytes = 0;
+  int64_t startLive = 0;
+
+public:
+  PhaseMeter() {
+    restart();
+  }
+
+  void restart() {
+    startAllocs = numAllocs.load();
+    startBytes = allocBytes.load();
+    startLive = liveBytes.load();
+    peakLiveBytes.store(startLive);
+    start = Clock::now();
+  }
+
+  void stop(PhaseStats &phase) {
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    phase.seconds = std::min(phase.seconds, seconds);
+    phase.allocs = numAllocs.load() - startAllocs;
+    phase.bytes = allocBytes.load() - startBytes;
+    phase.peakHeap = peakLiveBytes.load() - startLive;
+    restart();
+  }
+};
+
+cl::opt<unsigned> NumTypes("types", cl::desc("Number of struct types"), cl::init(10000));
+cl::opt<unsigned> MembersPerType("members", cl::desc("Members per struct"), cl::init(8));
+cl::opt<unsigned> NestingDepth("depth", cl::desc("Levels of structs nested by value"), cl::init(2));
+cl::opt<unsigned> Repeat("repeat", cl::desc("Runs per path; the best time is reported"), cl::init(3));
+cl::opt<std::string> Path("path", cl::desc("dibuilder, die or both"), cl::init("both"));
+cl::opt<std::string> Shape("shape", cl::desc("nested (--members, --depth) or chain"), cl::init("nested"));
+
+// Structs are split into depth + 1 levels. Level 0 holds base and pointer
+// members only; every deeper struct starts with a level - 1 struct by value.
+void makeSyntheticLayout(LayoutTable &table, unsigned numStructs, unsigned membersPerType, unsigned depth) {
+  table.types.clear();
+  table.types.push_back({LayoutTypeKind::Base, "int", 4, dwarf::DW_ATE_signed, 0, {}});
+  table.types.push_back({LayoutTypeKind::Base, "char", 1, dwarf::DW_ATE_signed_char, 0, {}});
+  table.types.push_back({LayoutTypeKind::Base, "double", 8, dwarf::DW_ATE_float, 0, {}});
+  table.types.push_back({LayoutTypeKind::Pointer, "", 8, 0, 1, {}});
+  const uint32_t fieldTypes[] = {0, 2, 3, 1};
+  uint32_t firstStruct = table.types.size();
+
+  // Every level needs at least one struct
+  unsigned levels = std::min(depth + 1, numStructs);
+  for (unsigned i = 0; i < numStructs; ++i) {
+    unsigned level = uint64_t(i) * levels / numStructs;
+    LayoutType type{LayoutTypeKind::Struct, table.save("S" + std::to_string(i)), 0, 0, 0, {}};
+    uint64_t offset = 0;
+    for (unsigned m = 0; m < membersPerType; ++m) {
+      uint32_t memberType = fieldTypes[m % 4];
+      if (m == 0 && level > 0) {
+        // Any struct of the previous level
+        unsigned levelBegin = (uint64_t(numStructs) * (level - 1) + levels - 1) / levels;
+        unsigned levelEnd = (uint64_t(numStructs) * level + levels - 1) / levels;
+        memberType = firstStruct + levelBegin + i % (levelEnd - levelBegin);
+      }
+      uint64_t size = table.types[memberType].byteSize;
+      offset = alignTo(offset, std::min<uint64_t>(size, 8));
+      type.members.push_back({table.save("m" + std::to_string(m)), memberType, offset});
+      offset += size;
+    }
+    type.byteSize = alignTo(offset, 8);
+    table.types.push_back(std::move(type));
+  }
+}
+
+// A linked list of --types same-named structs, Node {a: int, n: pointer to the
+// next Node}, whose last pointer goes to int. Every Node has the same local
+// shape but none can be merged, the worst case for type deduplication.
+void makeChainLayout(LayoutTable &table, unsigned numStructs) {
+  table.types.clear();
+  table.types.push_back({LayoutTypeKind::Base, "int", 4, dwarf::DW_ATE_signed, 0, {}});
+  // Node i at 1 + 2 * i, its pointer member type right after it
+  for (unsigned i = 0; i < numStructs; ++i) {
+    uint32_t node = table.types.size();
+    uint32_t next = i + 1 < numStructs ? node + 2 : 0;
+    table.types.push_back({LayoutTypeKind::Struct, "Node", 16, 0, 0, {{"a", 0, 0}, {"n", node + 1, 8}}});
+    table.types.push_back({LayoutTypeKind::Pointer, "", 8, 0, next, {}});
+  }
+}
+
+bool runDIBuilderPath(const LayoutTable &table, ObjectDwarfGenerator &generator, std::vector<PhaseStats> &phases, size_t &dumpBytes) {
+  PhaseMeter meter;
+  LLVMContext context;
+  Expected<std::unique_ptr<Module>> moduleOrErr =
+      buildLayoutModule(context, table, "bench_module", [&] { meter.stop(phases[0]); });
+  if (!moduleOrErr) {
+    errs() << toString(moduleOrErr.takeError()) << "\n";
+    return false;
+  }
+  meter.stop(phases[1]);
+
+  SmallVector<char, 0> objBuffer;
+  if (Error err = generator.emitObject(**moduleOrErr, objBuffer)) {
+    errs() << toString(std::move(err)) << "\n";
+    return false;
+  }
+  meter.stop(phases[2]);
+
+  Expected<std::unique_ptr<ObjectFile>> objOrErr =
+      ObjectFile::createObjectFile(MemoryBufferRef(StringRef(objBuffer.data(), objBuffer.size()), "memory"));
+  if (!objOrErr) {
+    errs() << toString(objOrErr.takeError()) << "\n";
+    return false;
+  }
+  std::unique_ptr<DWARFContext> dwCtx = DWARFContext::create(**objOrErr);
+  meter.stop(phases[3]);
+
+  // Same options as main.cpp, into memory instead of debug.txt
+  std::string dump;
+  raw_string_ostream dumpStream(dump);
+  DIDumpOptions dumpOptions;
+  dumpOptions.DumpType = DIDT_All & ~DIDT_DebugLine;
+  dumpOptions.ShowChildren = true;
+  dumpOptions.ShowForm = true;
+  dumpOptions.Verbose = true;
+  dwCtx->dump(dumpStream, dumpOptions);
+  dumpStream.flush();
+  dumpBytes = dump.size();
+  meter.stop(phases[4]);
+  return true;
+}
+
+bool runDIEPath(const LayoutTable &table, std::vector<PhaseStats> &phases, size_t &dumpBytes) {
+  PhaseMeter meter;
+  BumpPtrAllocator allocator;
+  DIEAbbrevSet abbrevSet(allocator);
+  SimpleStringPool stringPool(table.types.size() + table.getNumMembers() + 1);
+  LayoutUnitPlan plan(table, 1);
+  LayoutDIEBuilder dieBuilder(allocator, stringPool, plan);
+  dieBuilder.createDIEs();
+  DIE *cu = dieBuilder.buildCompileUnit();
+  meter.stop(phases[0]);
+
+  dwarf::FormParams formParams = {4, 4, dwarf::DWARF32};
+  cu->computeOffsetsAndAbbrevs(formParams, abbrevSet, getCompileUnitHeaderSize(formParams));
+  meter.stop(phases[1]);
+
+  DwarfSectionWriter writer(formParams);
+  if (Error err = writer.emitCompileUnit(*cu)) {
+    errs() << toString(std::move(err)) << "\n";
+    return false;
+  }
+  DwarfSections sections = writer.finish(stringPool);
+  meter.stop(phases[2]);
+
+  std::string dump;
+  raw_string_ostream dumpStream(dump);
+  printDIE(dumpStream, *cu, stringPool, 0, DwarfUnitOffsets());
+  printStringPool(dumpStream, stringPool);
+  dumpStream.flush();
+  dumpBytes = dump.size();
+  meter.stop(phases[3]);
+  return true;
+}
+
+void printPhases(StringRef title, const std::vector<PhaseStats> &phases, size_t dumpBytes) {
+  std::vector<PhaseStats> rows = phases;
+  PhaseStats total{"total", 0};
+  for (const PhaseStats &phase : phases) {
+    total.seconds += phase.seconds;
+    total.allocs += phase.allocs;
+    total.bytes += phase.bytes;
+    total.peakHeap = std::max(total.peakHeap, phase.peakHeap);
+  }
+  rows.push_back(total);
+
+  outs() << title << " (dump: " << dumpBytes << " bytes)\n";
+  outs() << "  phase                  ms       allocs   MB allocated   MB peak heap\n";
+  for (const PhaseStats &row : rows) {
+    outs() << format("  %-14s %10.2f %12llu %14.1f %14.1f\n", row.name, row.seconds * 1e3, (unsigned long long)row.allocs,
+                     row.bytes / 1048576.0, row.peakHeap / 1048576.0);
+  }
+}
+
+double totalSeconds(const std::vector<PhaseStats> &phases) {
+  double seconds = 0;
+  for (const PhaseStats &phase : phases)
+    seconds += phase.seconds;
+  return seconds;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "DIBuilder vs DIE DWARF generation benchmark\n");
+  bool runDIBuilder = Path == "both" || Path == "dibuilder";
+  bool runDIE = Path == "both" || Path == "die";
+  if (!runDIBuilder && !runDIE) {
+    errs() << "--path must be dibuilder, die or both\n";
+    return 1;
+  }
+
+  bool chain = Shape == "chain";
+  if (!chain && Shape != "nested") {
+    errs() << "--shape must be nested or chain\n";
+    return 1;
+  }
+
+  LayoutTable table;
+  if (chain) {
+    makeChainLayout(table, std::max(1u, unsigned(NumTypes)));
+    outs() << "Layout: chain of " << NumTypes << " Node structs";
+  } else {
+    makeSyntheticLayout(table, std::max(1u, unsigned(NumTypes)), MembersPerType, NestingDepth);
+    outs() << "Layout: " << NumTypes << " structs x " << MembersPerType << " members, depth " << NestingDepth;
+  }
+  outs() << " (" << table.types.size() << " types, " << table.getNumMembers() << " members)";
+#if !defined(__GLIBC__)
+  outs() << ", allocation counts unavailable on this platform";
+#endif
+  outs() << "\n\n";
+
+  std::vector<PhaseStats> dibuilderPhases = {{"IR build"}, {"finalize"}, {"codegen"}, {"object parse"}, {"dump"}};
+  std::vector<PhaseStats> diePhases = {{"DIE build"}, {"offsets"}, {"serialize"}, {"print"}};
+  size_t dibuilderDump = 0, dieDump = 0;
+
+  std::unique_ptr<ObjectDwarfGenerator> generator;
+  if (runDIBuilder) {
+    Expected<std::unique_ptr<ObjectDwarfGenerator>> generatorOrErr = ObjectDwarfGenerator::create();
+    if (!generatorOrErr) {
+      errs() << toString(generatorOrErr.takeError()) << "\n";
+      return 1;
+    }
+    generator = std::move(*generatorOrErr);
+  }
+
+  for (unsigned i = 0; i < std::max(1u, unsigned(Repeat)); ++i) {
+    if (runDIBuilder && !runDIBuilderPath(table, *generator, dibuilderPhases, dibuilderDump))
+      return 1;
+    if (runDIE && !runDIEPath(table, diePhases, dieDump))
+      return 1;
+  }
+
+  if (runDIBuilder)
+    printPhases("DIBuilder path (LLVMDwarf)", dibuilderPhases, dibuilderDump);
+  if (runDIE)
+    printPhases("DIE path (LLVMDwarf_Simple)", diePhases, dieDump);
+  if (runDIBuilder && runDIE)
+    outs() << "\nDIE path speedup: " << format("%.1fx", totalSeconds(dibuilderPhases) / totalSeconds(diePhases)) << "\n";
+  outs() << "Peak RSS: " << format("%.1f", getPeakRSSBytes() / 1048576.0) << " MB\n";
+  return 0;
+}
@@ -0,0 +1,269 @@
+// Single-type edits on one large compile unit: incremental re-layout vs a full rebuild
+// - Full: DIE build, computeOffsetsAndAbbrevs and serialization of the whole unit
+// - Incremental: IncrementalUnitLayout patching the serialized sections in place
+// - Edits cycle through renaming, adding and removing a member, retyping a
+//   member, adding a type at the end of the unit and removing a random
+//   unreferenced struct, usually from the middle of it
+// - The patched .debug_info is parsed back and compared with a full rebuild
+//   of the edited table (--check-every edits, and after the last one)
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/DebugInfo/DIContext.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/DwarfSectionWriter.h"
+#include "src/IncrementalUnitLayout.h"
+#include "src/LayoutDIEBuilder.h"
+#include "src/LayoutTable.h"
+#include "src/ParallelUnitBuilder.h"
+
+using namespace llvm;
+
+using Clock = std::chrono::steady_clock;
+
+cl::opt<unsigned> NumTypes("types", cl::desc("Number of struct types"), cl::init(100000));
+cl::opt<unsigned> NumEdits("edits", cl::desc("Single-type edits to time"), cl::init(1200));
+cl::opt<unsigned> CheckEvery("check-every", cl::desc("Compare with a full rebuild every N edits (0 = after the last only)"),
+                             cl::init(0));
+
+static const dwarf::FormParams formParams = {4, 4, dwarf::DWARF32};
+
+static double elapsedUs(Clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+// Base types, a char*, then structs with int/double/char* members and,
+// for every second struct, an earlier struct by value
+static void makeLayout(LayoutTable &table, unsigned numStructs) {
+  table.types.push_back({LayoutTypeKind::Base, "int", 4, dwarf::DW_ATE_signed, 0, {}});
+  table.types.push_back({LayoutTypeKind::Base, "char", 1, dwarf::DW_ATE_signed_char, 0, {}});
+  table.types.push_back({LayoutTypeKind::Base, "double", 8, dwarf::DW_ATE_float, 0, {}});
+  table.types.push_back({LayoutTypeKind::Pointer, "", 8, 0, 1, {}});
+  uint32_t firstStruct = table.types.size();
+  for (unsigned i = 0; i < numStructs; ++i) {
+    LayoutType type{LayoutTypeKind::Struct, table.save("S" + std::to_string(i)), 24, 0, 0, {}};
+    type.members.push_back({"a", 0, 0});
+    type.members.push_back({"b", 2, 8});
+    type.members.push_back({"c", 3, 16});
+    if (i % 2 && i > 0) {
+      type.members.push_back({"d", firstStruct + i / 2, 24});
+      type.byteSize += table.types[firstStruct + i / 2].byteSize;
+    }
+    table.types.push_back(std::move(type));
+  }
+}
+
+static Expected<DwarfSections> buildFull(const LayoutTable &table, LayoutCompileUnits &units) {
+  LayoutUnitPlan plan(table, 1, /*dedupTypes=*/false);
+  units = buildCompileUnits(plan, DwarfGeneratorOptions());
+  return serializeCompileUnits(units, formParams, computeCompileUnitOffsets(units.getUnitDies(), formParams));
+}
+
+// The types in unit order, with every reference renumbered to match
+static void copyInUnitOrder(const LayoutTable &table, ArrayRef<uint32_t> order, LayoutTable &copy) {
+  std::vector<uint32_t> newIndex(table.types.size());
+  for (uint32_t i = 0; i < order.size(); ++i)
+    newIndex[order[i]] = i;
+  for (uint32_t index : order) {
+    LayoutType type = table.types[index];
+    type.pointee = newIndex[type.pointee];
+    for (LayoutMember &member : type.members)
+      member.type = newIndex[member.type];
+    copy.types.push_back(std::move(type));
+  }
+}
+
+// Names, tags, attribute values and DW_AT_type targets as llvm-dwarfdump
+// prints them; string offsets and abbreviation codes are left out
+static std::string dumpInfo(const DwarfSectionsRef &sections) {
+  StringMap<std::unique_ptr<MemoryBuffer>> buffers;
+  auto addSection = [&](StringRef name, StringRef bytes) {
+    buffers[name] = MemoryBuffer::getMemBuffer(bytes, name, false);
+  };
+  addSection("debug_info", toStringRef(sections.info));
+  addSection("debug_abbrev", toStringRef(sections.abbrev));
+  addSection("debug_str", sections.str);
+  std::unique_ptr<DWARFContext> context = DWARFContext::create(buffers, formParams.AddrSize);
+  std::string text;
+  raw_string_ostream OS(text);
+  DIDumpOptions options;
+  options.DumpType = DIDT_DebugInfo;
+  context->dump(OS, options);
+  std::string verifyLog;
+  raw_string_ostream verifyOS(verifyLog);
+  if (!context->verify(verifyOS, options))
+    OS << "verify failed:\n" << verifyOS.str();
+  return OS.str();
+}
+
+// Whether a struct still in the unit has a member of type index
+static bool isReferenced(const LayoutTable &table, ArrayRef<uint32_t> liveStructs, uint32_t index) {
+  for (uint32_t source : liveStructs) {
+    for (const LayoutMember &member : table.types[source].members) {
+      if (member.type == index)
+        return true;
+    }
+  }
+  return false;
+}
+
+static bool checkAgainstFull(const LayoutTable &table, const IncrementalUnitLayout &layout) {
+  LayoutTable expected;
+  copyInUnitOrder(table, layout.getUnitOrder(), expected);
+  LayoutCompileUnits units;
+  Expected<DwarfSections> full = buildFull(expected, units);
+  if (!full) {
+    errs() << "full rebuild failed: " << toString(full.takeError()) << "\n";
+    return false;
+  }
+  DwarfSectionsRef patched = layout.getSections();
+  if (patched.info.size() != full->info.size()) {
+    errs() << "mismatch: patched .debug_info is " << patched.info.size() << " bytes, full rebuild " << full->info.size() << "\n";
+    return false;
+  }
+  std::string patchedDump = dumpInfo(patched);
+  if (patchedDump != dumpInfo(*full)) {
+    errs() << "mismatch: patched .debug_info does not dump like a full rebuild\n";
+    return false;
+  }
+  return true;
+}
+
+struct EditTimes {
+  std::vector<double> us;
+
+  void print(StringRef name) {
+    if (us.empty())
+      return;
+    std::sort(us.begin(), us.end());
+    double total = 0;
+    for (double t : us)
+      total += t;
+    outs() << format("  %-16s %6zu edits  p50 %9.1f us  p99 %9.1f us  mean %9.1f us\n", name.str().c_str(), us.size(),
+                     us[us.size() / 2], us[std::min(us.size() - 1, us.size() * 99 / 100)], total / us.size());
+  }
+};
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "Incremental re-layout benchmark\n");
+
+  LayoutTable table;
+  makeLayout(table, std::max(1u, unsigned(NumTypes)));
+  uint32_t firstStruct = 4;
+  uint32_t numStructs = table.types.size() - firstStruct;
+
+  Clock::time_point start = Clock::now();
+  LayoutCompileUnits units;
+  Expected<DwarfSections> full = buildFull(table, units);
+  if (!full) {
+    errs() << "error: " << toString(full.takeError()) << "\n";
+    return 1;
+  }
+  double fullUs = elapsedUs(start);
+  size_t infoSize = full->info.size();
+  units = LayoutCompileUnits();
+
+  IncrementalUnitLayout layout(table, formParams);
+  start = Clock::now();
+  if (Error err = layout.build()) {
+    errs() << "error: " << toString(std::move(err)) << "\n";
+    return 1;
+  }
+  double buildUs = elapsedUs(start);
+
+  EditTimes rename, addMember, removeMember, retype, addType, removeType;
+  EditTimes *kinds[] = {&rename, &addMember, &removeMember, &retype, &addType, &removeType};
+  // Structs still in the unit, in no particular order
+  std::vector<uint32_t> liveStructs;
+  for (uint32_t i = 0; i < numStructs; ++i)
+    liveStructs.push_back(firstStruct + i);
+  uint64_t seed = 0x9e3779b97f4a7c15ull;
+  auto nextRandom = [&] {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    return seed >> 33;
+  };
+  bool ok = true;
+  for (unsigned edit = 0; edit < NumEdits && ok; ++edit) {
+    size_t slot = nextRandom() % liveStructs.size();
+    unsigned kind = edit % 6;
+    // Only a struct nothing refers to can be removed; half of the initial ones qualify
+    if (kind == 5) {
+      for (unsigned attempt = 0; attempt < 64 && isReferenced(table, liveStructs, liveStructs[slot]); ++attempt)
+        slot = nextRandom() % liveStructs.size();
+      if (isReferenced(table, liveStructs, liveStructs[slot]))
+        continue;
+    }
+    uint32_t index = liveStructs[slot];
+    LayoutType &type = table.types[index];
+    start = Clock::now();
+    Error err = Error::success();
+    switch (kind) {
+    case 0:
+      type.members[0].name = table.save("renamed" + std::to_string(edit));
+      err = layout.updateType(index);
+      break;
+    case 1:
+      type.members.push_back({"extra", 2, type.byteSize});
+      type.byteSize += 8;
+      err = layout.updateType(index);
+      break;
+    case 2:
+      if (type.members.size() > 3) {
+        type.byteSize -= table.types[type.members.back().type].byteSize;
+        type.members.pop_back();
+      } else {
+        type.members.back().name = "c2";
+      }
+      err = layout.updateType(index);
+      break;
+    case 3:
+      type.members[0].type = type.members[0].type == 0 ? 2 : 0;
+      err = layout.updateType(index);
+      break;
+    case 4: {
+      uint32_t added = table.types.size();
+      table.types.push_back({LayoutTypeKind::Struct, table.save("Added" + std::to_string(edit)), 16, 0, 0,
+                             {{"inner", index, 0}, {"next", 3, 8}}});
+      err = layout.addType(added);
+      liveStructs.push_back(added);
+      break;
+    }
+    case 5:
+      err = layout.removeType(index);
+      liveStructs[slot] = liveStructs.back();
+      liveStructs.pop_back();
+      break;
+    }
+    double us = elapsedUs(start);
+    if (err) {
+      errs() << "edit " << edit << ": " << toString(std::move(err)) << "\n";
+      return 1;
+    }
+    kinds[kind]->us.push_back(us);
+    if (CheckEvery && (edit + 1) % CheckEvery == 0)
+      ok = checkAgainstFull(table, layout);
+  }
+  if (ok)
+    ok = checkAgainstFull(table, layout);
+
+  outs() << format("%u structs, %zu bytes of .debug_info\n", numStructs, infoSize);
+  outs() << format("  full rebuild     %12.1f us\n", fullUs);
+  outs() << format("  incremental build%12.1f us (baseline for the edits)\n", buildUs);
+  rename.print("rename member");
+  addMember.print("add member");
+  removeMember.print("remove member");
+  retype.print("retype member");
+  addType.print("add type");
+  removeType.print("remove type");
+  outs() << (ok ? "patched sections match a full rebuild\n" : "patched sections differ from a full rebuild\n");
+  return ok ? 0 : 1;
+}
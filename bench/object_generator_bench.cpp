@@ -0,0 +1,88 @@
+// Amortized per-module latency of the DIBuilder -> object path
+// - "fresh": a new TargetMachine per module. Target registration happens once
+//   per process and is not repeated, so this is a lower bound of what main.cpp
+//   used to pay per module (it registered every target on each run).
+// - "reused": one ObjectDwarfGenerator for the whole stream of modules
+
+#include <chrono>
+#include <cstdlib>
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/DIBuilderModule.h"
+#include "src/LayoutTable.h"
+#include "src/ObjectDwarfGenerator.h"
+
+using namespace llvm;
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static bool emitOne(ObjectDwarfGenerator &generator, const LayoutTable &table, size_t &objBytes) {
+  LLVMContext context;
+  Expected<std::unique_ptr<Module>> moduleOrErr = buildLayoutModule(context, table);
+  if (!moduleOrErr) {
+    errs() << toString(moduleOrErr.takeError()) << "\n";
+    return false;
+  }
+  SmallVector<char, 0> objBuffer;
+  if (Error err = generator.emitObject(**moduleOrErr, objBuffer)) {
+    errs() << toString(std::move(err)) << "\n";
+    return false;
+  }
+  objBytes += objBuffer.size();
+  return true;
+}
+
+int main(int argc, char **argv) {
+  size_t numModules = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+  size_t objBytes = 0;
+  LayoutTable table;
+  makeClassSampleLayout(table);
+
+  // One-time cost: target registration plus the first TargetMachine
+  auto start = Clock::now();
+  Expected<std::unique_ptr<ObjectDwarfGenerator>> generatorOrErr = ObjectDwarfGenerator::create();
+  if (!generatorOrErr) {
+    errs() << toString(generatorOrErr.takeError()) << "\n";
+    return 1;
+  }
+  double setupTime = secondsSince(start);
+  ObjectDwarfGenerator &generator = **generatorOrErr;
+
+  // Fresh TargetMachine for every module
+  start = Clock::now();
+  for (size_t i = 0; i < numModules; ++i) {
+    Expected<std::unique_ptr<ObjectDwarfGenerator>> fresh = ObjectDwarfGenerator::create();
+    if (!fresh) {
+      errs() << toString(fresh.takeError()) << "\n";
+      return 1;
+    }
+    if (!emitOne(**fresh, table, objBytes))
+      return 1;
+  }
+  double freshTime = secondsSince(start);
+
+  // Reused generator, reporting the amortized cost as the stream grows
+  outs() << "Target setup (once): " << format("%.3f ms", setupTime * 1e3) << "\n";
+  outs() << "   modules   reused us/module (incl. setup)   fresh us/module\n";
+  start = Clock::now();
+  size_t nextReport = 1;
+  for (size_t i = 1; i <= numModules; ++i) {
+    if (!emitOne(generator, table, objBytes))
+      return 1;
+    if (i == nextReport || i == numModules) {
+      double amortized = (setupTime + secondsSince(start)) / i;
+      outs() << format("%10zu %34.1f %17.1f\n", i, amortized * 1e6, freshTime / numModules * 1e6);
+      nextReport *= 10;
+    }
+  }
+
+  outs() << "Total object bytes: " << objBytes << "\n";
+  return 0;
+}
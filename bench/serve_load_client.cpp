@@ -0,0 +1,133 @@
+// Load test for LLVMDwarf_Simple --serve
+// - Each connection thread sends --requests layout requests back to back and
+//   times every round trip
+// - Reports throughput and the p50/p99/max latency over all connections
+// - Sends the given layout JSON, or the built-in MyClass example without one
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/DwarfServeProtocol.h"
+
+using namespace llvm;
+
+namespace {
+
+cl::opt<std::string> SocketPath("socket", cl::desc("Unix socket of the server"), cl::value_desc("path"), cl::Required);
+cl::opt<std::string> LayoutFile(cl::Positional, cl::desc("[layout.json]"), cl::init(""));
+cl::opt<unsigned> Connections("connections", cl::desc("Concurrent client connections"), cl::init(4));
+cl::opt<unsigned> Requests("requests", cl::desc("Requests per connection"), cl::init(1000));
+
+struct ConnectionStats {
+  std::vector<double> latencies;
+  size_t failed = 0;
+  size_t responseBytes = 0;
+  std::string error;
+};
+
+void runConnection(ArrayRef<uint8_t> request, ConnectionStats &stats) {
+  sockaddr_un addr;
+  makeServeSocketAddress(SocketPath, addr);
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    stats.error = "cannot connect to " + SocketPath;
+    if (fd >= 0)
+      ::close(fd);
+    return;
+  }
+
+  stats.latencies.reserve(Requests);
+  std::string part;
+  for (unsigned i = 0; i < Requests; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    uint32_t status, count;
+    bool ok = serveWriteAll(fd, request.data(), request.size()) && serveReadU32(fd, status) && serveReadU32(fd, count);
+    for (uint32_t p = 0; ok && p < count; ++p) {
+      ok = serveReadPart(fd, part, UINT32_MAX);
+      stats.responseBytes += part.size();
+    }
+    if (!ok) {
+      stats.error = "connection closed by the server";
+      break;
+    }
+    stats.latencies.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    if (status != uint32_t(DwarfServeStatus::Ok)) {
+      ++stats.failed;
+      if (stats.error.empty())
+        stats.error = part;
+    }
+  }
+  ::close(fd);
+}
+
+double percentile(const std::vector<double> &sorted, double p) {
+  size_t index = std::min(sorted.size() - 1, size_t(p * sorted.size()));
+  return sorted[index];
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "Load test client for the --serve DWARF generator\n");
+
+  std::string json;
+  if (!LayoutFile.empty()) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> bufferOrErr = MemoryBuffer::getFile(LayoutFile);
+    if (!bufferOrErr) {
+      errs() << "cannot read " << LayoutFile << ": " << bufferOrErr.getError().message() << "\n";
+      return 1;
+    }
+    json = (*bufferOrErr)->getBuffer().str();
+  }
+  sockaddr_un addr;
+  if (!makeServeSocketAddress(SocketPath, addr)) {
+    errs() << "socket path too long: " << SocketPath << "\n";
+    return 1;
+  }
+
+  // The request never changes, so it is encoded once
+  SmallVector<uint8_t, 0> request;
+  appendServePart(request, arrayRefFromStringRef(json));
+
+  unsigned numConnections = std::max(1u, unsigned(Connections));
+  std::vector<ConnectionStats> stats(numConnections);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < numConnections; ++i)
+    threads.emplace_back([&, i] { runConnection(request, stats[i]); });
+  for (std::thread &thread : threads)
+    thread.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::vector<double> latencies;
+  size_t failed = 0, responseBytes = 0;
+  for (const ConnectionStats &connection : stats) {
+    if (!connection.error.empty())
+      errs() << "warning: " << connection.error << "\n";
+    latencies.insert(latencies.end(), connection.latencies.begin(), connection.latencies.end());
+    failed += connection.failed;
+    responseBytes += connection.responseBytes;
+  }
+  if (latencies.empty()) {
+    errs() << "no request completed\n";
+    return 1;
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  outs() << "Requests: " << latencies.size() << " over " << numConnections << " connections (" << failed << " failed), "
+         << format("%.1f", responseBytes / double(latencies.size())) << " response bytes each\n";
+  outs() << "Throughput: " << format("%.0f", latencies.size() / seconds) << " requests/sec\n";
+  outs() << "Latency: p50 " << format("%.1f", percentile(latencies, 0.50) * 1e6) << " us, p99 "
+         << format("%.1f", percentile(latencies, 0.99) * 1e6) << " us, max " << format("%.1f", latencies.back() * 1e6) << " us\n";
+  return failed || latencies.size() != size_t(numConnections) * Requests ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+// String pool interning micro-benchmark
+// - Compares the original std::map based pool against SimpleStringPool
+// - Workload mimics member/type names: every unique name is interned ~4 times
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/SimpleStringPool.h"
+
+using namespace llvm;
+
+// The previous std::map backed pool, kept verbatim as the baseline
+class MapStringPool {
+  std::string data;
+  std::map<std::string, uint32_t> offsets;
+
+public:
+  uint32_t add(const std::string &str) {
+    auto it = offsets.find(str);
+    if (it != offsets.end()) {
+      return it->second;
+    }
+    uint32_t offset = data.size();
+    offsets[str] = offset;
+    data += str;
+    data += '\0';
+    return offset;
+  }
+
+  uint32_t getSize() const {
+    return data.size();
+  }
+};
+
+static std::vector<std::string> makeWorkload(size_t count) {
+  static const char *prefixes[] = {"m_", "member_", "field", "Class", "struct.", "ptr_to_"};
+  size_t unique = count / 4 + 1;
+  std::vector<std::string> names;
+  names.reserve(count);
+  uint64_t seed = 0x9e3779b97f4a7c15ULL;
+  for (size_t i = 0; i < count; ++i) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    size_t id = (seed >> 33) % unique;
+    names.push_back(std::string(prefixes[id % 6]) + std::to_string(id));
+  }
+  return names;
+}
+
+template <typename Pool, typename Key> static double runOnce(const std::vector<Key> &keys, uint32_t &checksum) {
+  auto start = std::chrono::steady_clock::now();
+  Pool pool;
+  uint32_t sum = 0;
+  for (const Key &k : keys)
+    sum += pool.add(k);
+  auto end = std::chrono::steady_clock::now();
+  checksum = sum + pool.getSize();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+template <typename Pool, typename Key> static double bestOf(const std::vector<Key> &keys, uint32_t &checksum, int repeats) {
+  double best = 1e30;
+  for (int r = 0; r < repeats; ++r)
+    best = std::min(best, runOnce<Pool>(keys, checksum));
+  return best;
+}
+
+int main() {
+  outs() << "String pool interning throughput (best of 3)\n";
+  outs() << "   strings     map ns/add    hash ns/add     map Madd/s    hash Madd/s   speedup\n";
+
+  for (size_t count : {10000u, 100000u, 1000000u}) {
+    std::vector<std::string> names = makeWorkload(count);
+    std::vector<StringRef> refs(names.begin(), names.end());
+
+    uint32_t mapSum = 0, hashSum = 0;
+    double mapTime = bestOf<MapStringPool>(names, mapSum, 3);
+    double hashTime = bestOf<SimpleStringPool>(refs, hashSum, 3);
+    if (mapSum != hashSum) {
+      errs() << "Checksum mismatch between pools at " << count << " strings\n";
+      return 1;
+    }
+
+    outs() << format("%10zu %14.1f %14.1f %14.2f %14.2f %8.2fx\n", count, mapTime * 1e9 / count, hashTime * 1e9 / count, count / mapTime / 1e6,
+                     count / hashTime / 1e6, mapTime / hashTime);
+  }
+  return 0;
+}
@@ -0,0 +1,22 @@
+# Writes ${OUTPUT} defining LLVMDWARF_GENERATOR_VERSION, a hash of every source
+# file under ${SOURCE_DIR}/src. The on-disk cache mixes it into its keys, so a
+# rebuilt generator whose output may differ never reuses older entries.
+# Run at build time; the file is only rewritten when the hash changes.
+file(GLOB sources "${SOURCE_DIR}/src/*.cpp" "${SOURCE_DIR}/src/*.h")
+list(SORT sources)
+set(combined "")
+foreach(source ${sources})
+  file(SHA256 "${source}" hash)
+  file(RELATIVE_PATH name "${SOURCE_DIR}" "${source}")
+  string(APPEND combined "${name} ${hash}\n")
+endforeach()
+string(SHA256 version "${combined}")
+string(SUBSTRING "${version}" 0 16 version)
+
+set(content "#pragma once\n\n// Generated by cmake/GeneratorVersion.cmake\n#define LLVMDWARF_GENERATOR_VERSION \"${version}\"\n")
+if(EXISTS "${OUTPUT}")
+  file(READ "${OUTPUT}" previous)
+endif()
+if(NOT previous STREQUAL content)
+  file(WRITE "${OUTPUT}" "${content}")
+endif()
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/LEB128.h"
+
+// Little-endian integers and LEB128, as written into DWARF sections, ELF
+// compression headers and cache entries. size is in bytes (at most 8).
+
+inline void writeLE(uint8_t *out, uint64_t value, unsigned size) {
+  for (unsigned i = 0; i < size; ++i)
+    out[i] = uint8_t(value >> (8 * i));
+}
+
+inline uint64_t readLE(const uint8_t *in, unsigned size) {
+  uint64_t value = 0;
+  for (unsigned i = 0; i < size; ++i)
+    value |= uint64_t(in[i]) << (8 * i);
+  return value;
+}
+
+// Append value as a size-byte little-endian integer
+inline void writeInt(llvm::SmallVectorImpl<uint8_t> &out, uint64_t value, unsigned size) {
+  size_t at = out.size();
+  out.resize_for_overwrite(at + size);
+  writeLE(out.data() + at, value, size);
+}
+
+// Overwrite the size bytes at out[at], e.g. a length known only at the end
+inline void patchInt(llvm::SmallVectorImpl<uint8_t> &out, size_t at, uint64_t value, unsigned size) {
+  writeLE(out.data() + at, value, size);
+}
+
+inline void writeULEB(llvm::SmallVectorImpl<uint8_t> &out, uint64_t value) {
+  uint8_t buf[16];
+  unsigned n = llvm::encodeULEB128(value, buf);
+  out.append(buf, buf + n);
+}
+
+inline void writeSLEB(llvm::SmallVectorImpl<uint8_t> &out, int64_t value) {
+  uint8_t buf[16];
+  unsigned n = llvm::encodeSLEB128(value, buf);
+  out.append(buf, buf + n);
+}
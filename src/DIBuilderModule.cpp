@@ -0,0 +1,160 @@
+#include <vector>
+
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/DIBuilderModule.h"
+#include "src/PhaseTiming.h"
+
+using namespace llvm;
+
+namespace {
+
+// Creates DIBuilder types for a layout table, memoized by type index
+class LayoutTypeBuilder {
+  DIBuilder &builder;
+  DICompileUnit *CU;
+  const LayoutTable &table;
+  std::vector<DIType *> types;
+  std::vector<bool> inProgress;
+
+public:
+  LayoutTypeBuilder(DIBuilder &builder, DICompileUnit *CU, const LayoutTable &table)
+      : builder(builder), CU(CU), table(table), types(table.types.size()), inProgress(table.types.size()) {
+  }
+
+  Expected<DIType *> getType(uint32_t index) {
+    if (types[index])
+      return types[index];
+    if (inProgress[index])
+      return createStringError(inconvertibleErrorCode(), "type #%u: pointer cycle without an aggregate", index);
+
+    const LayoutType &type = table.types[index];
+    uint64_t sizeInBits = type.byteSize * 8;
+    uint32_t alignInBits = type.alignment * 8;
+    switch (type.kind) {
+    case LayoutTypeKind::Base:
+      types[index] = builder.createBasicType(type.name, sizeInBits, type.encoding);
+      break;
+    case LayoutTypeKind::Pointer: {
+      inProgress[index] = true;
+      Expected<DIType *> pointee = getType(type.pointee);
+      if (!pointee)
+        return pointee.takeError();
+      types[index] = builder.createPointerType(*pointee, sizeInBits, 0, {}, type.name);
+      break;
+    }
+    case LayoutTypeKind::Struct:
+    case LayoutTypeKind::Class: {
+      // Create the composite without elements first, so members may refer back to it
+      DICompositeType *composite;
+      if (type.kind == LayoutTypeKind::Class) {
+        composite = builder.createClassType(CU,               // Scope (compile unit)
+                                            type.name,        // Name
+                                            nullptr,          // File (no source file)
+                                            0,                // Line number (no line info)
+                                            sizeInBits,       // Size in bits
+                                            alignInBits,      // Alignment in bits
+                                            0,                // Offset
+                                            DINode::FlagZero, // Flags
+                                            nullptr,          // Derived from
+                                            nullptr           // Elements (will add members)
+        );
+      } else {
+        composite = builder.createStructType(CU,               // Scope (compile unit)
+                                             type.name,        // Name
+                                             nullptr,          // File (no source file)
+                                             0,                // Line number (no line info)
+                                             sizeInBits,       // Size in bits
+                                             alignInBits,      // Alignment in bits
+                                             DINode::FlagZero, // Flags
+                                             nullptr,          // Derived from
+                                             nullptr           // Elements (will add members)
+        );
+      }
+      types[index] = composite;
+
+      // Create member variables for the class
+      SmallVector<Metadata *, 8> members;
+      for (const LayoutMember &member : type.members) {
+        Expected<DIType *> memberType = getType(member.type);
+        if (!memberType)
+          return memberType.takeError();
+        members.push_back(builder.createMemberType(composite,                             // Scope
+                                                   member.name,                           // Name
+                                                   nullptr,                               // File (no source)
+                                                   0,                                     // Line (no line info)
+                                                   table.types[member.type].byteSize * 8, // Size in bits
+                                                   member.alignment * 8,                  // Alignment
+                                                   member.offset * 8,                     // Offset in bits
+                                                   DINode::FlagZero,                      // Flags
+                                                   *memberType                            // Type
+                                                   ));
+      }
+      // Replace the class elements with the members array
+      builder.replaceArrays(composite, builder.getOrCreateArray(members));
+      break;
+    }
+    }
+    return types[index];
+  }
+};
+
+} // namespace
+
+Expected<std::unique_ptr<Module>> buildLayoutModule(LLVMContext &context, const LayoutTable &table, StringRef moduleName,
+                                                    function_ref<void()> beforeFinalize) {
+  auto module = std::make_unique<Module>(moduleName, context);
+
+  // Create DIBuilder
+  DIBuilder builder(*module);
+
+  // Create a compile unit with the table's producer
+  // Use a placeholder file (required by LLVM, but we won't use line info)
+  DIFile *file = builder.createFile("<unknown>", "");
+
+  DICompileUnit *CU = builder.createCompileUnit(dwarf::DW_LANG_C_plus_plus, // Language
+                                                file,                       // File
+                                                table.producer,             // Producer (the name we want)
+                                                false,                      // isOptimized
+                                                "",                         // Flags
+                                                0                           // Runtime Version
+  );
+
+  // Create every type of the table in one pass
+  {
+    PhaseScope phase("DIBuilder types");
+    LayoutTypeBuilder typeBuilder(builder, CU, table);
+    SmallVector<Metadata *, 0> retainedTypes;
+    retainedTypes.reserve(table.types.size());
+    for (uint32_t i = 0; i < table.types.size(); ++i) {
+      Expected<DIType *> type = typeBuilder.getType(i);
+      if (!type)
+        return type.takeError();
+      retainedTypes.push_back(*type);
+    }
+
+    // Add all types to the compile unit's retained types
+    // This ensures the types appear in DWARF even without a variable
+    CU->replaceRetainedTypes(MDTuple::get(context, retainedTypes));
+  }
+
+  // Finalize the debug info
+  if (beforeFinalize)
+    beforeFinalize();
+  {
+    PhaseScope phase("DIBuilder::finalize");
+    builder.finalize();
+  }
+
+  // Verify the module
+  PhaseScope phase("verifyModule");
+  std::string errorMsg;
+  raw_string_ostream errorStream(errorMsg);
+  if (verifyModule(*module, &errorStream)) {
+    return createStringError(inconvertibleErrorCode(), "Module verification failed: %s", errorMsg.c_str());
+  }
+
+  return std::move(module);
+}
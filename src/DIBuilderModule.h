@@ -0,0 +1,19 @@
+#pragma once
+
+#include <memory>
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+
+#include "src/LayoutTable.h"
+
+// Build a module whose debug info describes every type of a layout table
+// through DIBuilder, all retained by a single compile unit.
+// The module is finalized and verified, but has no target triple yet.
+// beforeFinalize runs once every type exists, so benchmarks can time the two halves.
+llvm::Expected<std::unique_ptr<llvm::Module>> buildLayoutModule(llvm::LLVMContext &context, const LayoutTable &table,
+                                                                llvm::StringRef moduleName = "test_module",
+                                                                llvm::function_ref<void()> beforeFinalize = {});
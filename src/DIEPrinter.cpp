@@ -0,0 +1,500 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <future>
+#include <system_error>
+#include <utility>
+
+#include <sys/uio.h>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include "src/DIEPrinter.h"
+
+using namespace llvm;
+
+namespace {
+
+// "00" .. "ff", two characters per byte value
+struct HexPairTable {
+  char pairs[512];
+
+  constexpr HexPairTable() : pairs() {
+    const char digits[] = "0123456789abcdef";
+    for (unsigned i = 0; i < 256; ++i) {
+      pairs[2 * i] = digits[i >> 4];
+      pairs[2 * i + 1] = digits[i & 15];
+    }
+  }
+};
+constexpr HexPairTable HexPairs;
+
+// Appenders for a cursor into a buffer that has room for what they write.
+// The cursor is a local of the caller: kept in a member, every character
+// store could alias it and force a reload.
+void put(char *&out, StringRef str) {
+  // Mostly short names, where a call to memcpy costs more than the copy
+  if (str.size() > 32) {
+    std::memcpy(out, str.data(), str.size());
+    out += str.size();
+    return;
+  }
+  for (char c : str)
+    *out++ = c;
+}
+template <size_t N> void put(char *&out, const char (&literal)[N]) {
+  std::memcpy(out, literal, N - 1);
+  out += N - 1;
+}
+void put(char *&out, char c) {
+  *out++ = c;
+}
+// Indents up to 64 are one fixed-size copy, so lines reserve 64 bytes more than they use
+void putSpaces(char *&out, unsigned count) {
+  static constexpr char Spaces[] = "                                                                ";
+  if (count <= 64)
+    std::memcpy(out, Spaces, 64);
+  else
+    std::memset(out, ' ', count);
+  out += count;
+}
+// Lowercase hex of at least minDigits digits: format("%08x") with 8, write_hex() with 1
+void putHex(char *&out, uint64_t value, unsigned minDigits) {
+  unsigned numDigits = std::max(minDigits, Log2_64(value | 1) / 4 + 1);
+  char *digit = out + numDigits;
+  for (; digit - out >= 2; value >>= 8) {
+    digit -= 2;
+    std::memcpy(digit, HexPairs.pairs + 2 * (value & 0xff), 2);
+  }
+  if (digit != out)
+    *out = HexPairs.pairs[2 * (value & 0xf) + 1];
+  out += numDigits;
+}
+void putDecimal(char *&out, unsigned value) {
+  char digits[10];
+  char *digitsEnd = digits + 10, *begin = digitsEnd;
+  do {
+    *--begin = char('0' + value % 10);
+    value /= 10;
+  } while (value);
+  put(out, StringRef(begin, digitsEnd - begin));
+}
+void putOffset(char *&out, uint64_t offset) {
+  put(out, "0x");
+  putHex(out, offset, 8);
+}
+
+// dwarf::*String() results for the small codes, each padded to a fixed-size
+// slot, so that appending a common name is one fixed-size copy instead of a
+// call into LLVM and a copy of unknown length
+class DwarfNameTable {
+  static constexpr unsigned SlotSize = 32;
+  static constexpr uint8_t NotInSlot = 0xff;
+
+  StringRef (*lookup)(unsigned);
+  char slots[256][SlotSize] = {};
+  uint8_t sizes[256] = {};
+
+  bool inSlot(unsigned code) const {
+    return code < 256 && sizes[code] != NotInSlot;
+  }
+
+public:
+  explicit DwarfNameTable(StringRef (*lookup)(unsigned)) : lookup(lookup) {
+    for (unsigned code = 0; code < 256; ++code) {
+      StringRef name = lookup(code);
+      sizes[code] = name.size() <= SlotSize ? name.size() : NotInSlot;
+      if (sizes[code] != NotInSlot)
+        std::memcpy(slots[code], name.data(), name.size());
+    }
+  }
+
+  size_t getSize(unsigned code) const {
+    return inSlot(code) ? sizes[code] : lookup(code).size();
+  }
+  // Writes up to SlotSize bytes past the name
+  void append(char *&out, unsigned code) const {
+    if (!inSlot(code)) {
+      put(out, lookup(code));
+      return;
+    }
+    std::memcpy(out, slots[code], SlotSize);
+    out += sizes[code];
+  }
+};
+
+const DwarfNameTable TagNames([](unsigned tag) { return dwarf::TagString(tag); });
+const DwarfNameTable AttributeNames([](unsigned attribute) { return dwarf::AttributeString(attribute); });
+const DwarfNameTable FormNames([](unsigned form) { return dwarf::FormEncodingString(form); });
+
+// Dump text writer over a reusable buffer
+// - Each line reserves an upper bound of its length once and is then written
+//   through a raw cursor: plain copies with no format() parsing, capacity
+//   checks or temporaries; strings are copied from the pool's StringRefs
+// - Walks the tree with an explicit stack, so depth is only bounded by memory
+// - With a stream, the text is written out whenever it passes FlushSize and
+//   once more at the end; without one, it all stays in the buffer
+class DIETextWriter {
+  static constexpr size_t FlushSize = 1 << 20;
+  // Room for everything on a line except the indent and the variable-length
+  // names and strings, plus the overshoot of putSpaces() and DwarfNameTable
+  static constexpr size_t LineSlack = 160;
+
+  SmallVectorImpl<char> &buffer;
+  raw_ostream *OS;
+  const SimpleStringPool &stringPool;
+  uint64_t unitOffset;
+  const DwarfUnitOffsets &unitOffsets;
+  // Bytes of buffer written so far; the rest of its storage is scratch
+  size_t size;
+
+  // Cursor at the end of the text, with room for bytes more
+  char *reserve(size_t bytes) {
+    if (buffer.size() - size < bytes)
+      buffer.resize_for_overwrite(std::max(buffer.size() * 2, size + bytes));
+    return buffer.data() + size;
+  }
+  void commit(char *out) {
+    size = out - buffer.data();
+  }
+
+public:
+  DIETextWriter(SmallVectorImpl<char> &buffer, raw_ostream *OS, const SimpleStringPool &stringPool, uint64_t unitOffset,
+                const DwarfUnitOffsets &unitOffsets)
+      : buffer(buffer), OS(OS), stringPool(stringPool), unitOffset(unitOffset), unitOffsets(unitOffsets), size(buffer.size()) {
+    if (OS && buffer.size() < FlushSize + FlushSize / 2)
+      buffer.resize_for_overwrite(FlushSize + FlushSize / 2);
+  }
+  ~DIETextWriter() {
+    flush();
+    buffer.truncate(size);
+  }
+
+  void flush() {
+    if (OS && size) {
+      OS->write(buffer.data(), size);
+      size = 0;
+    }
+  }
+  void flushIfFull() {
+    if (size >= FlushSize)
+      flush();
+  }
+
+  void writeAttributes(const DIE &die, unsigned indent) {
+    char *out = reserve(indent + TagNames.getSize(die.getTag()) + LineSlack);
+    putSpaces(out, indent);
+    putOffset(out, die.getOffset() + unitOffset);
+    put(out, ": ");
+    TagNames.append(out, die.getTag());
+    put(out, " [");
+    putDecimal(out, die.getAbbrevNumber());
+    if (die.hasChildren())
+      put(out, "] *\n");
+    else
+      put(out, "]\n");
+    commit(out);
+
+    for (const DIEValue &V : die.values()) {
+      dwarf::Form form = V.getForm();
+      bool isInteger = V.getType() == DIEValue::isInteger;
+      uint64_t val = isInteger ? V.getDIEInteger().getValue() : 0;
+      bool isStrx = form >= dwarf::DW_FORM_strx1 && form <= dwarf::DW_FORM_strx4;
+      // The string or encoding name the value prints as, if any
+      StringRef text;
+      if (isInteger && form == dwarf::DW_FORM_strp)
+        text = stringPool.getStringAt(val);
+      else if (isInteger && isStrx)
+        text = stringPool.getStringAt(stringPool.getOffsetOfIndex(val));
+      else if (isInteger && V.getAttribute() == dwarf::DW_AT_encoding)
+        text = dwarf::AttributeEncodingString(val);
+
+      out = reserve(indent + AttributeNames.getSize(V.getAttribute()) + FormNames.getSize(form) + text.size() + LineSlack);
+      putSpaces(out, indent + 2);
+      AttributeNames.append(out, V.getAttribute());
+      put(out, " = ");
+
+      switch (V.getType()) {
+      case DIEValue::isInteger: {
+        if (form == dwarf::DW_FORM_strp) {
+          put(out, '"');
+          put(out, text);
+          put(out, "\" (strp offset: ");
+          putOffset(out, val);
+          put(out, ')');
+        } else if (isStrx) {
+          put(out, '"');
+          put(out, text);
+          put(out, "\" (indexed string: ");
+          putOffset(out, val);
+          put(out, ')');
+        } else if (V.getAttribute() == dwarf::DW_AT_encoding) {
+          put(out, text);
+        } else if (form == dwarf::DW_FORM_ref_sig8) {
+          put(out, "0x");
+          putHex(out, val, 16);
+        } else if (form == dwarf::DW_FORM_ref4) {
+          // Resolved reference to a DIE that is no longer in memory (streaming)
+          put(out, '{');
+          putOffset(out, val + unitOffset);
+          put(out, '}');
+        } else {
+          put(out, "0x");
+          putHex(out, val, 1);
+        }
+        break;
+      }
+      case DIEValue::isEntry: {
+        const DIE &refDie = V.getDIEEntry().getEntry();
+        uint64_t refUnitOffset = unitOffset;
+        if (form == dwarf::DW_FORM_ref_addr)
+          refUnitOffset = unitOffsets.lookup(refDie.getUnitDie());
+        put(out, '{');
+        putOffset(out, refDie.getOffset() + refUnitOffset);
+        put(out, '}');
+        break;
+      }
+      default:
+        put(out, "<unknown type>");
+        break;
+      }
+
+      put(out, " [");
+      FormNames.append(out, form);
+      put(out, "]\n");
+      commit(out);
+    }
+  }
+
+  // "0x<index>: <offset> "<string>"", one line of .debug_str_offsets
+  void writeStringOffset(uint32_t index, uint32_t offset) {
+    StringRef str = stringPool.getStringAt(offset);
+    char *out = reserve(str.size() + LineSlack);
+    putOffset(out, index);
+    put(out, ": ");
+    putHex(out, offset, 8);
+    put(out, " \"");
+    put(out, str);
+    put(out, "\"\n");
+    commit(out);
+  }
+  // "0x<offset>: "<string>"", one line of .debug_str; returns the string
+  StringRef writeString(uint32_t offset) {
+    StringRef str = stringPool.getStringAt(offset);
+    char *out = reserve(str.size() + LineSlack);
+    putOffset(out, offset);
+    put(out, ": \"");
+    put(out, str);
+    put(out, "\"\n");
+    commit(out);
+    return str;
+  }
+
+  // The "NULL" line closing the children of die, if it has any
+  void writeEnd(const DIE &die, unsigned indent) {
+    if (!die.hasChildren())
+      return;
+    char *out = reserve(indent + LineSlack);
+    putSpaces(out, indent);
+    put(out, "NULL\n");
+    commit(out);
+  }
+
+  // die, everything below it in pre-order, and a "NULL" line after the children of each DIE that has them
+  void writeTree(DIE &die, unsigned indent) {
+    SmallVector<std::pair<DIE *, DIE::child_iterator>, 32> stack;
+    writeAttributes(die, indent);
+    stack.push_back({&die, die.children().begin()});
+    while (!stack.empty()) {
+      DIE *parent = stack.back().first;
+      DIE::child_iterator &next = stack.back().second;
+      unsigned depthIndent = indent + 2 * (stack.size() - 1);
+      if (next != parent->children().end()) {
+        DIE &child = *next;
+        ++next;
+        writeAttributes(child, depthIndent + 2);
+        flushIfFull();
+        stack.push_back({&child, child.children().begin()});
+        continue;
+      }
+      writeEnd(*parent, depthIndent);
+      stack.pop_back();
+    }
+  }
+};
+
+const DwarfUnitOffsets NoUnitOffsets;
+
+// Reused by every dump on a thread, so steady-state dumping does not allocate
+SmallVectorImpl<char> &getThreadBuffer() {
+  thread_local SmallVector<char, 0> buffer;
+  buffer.clear();
+  return buffer;
+}
+
+} // namespace
+
+void printDIEAttributes(raw_ostream &OS, DIE &die, const SimpleStringPool &stringPool, uint64_t unitOffset,
+                        const DwarfUnitOffsets &unitOffsets, int indent) {
+  DIETextWriter(getThreadBuffer(), &OS, stringPool, unitOffset, unitOffsets).writeAttributes(die, indent);
+}
+
+void printDIE(raw_ostream &OS, DIE &die, const SimpleStringPool &stringPool, uint64_t unitOffset, const DwarfUnitOffsets &unitOffsets,
+              int indent) {
+  DIETextWriter(getThreadBuffer(), &OS, stringPool, unitOffset, unitOffsets).writeTree(die, indent);
+}
+
+void printStringOffsets(raw_ostream &OS, const SimpleStringPool &stringPool) {
+  DIETextWriter writer(getThreadBuffer(), &OS, stringPool, 0, NoUnitOffsets);
+  for (uint32_t index = 0; index < stringPool.getNumIndices(); ++index) {
+    writer.writeStringOffset(index, stringPool.getOffsetOfIndex(index));
+    writer.flushIfFull();
+  }
+}
+
+void printStringPool(raw_ostream &OS, const SimpleStringPool &stringPool) {
+  DIETextWriter writer(getThreadBuffer(), &OS, stringPool, 0, NoUnitOffsets);
+  StringRef strData = stringPool.getData();
+  for (uint32_t offset = 0; offset < strData.size();) {
+    StringRef str = writer.writeString(offset);
+    writer.flushIfFull();
+    offset += str.size() + 1;
+  }
+}
+
+#if LLVM_VERSION_MAJOR >= 18
+using DumpThreadPool = DefaultThreadPool;
+#else
+using DumpThreadPool = ThreadPool;
+#endif
+
+struct ParallelDIEDump::RenderPool {
+  DumpThreadPool threads;
+
+  explicit RenderPool(ThreadPoolStrategy strategy) : threads(strategy) {
+  }
+};
+
+// Text written directly, or one range of children rendered on the pool (ready is valid)
+struct ParallelDIEDump::Chunk {
+  SmallVector<char, 0> text;
+  std::shared_future<void> ready;
+};
+
+// Ranges per thread, so that ranges of unequal cost still balance
+static constexpr unsigned RangesPerThread = 8;
+// Buffers per writev() call at most, fewer when the next one is not rendered yet
+static constexpr size_t MaxWriteBatch = std::min(IOV_MAX, 64);
+
+unsigned ParallelDIEDump::getNumThreads(unsigned numThreads) {
+  return hardware_concurrency(numThreads).compute_thread_count();
+}
+
+ParallelDIEDump::ParallelDIEDump(unsigned numThreads) : raw_ostream(/*unbuffered=*/true) {
+  ThreadPoolStrategy strategy = hardware_concurrency(numThreads);
+  this->numThreads = strategy.compute_thread_count();
+  assert(this->numThreads > 1 && "print a single-threaded dump with printDIE()");
+  pool = std::make_unique<RenderPool>(strategy);
+}
+
+ParallelDIEDump::~ParallelDIEDump() {
+  pool->threads.wait();
+}
+
+ParallelDIEDump::Chunk &ParallelDIEDump::getTail() {
+  if (chunks.empty() || chunks.back()->ready.valid())
+    chunks.push_back(std::make_unique<Chunk>());
+  return *chunks.back();
+}
+
+void ParallelDIEDump::write_impl(const char *ptr, size_t size) {
+  getTail().text.append(ptr, ptr + size);
+  directBytes += size;
+}
+
+void ParallelDIEDump::printDIE(DIE &die, const SimpleStringPool &stringPool, uint64_t unitOffset, const DwarfUnitOffsets &unitOffsets,
+                               int indent) {
+  DIETextWriter(getTail().text, nullptr, stringPool, unitOffset, unitOffsets).writeAttributes(die, indent);
+
+  std::vector<DIE *> children;
+  for (DIE &child : die.children())
+    children.push_back(&child);
+  size_t numRanges = std::min<size_t>(children.size(), numThreads * RangesPerThread);
+  size_t rangeSize = numRanges ? (children.size() + numRanges - 1) / numRanges : 0;
+  for (size_t begin = 0; begin < children.size(); begin += rangeSize) {
+    chunks.push_back(std::make_unique<Chunk>());
+    Chunk &chunk = *chunks.back();
+    std::vector<DIE *> range(children.begin() + begin, children.begin() + std::min(begin + rangeSize, children.size()));
+    chunk.ready = pool->threads.async([&chunk, range = std::move(range), &stringPool, unitOffset, &unitOffsets, indent] {
+      DIETextWriter writer(chunk.text, nullptr, stringPool, unitOffset, unitOffsets);
+      for (DIE *child : range)
+        writer.writeTree(*child, indent + 2);
+    });
+  }
+
+  DIETextWriter(getTail().text, nullptr, stringPool, unitOffset, unitOffsets).writeEnd(die, indent);
+}
+
+Error ParallelDIEDump::writeTo(int fd) {
+  SmallVector<iovec, 64> batch;
+  size_t batchBegin = 0;
+  auto writeBatch = [&](size_t batchEnd) -> Error {
+    iovec *next = batch.data();
+    size_t remaining = batch.size();
+    while (remaining) {
+      ssize_t written = ::writev(fd, next, remaining);
+      if (written < 0) {
+        if (errno == EINTR)
+          continue;
+        std::error_code ec(errno, std::generic_category());
+        return createStringError(ec, "cannot write the dump: %s", ec.message().c_str());
+      }
+      for (; remaining && size_t(written) >= next->iov_len; ++next, --remaining)
+        written -= next->iov_len;
+      if (remaining) {
+        next->iov_base = static_cast<char *>(next->iov_base) + written;
+        next->iov_len -= written;
+      }
+    }
+    batch.clear();
+    for (; batchBegin < batchEnd; ++batchBegin)
+      chunks[batchBegin].reset();
+    return Error::success();
+  };
+
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    Chunk &chunk = *chunks[i];
+    if (chunk.ready.valid() && chunk.ready.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      // Hand what is rendered to the kernel while this range finishes
+      if (Error err = writeBatch(i))
+        return err;
+      chunk.ready.wait();
+    }
+    if (!chunk.text.empty())
+      batch.push_back({chunk.text.data(), chunk.text.size()});
+    if (batch.size() == MaxWriteBatch) {
+      if (Error err = writeBatch(i + 1))
+        return err;
+    }
+  }
+  Error err = writeBatch(chunks.size());
+  chunks.clear();
+  directBytes = 0;
+  return err;
+}
+
+void ParallelDIEDump::writeTo(raw_ostream &OS) {
+  for (std::unique_ptr<Chunk> &chunk : chunks) {
+    if (chunk->ready.valid())
+      chunk->ready.wait();
+    OS.write(chunk->text.data(), chunk->text.size());
+    chunk.reset();
+  }
+  chunks.clear();
+  directBytes = 0;
+}
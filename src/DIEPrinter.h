@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "llvm/CodeGen/DIE.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/DwarfSectionWriter.h"
+#include "src/SimpleStringPool.h"
+
+// Print a DIE and everything below it with indentation. Offsets are relative
+// to the section, unitOffsets resolves DW_FORM_ref_addr into other compile units.
+// - Iterative, so nesting depth is not limited by the call stack
+// - Text is formatted into a per-thread buffer that is reused across calls
+//   and written to OS in large blocks
+void printDIE(llvm::raw_ostream &OS, llvm::DIE &die, const SimpleStringPool &stringPool, uint64_t unitOffset,
+              const DwarfUnitOffsets &unitOffsets, int indent = 0);
+// Only the header line and attributes of die, for units printed child by
+// child; the caller prints the closing "NULL" line
+void printDIEAttributes(llvm::raw_ostream &OS, llvm::DIE &die, const SimpleStringPool &stringPool, uint64_t unitOffset,
+                        const DwarfUnitOffsets &unitOffsets, int indent = 0);
+
+// One line per string index: the .debug_str offset and the string
+void printStringOffsets(llvm::raw_ostream &OS, const SimpleStringPool &stringPool);
+// One line per .debug_str entry
+void printStringPool(llvm::raw_ostream &OS, const SimpleStringPool &stringPool);
+
+// printDIE() text of large dumps, rendered on a thread pool
+// - A raw_ostream: text written to it directly stays in order with the DIEs
+// - printDIE() splits the children of die into contiguous ranges and renders
+//   each range into its own buffer on the pool while the caller goes on
+// - writeTo() takes the buffers in order, waiting for ranges still being
+//   rendered, and writes them with writev(), releasing each once written
+// The output is byte-identical to printing everything with printDIE() in
+// order. The DIEs, pools and offsets passed in must outlive writeTo().
+class ParallelDIEDump : public llvm::raw_ostream {
+  struct Chunk;
+  struct RenderPool;
+
+  std::unique_ptr<RenderPool> pool;
+  unsigned numThreads;
+  std::vector<std::unique_ptr<Chunk>> chunks;
+  // Bytes written to the stream itself; the DIE text is not counted
+  uint64_t directBytes = 0;
+
+  Chunk &getTail();
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override {
+    return directBytes;
+  }
+
+public:
+  // Threads that numThreads (0 = all cores) gives. With one, a ParallelDIEDump
+  // would only hold the whole dump in memory, so print it with printDIE().
+  static unsigned getNumThreads(unsigned numThreads);
+
+  // numThreads must give more than one thread
+  explicit ParallelDIEDump(unsigned numThreads);
+  ~ParallelDIEDump() override;
+
+  void printDIE(llvm::DIE &die, const SimpleStringPool &stringPool, uint64_t unitOffset, const DwarfUnitOffsets &unitOffsets,
+                int indent = 0);
+
+  // Write everything printed so far to the file descriptor and start over
+  llvm::Error writeTo(int fd);
+  // Same for a stream, e.g. to keep the dump in memory
+  void writeTo(llvm::raw_ostream &OS);
+};
@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/TimeProfiler.h"
+
+#include "src/ByteEncoding.h"
+#include "src/DebugSectionCompression.h"
+#include "src/PhaseTiming.h"
+
+using namespace llvm;
+
+#if LLVM_VERSION_MAJOR >= 18
+using CompressionThreadPool = DefaultThreadPool;
+#else
+using CompressionThreadPool = ThreadPool;
+#endif
+
+static cl::opt<SectionCompressionType> CompressDebugSections(
+    "compress-debug-sections", cl::desc("Compress the DWARF sections (LLVMDwarf_Simple reports the compressed sizes only)"),
+    cl::values(clEnumValN(SectionCompressionType::None, "none", "No compression"),
+               clEnumValN(SectionCompressionType::Zlib, "zlib", "ELFCOMPRESS_ZLIB"),
+               clEnumValN(SectionCompressionType::Zstd, "zstd", "ELFCOMPRESS_ZSTD (LLVM 16 or newer)")),
+    cl::init(SectionCompressionType::None));
+static cl::opt<int> CompressionLevel("compression-level", cl::desc("zlib 1-9 or zstd 1-22 (0 = library default)"), cl::init(0));
+
+SectionCompressionType getSectionCompressionType() {
+  return CompressDebugSections;
+}
+
+int getSectionCompressionLevel() {
+  if (CompressionLevel)
+    return CompressionLevel;
+#if LLVM_VERSION_MAJOR >= 16
+  if (CompressDebugSections == SectionCompressionType::Zstd)
+    return compression::zstd::DefaultCompression;
+  return compression::zlib::DefaultCompression;
+#else
+  return zlib::DefaultCompression;
+#endif
+}
+
+static StringRef getTypeName(SectionCompressionType type) {
+  return type == SectionCompressionType::Zstd ? "zstd" : "zlib";
+}
+
+Error checkSectionCompressionAvailable(SectionCompressionType type) {
+#if LLVM_VERSION_MAJOR >= 16
+  bool available = type == SectionCompressionType::Zstd ? compression::zstd::isAvailable() : compression::zlib::isAvailable();
+#else
+  bool available = type == SectionCompressionType::Zlib && zlib::isAvailable();
+#endif
+  if (available)
+    return Error::success();
+  return createStringError(inconvertibleErrorCode(), "LLVM " LLVM_VERSION_STRING " has no %s support",
+                           getTypeName(type).str().c_str());
+}
+
+// type is only read on LLVM 16 or newer; older ones have no zstd
+static Error compressSection(ArrayRef<uint8_t> input, bool is64Bit, [[maybe_unused]] SectionCompressionType type, int level,
+                             SmallVectorImpl<uint8_t> &out) {
+  // Elf64_Chdr has a reserved word after ch_type; Elf32_Chdr does not
+  unsigned wordSize = is64Bit ? 8 : 4;
+#if LLVM_VERSION_MAJOR >= 16
+  writeInt(out, type == SectionCompressionType::Zstd ? ELF::ELFCOMPRESS_ZSTD : ELF::ELFCOMPRESS_ZLIB, 4);
+#else
+  writeInt(out, ELF::ELFCOMPRESS_ZLIB, 4);
+#endif
+  if (is64Bit)
+    writeInt(out, 0, 4);
+  writeInt(out, input.size(), wordSize);
+  writeInt(out, 1, wordSize);
+
+#if LLVM_VERSION_MAJOR >= 16
+  SmallVector<uint8_t, 0> stream;
+  if (type == SectionCompressionType::Zstd)
+    compression::zstd::compress(input, stream, level);
+  else
+    compression::zlib::compress(input, stream, level);
+  out.append(stream.begin(), stream.end());
+  return Error::success();
+#else
+  SmallVector<char, 0> stream;
+  if (Error err = zlib::compress(toStringRef(input), stream, level))
+    return err;
+  out.append(stream.begin(), stream.end());
+  return Error::success();
+#endif
+}
+
+Expected<CompressedDebugSections> compressDebugSections(ArrayRef<DebugSectionInput> sections, bool is64Bit) {
+  return compressDebugSections(sections, is64Bit, getSectionCompressionType(), getSectionCompressionLevel());
+}
+
+Expected<CompressedDebugSections> compressDebugSections(ArrayRef<DebugSectionInput> sections, bool is64Bit, SectionCompressionType type,
+                                                        int level) {
+  assert(type != SectionCompressionType::None && "nothing to compress with");
+  if (Error err = checkSectionCompressionAvailable(type))
+    return std::move(err);
+  PhaseScope phase("Compress sections", getTypeName(type));
+  auto start = std::chrono::steady_clock::now();
+
+  CompressedDebugSections result;
+  result.type = type;
+  result.level = level;
+  result.sections.resize(sections.size());
+  std::vector<Error> errors;
+  for (size_t i = 0; i < sections.size(); ++i)
+    errors.push_back(Error::success());
+
+  // The sections differ a lot in size, so .debug_info usually bounds the wall time
+  auto compressOne = [&](size_t i) {
+    auto sectionStart = std::chrono::steady_clock::now();
+    CompressedDebugSection &section = result.sections[i];
+    section.name = sections[i].name;
+    section.uncompressedSize = sections[i].contents.size();
+    errors[i] = compressSection(sections[i].contents, is64Bit, type, level, section.bytes);
+    section.compressed = section.bytes.size() < section.uncompressedSize;
+    if (!section.compressed)
+      section.bytes.assign(sections[i].contents.begin(), sections[i].contents.end());
+    section.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - sectionStart).count();
+  };
+  if (sections.size() > 1) {
+    CompressionThreadPool pool(hardware_concurrency());
+    for (size_t i = 0; i < sections.size(); ++i) {
+      pool.async([&, i] {
+        PhaseWorkerScope worker;
+        TimeTraceScope trace("Compress section", sections[i].name);
+        compressOne(i);
+      });
+    }
+    pool.wait();
+  } else if (!sections.empty()) {
+    compressOne(0);
+  }
+
+  Error err = Error::success();
+  for (Error &sectionErr : errors)
+    err = joinErrors(std::move(err), std::move(sectionErr));
+  if (err)
+    return std::move(err);
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return std::move(result);
+}
+
+template <typename ELFT>
+static Expected<CompressedDebugSections> rewriteElfDebugSections(const object::ELFFile<ELFT> &file, SmallVectorImpl<char> &out) {
+  using Elf_Ehdr = typename ELFT::Ehdr;
+  using Elf_Shdr = typename ELFT::Shdr;
+  const Elf_Ehdr &header = file.getHeader();
+  // Without program headers, sections can move freely
+  if (header.e_type != ELF::ET_REL || header.e_phnum != 0)
+    return createStringError(inconvertibleErrorCode(), "only relocatable ELF objects can be compressed");
+  Expected<typename ELFT::ShdrRange> sectionsOrErr = file.sections();
+  if (!sectionsOrErr)
+    return sectionsOrErr.takeError();
+  typename ELFT::ShdrRange sections = *sectionsOrErr;
+
+  // The DWARF sections, as the relocations refer to them; .rela.debug_* stay as they are
+  std::vector<DebugSectionInput> inputs;
+  std::vector<size_t> inputSections;
+  for (size_t i = 0; i < sections.size(); ++i) {
+    const Elf_Shdr &section = sections[i];
+    if (section.sh_type == ELF::SHT_NOBITS || (section.sh_flags & (ELF::SHF_ALLOC | ELF::SHF_COMPRESSED)) || !section.sh_size)
+      continue;
+    Expected<StringRef> nameOrErr = file.getSectionName(section);
+    if (!nameOrErr)
+      return nameOrErr.takeError();
+    if (nameOrErr->substr(0, 7) != ".debug_")
+      continue;
+    Expected<ArrayRef<uint8_t>> contentsOrErr = file.getSectionContents(section);
+    if (!contentsOrErr)
+      return contentsOrErr.takeError();
+    inputs.push_back({*nameOrErr, *contentsOrErr});
+    inputSections.push_back(i);
+  }
+  Expected<CompressedDebugSections> compressedOrErr = compressDebugSections(inputs, ELFT::Is64Bits);
+  if (!compressedOrErr)
+    return compressedOrErr.takeError();
+
+  std::vector<const CompressedDebugSection *> replacements(sections.size());
+  for (size_t i = 0; i < inputSections.size(); ++i)
+    replacements[inputSections[i]] = &compressedOrErr->sections[i];
+
+  // Lay the sections out again in index order after the ELF header, then the
+  // section header table
+  PhaseScope phase("Write ELF object");
+  std::vector<Elf_Shdr> headers(sections.begin(), sections.end());
+  out.assign(sizeof(Elf_Ehdr), 0);
+  for (size_t i = 1; i < headers.size(); ++i) {
+    Elf_Shdr &section = headers[i];
+    const CompressedDebugSection *replacement = replacements[i];
+    ArrayRef<uint8_t> contents;
+    if (replacement) {
+      contents = replacement->bytes;
+      if (replacement->compressed) {
+        // The section now starts with an Elf_Chdr
+        section.sh_flags = section.sh_flags | ELF::SHF_COMPRESSED;
+        section.sh_addralign = ELFT::Is64Bits ? 8 : 4;
+      }
+    } else if (section.sh_type != ELF::SHT_NOBITS) {
+      Expected<ArrayRef<uint8_t>> contentsOrErr = file.getSectionContents(sections[i]);
+      if (!contentsOrErr)
+        return contentsOrErr.takeError();
+      contents = *contentsOrErr;
+    }
+    out.resize(alignTo(out.size(), std::max<uint64_t>(section.sh_addralign, 1)), 0);
+    section.sh_offset = out.size();
+    if (section.sh_type != ELF::SHT_NOBITS) {
+      section.sh_size = contents.size();
+      out.append(contents.begin(), contents.end());
+    }
+  }
+  out.resize(alignTo(out.size(), ELFT::Is64Bits ? 8 : 4), 0);
+
+  Elf_Ehdr newHeader = header;
+  newHeader.e_shoff = out.size();
+  std::memcpy(out.data(), &newHeader, sizeof(Elf_Ehdr));
+  const char *headerBytes = reinterpret_cast<const char *>(headers.data());
+  out.append(headerBytes, headerBytes + headers.size() * sizeof(Elf_Shdr));
+  return compressedOrErr;
+}
+
+Expected<CompressedDebugSections> compressElfDebugSections(const object::ELFObjectFileBase &obj, SmallVectorImpl<char> &out) {
+  // compressSection() writes little-endian compression headers
+  if (const auto *elf = dyn_cast<object::ELF64LEObjectFile>(&obj))
+    return rewriteElfDebugSections(elf->getELFFile(), out);
+  if (const auto *elf = dyn_cast<object::ELF32LEObjectFile>(&obj))
+    return rewriteElfDebugSections(elf->getELFFile(), out);
+  return createStringError(inconvertibleErrorCode(), "big-endian ELF objects are not supported");
+}
+
+static double getMBPerSecond(uint64_t bytes, double seconds) {
+  return seconds > 0 ? bytes / 1048576.0 / seconds : 0;
+}
+
+void printCompressionStats(raw_ostream &OS, const CompressedDebugSections &compressed) {
+  uint64_t totalIn = 0, totalOut = 0;
+  size_t numCompressed = 0;
+  for (const CompressedDebugSection &section : compressed.sections) {
+    totalIn += section.uncompressedSize;
+    totalOut += section.bytes.size();
+    numCompressed += section.compressed;
+    if (!section.compressed) {
+      OS << "✓ " << getTypeName(compressed.type) << " " << section.name << ": " << section.uncompressedSize
+         << " bytes, kept uncompressed (compression would not shrink it)\n";
+      continue;
+    }
+    OS << "✓ " << getTypeName(compressed.type) << " " << section.name << ": " << section.uncompressedSize << " -> " << section.bytes.size()
+       << " bytes (" << format("%.2f", double(section.uncompressedSize) / section.bytes.size()) << "x";
+    if (section.seconds > 0)
+      OS << ", " << format("%.1f", getMBPerSecond(section.uncompressedSize, section.seconds)) << " MB/s";
+    OS << ")\n";
+  }
+  OS << "✓ Compressed " << numCompressed << " of " << compressed.sections.size() << " sections with " << getTypeName(compressed.type) << " level "
+     << compressed.level << ": " << totalIn << " -> " << totalOut << " bytes (" << format("%.2f", totalOut ? double(totalIn) / totalOut : 0.0)
+     << "x)";
+  if (compressed.seconds > 0)
+    OS << " in " << format("%.3f", compressed.seconds * 1e3) << " ms (" << format("%.1f", getMBPerSecond(totalIn, compressed.seconds)) << " MB/s)";
+  OS << "\n\n";
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Opt-in compression of the DWARF sections, shared by both generators
+// - --compress-debug-sections=zlib|zstd, --compression-level=<n>
+// - A compressed section holds an ELF compression header (Elf32_Chdr or
+//   Elf64_Chdr with ELFCOMPRESS_ZLIB / ELFCOMPRESS_ZSTD) followed by the
+//   stream: the contents of an SHF_COMPRESSED section
+// - LLVMDwarf writes the compressed sections back into its ELF object as
+//   SHF_COMPRESSED (compressElfDebugSections()); LLVMDwarf_Simple only reports
+//   the sizes and writes its wasm custom sections uncompressed, since wasm
+//   consumers do not decompress custom sections
+// - Every section is compressed by its own task on a thread pool
+
+enum class SectionCompressionType { None, Zlib, Zstd };
+
+SectionCompressionType getSectionCompressionType();
+// --compression-level, or the library default for 0
+int getSectionCompressionLevel();
+// Fails if the algorithm is not compiled into LLVM
+llvm::Error checkSectionCompressionAvailable(SectionCompressionType type);
+
+struct DebugSectionInput {
+  llvm::StringRef name;
+  llvm::ArrayRef<uint8_t> contents;
+};
+
+struct CompressedDebugSection {
+  llvm::StringRef name;
+  uint64_t uncompressedSize = 0;
+  // Compression header and compressed stream, or the input as is when that
+  // would not be smaller (as linkers do, the section then stays uncompressed)
+  llvm::SmallVector<uint8_t, 0> bytes;
+  bool compressed = false;
+  // 0 when not timed on its own
+  double seconds = 0;
+};
+
+struct CompressedDebugSections {
+  SectionCompressionType type = SectionCompressionType::None;
+  int level = 0;
+  std::vector<CompressedDebugSection> sections;
+  // Wall time of the whole batch, which is below the sum of the per-section
+  // times when sections run in parallel; 0 when not timed
+  double seconds = 0;
+};
+
+// Compress sections with the algorithm and level from the options. is64Bit
+// selects Elf64_Chdr over Elf32_Chdr. Fails if the algorithm is not compiled
+// into LLVM.
+llvm::Expected<CompressedDebugSections> compressDebugSections(llvm::ArrayRef<DebugSectionInput> sections, bool is64Bit);
+llvm::Expected<CompressedDebugSections> compressDebugSections(llvm::ArrayRef<DebugSectionInput> sections, bool is64Bit,
+                                                              SectionCompressionType type, int level);
+
+// Compress the non-empty .debug_* sections of a little-endian relocatable ELF
+// object with the options' algorithm and level, and write the object again
+// into out with those sections as SHF_COMPRESSED. Sections compression would
+// not shrink are copied as they are.
+llvm::Expected<CompressedDebugSections> compressElfDebugSections(const llvm::object::ELFObjectFileBase &obj,
+                                                                 llvm::SmallVectorImpl<char> &out);
+
+// Per section and total: sizes, ratio and, where timed, MB/s of uncompressed input
+void printCompressionStats(llvm::raw_ostream &OS, const CompressedDebugSections &compressed);
@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+
+#include "src/ByteEncoding.h"
+#include "src/DwarfCache.h"
+#include "src/GeneratorVersion.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> CacheDir("cache-dir", cl::desc("Reuse generated DWARF for unchanged layouts from this directory"),
+                                     cl::value_desc("dir"), cl::init(""));
+static cl::opt<unsigned> CacheSizeMB("cache-size-mb", cl::desc("Evict least recently used cache entries beyond this size"),
+                                     cl::init(1024));
+static cl::opt<bool> CacheStats("cache-stats", cl::desc("Print the cumulative cache hit/miss counters"), cl::init(false));
+
+// Bump when the entry layout or the meaning of a part changes. Changes to the
+// generated output need no bump: LLVMDWARF_GENERATOR_VERSION covers them.
+static const char EntryMagic[8] = {'D', 'W', 'C', 'A', 'C', 'H', 'E', '1'};
+static const char EntryExtension[] = ".dwc";
+static const char StatsFileName[] = "stats";
+
+std::string computeDwarfCacheKey(const LayoutTable &table, StringRef config) {
+  MD5 hash;
+  auto addInt = [&](uint64_t value) {
+    uint8_t bytes[8];
+    writeLE(bytes, value, 8);
+    hash.update(ArrayRef<uint8_t>(bytes));
+  };
+  // Length-prefixed, so adjacent strings cannot run into each other
+  auto addString = [&](StringRef str) {
+    addInt(str.size());
+    hash.update(str);
+  };
+
+  addString(StringRef(EntryMagic, sizeof(EntryMagic)));
+  addString(LLVM_VERSION_STRING);
+  addString(LLVMDWARF_GENERATOR_VERSION);
+  addString(config);
+  addString(table.producer);
+  addInt(table.types.size());
+  for (const LayoutType &type : table.types) {
+    addInt(uint64_t(type.kind));
+    addString(type.name);
+    addInt(type.byteSize);
+    addInt(type.encoding);
+    addInt(type.pointee);
+    addInt(type.alignment);
+    addInt(type.members.size());
+    for (const LayoutMember &member : type.members) {
+      addString(member.name);
+      addInt(member.type);
+      addInt(member.offset);
+      addInt(member.alignment);
+    }
+  }
+
+  MD5::MD5Result result;
+  hash.final(result);
+  return std::string(result.digest());
+}
+
+Expected<std::unique_ptr<DwarfCache>> DwarfCache::open(StringRef dir, uint64_t maxBytes) {
+  if (std::error_code ec = sys::fs::create_directories(dir))
+    return createStringError(ec, "cannot create cache directory %s: %s", dir.str().c_str(), ec.message().c_str());
+  return std::unique_ptr<DwarfCache>(new DwarfCache(dir.str(), maxBytes));
+}
+
+std::string DwarfCache::getEntryPath(StringRef key) const {
+  SmallString<256> path(dir);
+  sys::path::append(path, key + EntryExtension);
+  return std::string(path);
+}
+
+// Best effort: the counters are only statistics, so failures are ignored.
+// The file lock keeps concurrent generators from losing updates.
+void DwarfCache::countLookup(bool hit) {
+  SmallString<256> path(dir);
+  sys::path::append(path, StatsFileName);
+  int fd;
+  if (sys::fs::openFileForReadWrite(path, fd, sys::fs::CD_OpenAlways, sys::fs::OF_None))
+    return;
+  if (!sys::fs::lockFile(fd)) {
+    uint8_t counters[16] = {};
+    Expected<size_t> readOrErr =
+        sys::fs::readNativeFileSlice(sys::fs::convertFDToNativeFile(fd), MutableArrayRef<char>(reinterpret_cast<char *>(counters), 16), 0);
+    if (!readOrErr || *readOrErr != sizeof(counters)) {
+      consumeError(readOrErr.takeError());
+      std::memset(counters, 0, sizeof(counters));
+    }
+    unsigned index = hit ? 0 : 8;
+    writeLE(counters + index, readLE(counters + index, 8) + 1, 8);
+    {
+      raw_fd_ostream OS(fd, /*shouldClose=*/false);
+      OS.seek(0);
+      OS.write(reinterpret_cast<const char *>(counters), sizeof(counters));
+    }
+    sys::fs::unlockFile(fd);
+  }
+  sys::Process::SafelyCloseFileDescriptor(fd);
+}
+
+std::optional<DwarfCacheEntry> DwarfCache::lookup(StringRef key) {
+  std::string path = getEntryPath(key);
+  // No null terminator needed, which lets MemoryBuffer map the file instead of reading it
+  ErrorOr<std::unique_ptr<MemoryBuffer>> bufferOrErr = MemoryBuffer::getFile(path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+  if (!bufferOrErr) {
+    countLookup(false);
+    return {};
+  }
+
+  // Header: magic, u32 part count, u32 reserved, u64 size per part; then the parts back to back
+  DwarfCacheEntry entry;
+  entry.buffer = std::move(*bufferOrErr);
+  ArrayRef<uint8_t> data(reinterpret_cast<const uint8_t *>(entry.buffer->getBufferStart()), entry.buffer->getBufferSize());
+  bool valid = data.size() >= 16 && std::memcmp(data.data(), EntryMagic, 8) == 0;
+  uint64_t numParts = valid ? readLE(data.data() + 8, 4) : 0;
+  uint64_t offset = 16 + 8 * numParts;
+  valid = valid && offset <= data.size();
+  for (uint64_t i = 0; valid && i < numParts; ++i) {
+    uint64_t size = readLE(data.data() + 16 + 8 * i, 8);
+    valid = size <= data.size() - offset;
+    if (valid)
+      entry.parts.push_back(data.slice(offset, size));
+    offset += size;
+  }
+  if (!valid || offset != data.size()) {
+    countLookup(false);
+    return {};
+  }
+
+  // Modification time doubles as the last use for LRU eviction (atime is often disabled)
+  int fd;
+  if (!sys::fs::openFileForRead(path, fd)) {
+    sys::fs::setLastAccessAndModificationTime(fd, std::chrono::system_clock::now());
+    sys::Process::SafelyCloseFileDescriptor(fd);
+  }
+  countLookup(true);
+  return std::move(entry);
+}
+
+Error DwarfCache::store(StringRef key, ArrayRef<ArrayRef<uint8_t>> parts) {
+  // Eviction would delete it right away
+  uint64_t size = 16 + 8 * parts.size();
+  for (ArrayRef<uint8_t> part : parts)
+    size += part.size();
+  if (size > maxBytes)
+    return createStringError(inconvertibleErrorCode(), "cache entry %s not stored: %llu bytes exceed the %llu-byte cache size",
+                             key.str().c_str(), (unsigned long long)size, (unsigned long long)maxBytes);
+
+  SmallString<256> model(dir);
+  sys::path::append(model, "tmp-%%%%%%%%%%%%.part");
+  Expected<sys::fs::TempFile> tempOrErr = sys::fs::TempFile::create(model);
+  if (!tempOrErr)
+    return tempOrErr.takeError();
+  sys::fs::TempFile &temp = *tempOrErr;
+
+  std::error_code ec;
+  {
+    raw_fd_ostream OS(temp.FD, /*shouldClose=*/false);
+    std::vector<uint8_t> header(16 + 8 * parts.size());
+    std::memcpy(header.data(), EntryMagic, 8);
+    writeLE(header.data() + 8, parts.size(), 4);
+    for (size_t i = 0; i < parts.size(); ++i)
+      writeLE(header.data() + 16 + 8 * i, parts[i].size(), 8);
+    OS.write(reinterpret_cast<const char *>(header.data()), header.size());
+    for (ArrayRef<uint8_t> part : parts)
+      OS.write(reinterpret_cast<const char *>(part.data()), part.size());
+    OS.flush();
+    ec = OS.error();
+    OS.clear_error();
+  }
+  if (ec) {
+    consumeError(temp.discard());
+    return createStringError(ec, "cannot write cache entry %s: %s", key.str().c_str(), ec.message().c_str());
+  }
+  // rename() replaces an entry another process stored meanwhile, which has the same contents
+  std::string path = getEntryPath(key);
+  if (Error err = temp.keep(path))
+    return err;
+  evict(path);
+  return Error::success();
+}
+
+namespace {
+
+struct CachedFile {
+  std::string path;
+  uint64_t size;
+  sys::TimePoint<> lastUse;
+};
+
+// Every entry of the cache directory
+std::vector<CachedFile> listEntries(StringRef dir) {
+  std::vector<CachedFile> entries;
+  std::error_code ec;
+  for (sys::fs::directory_iterator it(dir, ec), end; it != end && !ec; it.increment(ec)) {
+    if (sys::path::filename(it->path()).take_back(sizeof(EntryExtension) - 1) != EntryExtension)
+      continue;
+    ErrorOr<sys::fs::basic_file_status> status = it->status();
+    if (status)
+      entries.push_back({it->path(), status->getSize(), status->getLastModificationTime()});
+  }
+  return entries;
+}
+
+} // namespace
+
+void DwarfCache::evict(StringRef keepPath) {
+  std::vector<CachedFile> entries = listEntries(dir);
+  uint64_t total = 0;
+  for (const CachedFile &entry : entries)
+    total += entry.size;
+  if (total <= maxBytes)
+    return;
+  std::sort(entries.begin(), entries.end(), [](const CachedFile &a, const CachedFile &b) { return a.lastUse < b.lastUse; });
+  for (const CachedFile &entry : entries) {
+    if (total <= maxBytes)
+      break;
+    if (entry.path == keepPath)
+      continue;
+    // Another generator may have evicted it already; mapped copies stay valid either way
+    sys::fs::remove(entry.path);
+    total -= entry.size;
+  }
+}
+
+DwarfCacheStats DwarfCache::getStats() const {
+  DwarfCacheStats stats;
+  SmallString<256> path(dir);
+  sys::path::append(path, StatsFileName);
+  ErrorOr<std::unique_ptr<MemoryBuffer>> bufferOrErr = MemoryBuffer::getFile(path);
+  if (bufferOrErr && (*bufferOrErr)->getBufferSize() >= 16) {
+    const uint8_t *counters = reinterpret_cast<const uint8_t *>((*bufferOrErr)->getBufferStart());
+    stats.hits = readLE(counters, 8);
+    stats.misses = readLE(counters + 8, 8);
+  }
+  for (const CachedFile &entry : listEntries(dir)) {
+    ++stats.entries;
+    stats.bytes += entry.size;
+  }
+  return stats;
+}
+
+Expected<std::unique_ptr<DwarfCache>> openDwarfCacheFromOptions() {
+  if (CacheDir.empty())
+    return nullptr;
+  return DwarfCache::open(CacheDir, uint64_t(CacheSizeMB) << 20);
+}
+
+void printDwarfCacheStats(raw_ostream &OS, const DwarfCache &cache) {
+  if (!CacheStats)
+    return;
+  DwarfCacheStats stats = cache.getStats();
+  uint64_t lookups = stats.hits + stats.misses;
+  OS << "✓ Cache: " << stats.hits << " hits, " << stats.misses << " misses ("
+     << format("%.1f", lookups ? 100.0 * stats.hits / lookups : 0.0) << "% hit rate), " << stats.entries << " entries, "
+     << format("%.1f", stats.bytes / 1048576.0) << " of " << format("%.0f", cache.getMaxBytes() / 1048576.0) << " MB\n";
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/LayoutTable.h"
+
+// Content-addressed on-disk cache of generator output, shared by both generators
+// - Keyed by computeDwarfCacheKey(): the normalized layout plus everything else
+//   the output depends on, so unchanged layouts skip building entirely
+// - An entry is a list of byte parts (sections, object file, dump) in one file;
+//   a hit is memory-mapped (when large enough to pay off) and written out from there
+// - Entries are written to a temporary file and renamed into place, so
+//   concurrent generators never see a partial entry
+// - Least recently used entries are evicted once the directory exceeds its size bound
+// - Hit/miss counters are kept in the directory across runs
+
+// MD5 over the parsed table (so JSON formatting and key order do not matter),
+// the LLVM version, the generator version (a hash of the sources it was built
+// from) and config, which names the generator and its DWARF version, form
+// parameters and options. Returns 32 hex digits.
+std::string computeDwarfCacheKey(const LayoutTable &table, llvm::StringRef config);
+
+struct DwarfCacheEntry {
+  std::unique_ptr<llvm::MemoryBuffer> buffer;
+  // Views into buffer, in the order they were stored
+  llvm::SmallVector<llvm::ArrayRef<uint8_t>, 8> parts;
+};
+
+struct DwarfCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t entries = 0;
+  uint64_t bytes = 0;
+};
+
+class DwarfCache {
+  std::string dir;
+  uint64_t maxBytes;
+
+  DwarfCache(std::string dir, uint64_t maxBytes) : dir(std::move(dir)), maxBytes(maxBytes) {
+  }
+
+  std::string getEntryPath(llvm::StringRef key) const;
+  void countLookup(bool hit);
+  // Evicts least recently used entries other than keepPath down to maxBytes
+  void evict(llvm::StringRef keepPath);
+
+public:
+  // Creates dir if needed
+  static llvm::Expected<std::unique_ptr<DwarfCache>> open(llvm::StringRef dir, uint64_t maxBytes);
+
+  // The entry stored under key, marked as most recently used; none on a miss
+  // or a corrupt entry
+  std::optional<DwarfCacheEntry> lookup(llvm::StringRef key);
+  // Atomically (re)place the entry for key, then evict other entries down to
+  // the size bound. Fails, storing nothing, if the entry alone exceeds it.
+  llvm::Error store(llvm::StringRef key, llvm::ArrayRef<llvm::ArrayRef<uint8_t>> parts);
+
+  DwarfCacheStats getStats() const;
+  uint64_t getMaxBytes() const {
+    return maxBytes;
+  }
+};
+
+// --cache-dir=<dir> and --cache-size-mb=<n>; nullptr without --cache-dir
+llvm::Expected<std::unique_ptr<DwarfCache>> openDwarfCacheFromOptions();
+// With --cache-stats, print the cumulative counters of cache to OS
+void printDwarfCacheStats(llvm::raw_ostream &OS, const DwarfCache &cache);
@@ -0,0 +1,103 @@
+#include "llvm/Support/LEB128.h"
+
+#include "src/DwarfFormSelection.h"
+
+using namespace llvm;
+
+namespace {
+
+// Smallest fixed size (1, 2, 4 or 8 bytes) that holds value
+unsigned getFixedSize(uint64_t value) {
+  if (value <= UINT8_MAX)
+    return 1;
+  if (value <= UINT16_MAX)
+    return 2;
+  if (value <= UINT32_MAX)
+    return 4;
+  return 8;
+}
+
+bool isUnitRefForm(dwarf::Form form) {
+  switch (form) {
+  case dwarf::DW_FORM_ref1:
+  case dwarf::DW_FORM_ref2:
+  case dwarf::DW_FORM_ref4:
+  case dwarf::DW_FORM_ref8:
+  case dwarf::DW_FORM_ref_udata:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Whether a unit-relative reference of this form can hold offset
+bool fitsUnitRefForm(dwarf::Form form, uint64_t offset) {
+  switch (form) {
+  case dwarf::DW_FORM_ref1:
+    return offset <= UINT8_MAX;
+  case dwarf::DW_FORM_ref2:
+    return offset <= UINT16_MAX;
+  case dwarf::DW_FORM_ref4:
+    return offset <= UINT32_MAX;
+  default:
+    return true;
+  }
+}
+
+} // namespace
+
+dwarf::Form getConstantForm(uint64_t value) {
+  unsigned size = getFixedSize(value);
+  if (getULEB128Size(value) < size)
+    return dwarf::DW_FORM_udata;
+  switch (size) {
+  case 1:
+    return dwarf::DW_FORM_data1;
+  case 2:
+    return dwarf::DW_FORM_data2;
+  case 4:
+    return dwarf::DW_FORM_data4;
+  default:
+    return dwarf::DW_FORM_data8;
+  }
+}
+
+dwarf::Form getUnitRefForm(uint64_t offset) {
+  unsigned size = getFixedSize(offset);
+  if (getULEB128Size(offset) < size)
+    return dwarf::DW_FORM_ref_udata;
+  switch (size) {
+  case 1:
+    return dwarf::DW_FORM_ref1;
+  case 2:
+    return dwarf::DW_FORM_ref2;
+  case 4:
+    return dwarf::DW_FORM_ref4;
+  default:
+    return dwarf::DW_FORM_ref8;
+  }
+}
+
+static void fitRefForms(DIE &die, bool widenOnly, UnitRefFit &fit) {
+  fit.offsetHash = (fit.offsetHash ^ die.getOffset()) * 0x100000001b3ull;
+  for (DIEValue &V : die.values()) {
+    if (V.getType() != DIEValue::isEntry || !isUnitRefForm(V.getForm()))
+      continue;
+    uint64_t offset = V.getDIEEntry().getEntry().getOffset();
+    if (widenOnly && fitsUnitRefForm(V.getForm(), offset))
+      continue;
+    dwarf::Form form = getUnitRefForm(offset);
+    if (form == V.getForm())
+      continue;
+    V = DIEValue(V.getAttribute(), form, V.getDIEEntry());
+    ++fit.numChanged;
+  }
+  for (DIE &child : die.children())
+    fitRefForms(child, widenOnly, fit);
+}
+
+UnitRefFit fitUnitRefForms(DIE &die, bool widenOnly) {
+  UnitRefFit fit;
+  fitRefForms(die, widenOnly, fit);
+  return fit;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/CodeGen/DIE.h"
+
+// Narrowest form for a constant: the smallest of DW_FORM_data1/2/4/8 that
+// holds value, or DW_FORM_udata where its ULEB128 encoding is shorter still
+llvm::dwarf::Form getConstantForm(uint64_t value);
+
+// Same for a unit-relative reference to a DIE at offset: DW_FORM_ref1/2/4/8
+// or DW_FORM_ref_udata
+llvm::dwarf::Form getUnitRefForm(uint64_t offset);
+
+// Outcome of one fitUnitRefForms() walk
+struct UnitRefFit {
+  size_t numChanged = 0;
+  // Hash of every DIE offset seen, to tell whether a layout moved anything
+  uint64_t offsetHash = 0;
+};
+
+// Give every unit-relative DIEEntry reference below die (DW_AT_type and the
+// like; DW_FORM_ref_addr is left alone) the narrowest form for its target's
+// current offset. Expects computeOffsetsAndAbbrevs() to have run.
+// - A changed form changes DIE sizes, so the unit needs another layout and
+//   another walk; repeat until nothing changes
+// - DW_FORM_ref_udata sizes depend on the target offset, and a layout reads
+//   forward targets' offsets from the previous one, so a layout is only exact
+//   once the offsets stop moving as well (compare offsetHash)
+// - Narrowing alone can oscillate once offsets grow (e.g. wider abbreviation
+//   codes); with widenOnly, forms are only replaced by wider ones, which
+//   always reaches a fixpoint
+UnitRefFit fitUnitRefForms(llvm::DIE &die, bool widenOnly = false);
@@ -0,0 +1,63 @@
+#include <optional>
+
+#include "src/DwarfGenerator.h"
+#include "src/ParallelUnitBuilder.h"
+
+using namespace llvm;
+
+dwarf::FormParams DwarfGeneratorOptions::getFormParams() const {
+  bool dwarf5 = stringIndices || nameIndex || implicitConsts;
+  return {uint16_t(dwarf5 ? 5 : 4), 4, dwarf::DWARF32};
+}
+
+Error DwarfGeneratorOptions::validate() const {
+  if (getFormParams().Version >= 5 && typeUnits)
+    return createStringError(inconvertibleErrorCode(), "string indices (--strx), the name index (--debug-names) and implicit "
+                                                       "constants (--implicit-const) emit DWARF 5, whose type units "
+                                                       "(--type-units) are not supported");
+  return Error::success();
+}
+
+GeneratedDwarf::~GeneratedDwarf() = default;
+
+static Expected<std::unique_ptr<GeneratedDwarf>> generate(const LayoutTable &table, const DwarfGeneratorOptions &options) {
+  if (Error err = options.validate())
+    return std::move(err);
+  if (Error err = validateLayoutTable(table))
+    return std::move(err);
+
+  dwarf::FormParams formParams = options.getFormParams();
+  std::optional<PhaseScope> planPhase(std::in_place, "Plan units");
+  LayoutUnitPlan plan(table, options.compileUnits, options.dedupTypes, options.typeUnits);
+  planPhase.reset();
+  auto units = std::make_unique<LayoutCompileUnits>(buildCompileUnits(plan, options));
+  DwarfUnitOffsets unitOffsets = computeCompileUnitOffsets(units->getUnitDies(), formParams);
+  Expected<DwarfSections> sections = serializeCompileUnits(*units, formParams, unitOffsets);
+  if (!sections)
+    return sections.takeError();
+
+  auto result = std::make_unique<GeneratedDwarf>();
+  result->stringPool = std::move(units->stringPool);
+  result->sections = std::move(*sections);
+  result->sections.str = result->stringPool.getData();
+  result->numTypeDIEs = units->getNumTypeDIEs();
+  result->numCompileUnits = plan.getNumUnits();
+  if (options.keepDIEs) {
+    result->units = std::move(units);
+    result->unitOffsets = std::move(unitOffsets);
+  }
+  return std::move(result);
+}
+
+Expected<std::unique_ptr<GeneratedDwarf>> generateDwarf(const LayoutTable &table, const DwarfGeneratorOptions &options) {
+  if (!options.timing.isEnabled() || isPhaseTimingStarted())
+    return generate(table, options);
+  startPhaseTiming("generateDwarf", options.timing);
+  Expected<std::unique_ptr<GeneratedDwarf>> result = generate(table, options);
+  if (Error err = finishPhaseTiming()) {
+    if (!result)
+      return joinErrors(result.takeError(), std::move(err));
+    return std::move(err);
+  }
+  return result;
+}
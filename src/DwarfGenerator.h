@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/Support/Error.h"
+
+#include "src/DwarfSectionWriter.h"
+#include "src/LayoutTable.h"
+#include "src/PhaseTiming.h"
+#include "src/SimpleStringPool.h"
+
+// Settings of one DIE-based generation
+struct DwarfGeneratorOptions {
+  bool dedupTypes = true;
+  bool typeUnits = false;
+  unsigned compileUnits = 1;
+  // Threads for multi-unit builds (0 = all cores)
+  unsigned jobs = 0;
+  // DWARF 5 with DW_FORM_strx* names and .debug_str_offsets
+  bool stringIndices = false;
+  // Tail-merged .debug_str
+  bool tailMergeStrings = false;
+  // DWARF 5 with .debug_names
+  bool nameIndex = false;
+  // One abbreviation table for all units, numbered by use count
+  bool shareAbbrevs = false;
+  // Narrowest ref form for every unit-relative reference
+  bool narrowRefs = false;
+  // DWARF 5 with recurring constants as DW_FORM_implicit_const
+  bool implicitConsts = false;
+  // Times the phases of this call, unless the process already does
+  // (startPhaseTiming()). Timing is process-wide, so concurrent calls must not
+  // ask for it.
+  PhaseTimingSettings timing;
+  // Keep the laid-out DIE tree in the result, e.g. to dump it
+  bool keepDIEs = false;
+
+  // Version 5 when any DWARF 5 feature is on, else 4; always 32-bit DWARF
+  llvm::dwarf::FormParams getFormParams() const;
+  // Fails on options that cannot be combined (DWARF 5 with type units)
+  llvm::Error validate() const;
+};
+
+struct LayoutCompileUnits;
+
+// Sections of one generation; owns every byte, including .debug_str
+struct GeneratedDwarf {
+  SimpleStringPool stringPool;
+  // sections.str is a view into stringPool
+  DwarfSections sections;
+  uint64_t numTypeDIEs = 0;
+  uint32_t numCompileUnits = 0;
+  // With keepDIEs: the units the sections were serialized from, and the
+  // offset of each compile unit DIE. Their string pool is moved into stringPool.
+  std::unique_ptr<LayoutCompileUnits> units;
+  DwarfUnitOffsets unitOffsets;
+
+  GeneratedDwarf() = default;
+  ~GeneratedDwarf();
+  GeneratedDwarf(const GeneratedDwarf &) = delete;
+  GeneratedDwarf &operator=(const GeneratedDwarf &) = delete;
+};
+
+// In-process entry point of the DIE path: builds, lays out and serializes the
+// DWARF of table, without touching the filesystem
+// - Same output as LLVMDwarf_Simple and the server for the same options
+// - The table is only read, and only during the call; the result does not
+//   point into it
+// - Safe to call concurrently on different tables
+// Fails on options that validate() rejects, on a table that
+// validateLayoutTable() rejects and on serialization errors.
+llvm::Expected<std::unique_ptr<GeneratedDwarf>> generateDwarf(const LayoutTable &table, const DwarfGeneratorOptions &options);
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "llvm/ADT/StringExtras.h"
+
+#include "src/DwarfGenerator.h"
+#include "src/DwarfGeneratorC.h"
+
+using namespace llvm;
+
+struct DwarfGenOpaqueResult {
+  std::unique_ptr<GeneratedDwarf> dwarf;
+  std::string error;
+};
+
+namespace {
+
+constexpr uint32_t AllFlags = DwarfGenDedupTypes | DwarfGenTypeUnits | DwarfGenStringIndices | DwarfGenTailMergeStrings |
+                              DwarfGenNameIndex | DwarfGenShareAbbrevs | DwarfGenNarrowRefs | DwarfGenImplicitConsts;
+
+DwarfGenStatus fail(DwarfGenResultRef *result, DwarfGenStatus status, std::string message) {
+  if (result) {
+    *result = new DwarfGenOpaqueResult();
+    (*result)->error = std::move(message);
+  }
+  return status;
+}
+
+DwarfGenStatus fail(DwarfGenResultRef *result, DwarfGenStatus status, Error err) {
+  return fail(result, status, toString(std::move(err)));
+}
+
+// Reads the fields the caller's options struct has; the ones it predates keep
+// their DwarfGenInitOptions() defaults, the ones it adds beyond ours are ignored
+DwarfGenStatus readOptions(const DwarfGenOptions *in, DwarfGeneratorOptions &out, DwarfGenResultRef *result) {
+  if (!in || in->structSize < offsetof(DwarfGenOptions, compileUnits))
+    return fail(result, DwarfGenInvalidArgument, "options missing or without flags");
+  DwarfGenOptions known;
+  DwarfGenInitOptions(&known);
+  std::memcpy(&known, in, std::min<size_t>(in->structSize, sizeof(DwarfGenOptions)));
+  if (known.flags & ~AllFlags)
+    return fail(result, DwarfGenInvalidArgument, "unknown option flags");
+  out.dedupTypes = known.flags & DwarfGenDedupTypes;
+  out.typeUnits = known.flags & DwarfGenTypeUnits;
+  out.stringIndices = known.flags & DwarfGenStringIndices;
+  out.tailMergeStrings = known.flags & DwarfGenTailMergeStrings;
+  out.nameIndex = known.flags & DwarfGenNameIndex;
+  out.shareAbbrevs = known.flags & DwarfGenShareAbbrevs;
+  out.narrowRefs = known.flags & DwarfGenNarrowRefs;
+  out.implicitConsts = known.flags & DwarfGenImplicitConsts;
+  out.compileUnits = known.compileUnits;
+  out.jobs = known.jobs;
+  return DwarfGenSuccess;
+}
+
+DwarfGenStatus generate(const LayoutTable &table, const DwarfGeneratorOptions &options, DwarfGenResultRef *result) {
+  Expected<std::unique_ptr<GeneratedDwarf>> dwarf = generateDwarf(table, options);
+  if (!dwarf)
+    return fail(result, DwarfGenGenerationFailed, dwarf.takeError());
+  *result = new DwarfGenOpaqueResult();
+  (*result)->dwarf = std::move(*dwarf);
+  return DwarfGenSuccess;
+}
+
+StringRef getName(const char *name) {
+  return name ? StringRef(name) : StringRef();
+}
+
+} // namespace
+
+void DwarfGenInitOptions(DwarfGenOptions *options) {
+  DwarfGeneratorOptions defaults;
+  std::memset(options, 0, sizeof(DwarfGenOptions));
+  options->structSize = sizeof(DwarfGenOptions);
+  options->flags = defaults.dedupTypes ? DwarfGenDedupTypes : 0;
+  options->compileUnits = defaults.compileUnits;
+  options->jobs = defaults.jobs;
+}
+
+DwarfGenStatus DwarfGenGenerateFromJSON(const char *json, size_t length, const DwarfGenOptions *options, DwarfGenResultRef *result) {
+  if (!result)
+    return DwarfGenInvalidArgument;
+  DwarfGeneratorOptions generatorOptions;
+  if (DwarfGenStatus status = readOptions(options, generatorOptions, result))
+    return status;
+  if (!json && length)
+    return fail(result, DwarfGenInvalidArgument, "null JSON");
+
+  LayoutTable table;
+  if (Error err = parseLayoutJSON(StringRef(json, length), table))
+    return fail(result, DwarfGenInvalidLayout, std::move(err));
+  return generate(table, generatorOptions, result);
+}
+
+DwarfGenStatus DwarfGenGenerate(const char *producer, const DwarfGenType *types, size_t numTypes, const DwarfGenOptions *options,
+                                DwarfGenResultRef *result) {
+  if (!result)
+    return DwarfGenInvalidArgument;
+  DwarfGeneratorOptions generatorOptions;
+  if (DwarfGenStatus status = readOptions(options, generatorOptions, result))
+    return status;
+  if (!types && numTypes)
+    return fail(result, DwarfGenInvalidArgument, "null type array");
+
+  // Names stay the caller's; generateDwarf() copies what it keeps
+  LayoutTable table;
+  if (producer)
+    table.producer = producer;
+  table.types.resize(numTypes);
+  for (size_t i = 0; i < numTypes; ++i) {
+    const DwarfGenType &in = types[i];
+    LayoutType &type = table.types[i];
+    auto typeError = [&](const char *message) {
+      return fail(result, DwarfGenInvalidLayout, ("type #" + Twine(i) + ": " + message).str());
+    };
+    if (in.kind > DwarfGenClass)
+      return typeError("unknown kind");
+    if (in.kind == DwarfGenBase && !in.encoding)
+      return typeError("base type has no encoding");
+    if (in.numMembers && !in.members)
+      return fail(result, DwarfGenInvalidArgument, "null member array");
+    type.kind = LayoutTypeKind(in.kind);
+    type.name = getName(in.name);
+    type.byteSize = in.byteSize;
+    type.encoding = in.encoding;
+    type.pointee = in.pointee;
+    type.members.reserve(in.numMembers);
+    for (size_t m = 0; m < in.numMembers; ++m)
+      type.members.push_back({getName(in.members[m].name), in.members[m].type, in.members[m].offset});
+  }
+  if (Error err = validateLayoutTable(table))
+    return fail(result, DwarfGenInvalidLayout, std::move(err));
+  return generate(table, generatorOptions, result);
+}
+
+size_t DwarfGenGetSectionSize(DwarfGenResultRef result, DwarfGenSection section) {
+  if (!result || !result->dwarf)
+    return 0;
+  const DwarfSections &sections = result->dwarf->sections;
+  switch (section) {
+  case DwarfGenSectionInfo:
+    return sections.info.size();
+  case DwarfGenSectionAbbrev:
+    return sections.abbrev.size();
+  case DwarfGenSectionStr:
+    return sections.str.size();
+  case DwarfGenSectionStrOffsets:
+    return sections.strOffsets.size();
+  case DwarfGenSectionNames:
+    return sections.names.size();
+  case DwarfGenSectionTypes: {
+    size_t size = 0;
+    for (const DwarfTypeUnitSection &unit : sections.typeUnits)
+      size += unit.bytes.size();
+    return size;
+  }
+  }
+  return 0;
+}
+
+DwarfGenStatus DwarfGenCopySection(DwarfGenResultRef result, DwarfGenSection section, void *buffer, size_t bufferSize) {
+  if (!result || section < DwarfGenSectionInfo || section > DwarfGenSectionTypes)
+    return DwarfGenInvalidArgument;
+  size_t size = DwarfGenGetSectionSize(result, section);
+  if (size > bufferSize)
+    return DwarfGenBufferTooSmall;
+  if (!size)
+    return DwarfGenSuccess;
+  if (!buffer)
+    return DwarfGenInvalidArgument;
+
+  const DwarfSections &sections = result->dwarf->sections;
+  uint8_t *out = static_cast<uint8_t *>(buffer);
+  auto copy = [&](ArrayRef<uint8_t> bytes) { out = std::copy(bytes.begin(), bytes.end(), out); };
+  switch (section) {
+  case DwarfGenSectionInfo:
+    copy(sections.info);
+    break;
+  case DwarfGenSectionAbbrev:
+    copy(sections.abbrev);
+    break;
+  case DwarfGenSectionStr:
+    copy(arrayRefFromStringRef(sections.str));
+    break;
+  case DwarfGenSectionStrOffsets:
+    copy(sections.strOffsets);
+    break;
+  case DwarfGenSectionNames:
+    copy(sections.names);
+    break;
+  case DwarfGenSectionTypes:
+    for (const DwarfTypeUnitSection &unit : sections.typeUnits)
+      copy(unit.bytes);
+    break;
+  }
+  return DwarfGenSuccess;
+}
+
+uint64_t DwarfGenGetNumTypeDIEs(DwarfGenResultRef result) {
+  return result && result->dwarf ? result->dwarf->numTypeDIEs : 0;
+}
+
+size_t DwarfGenGetErrorMessage(DwarfGenResultRef result, char *buffer, size_t bufferSize) {
+  if (!result)
+    return 0;
+  const std::string &error = result->error;
+  if (buffer && bufferSize) {
+    size_t n = std::min(error.size(), bufferSize - 1);
+    std::memcpy(buffer, error.data(), n);
+    buffer[n] = '\0';
+  }
+  return error.size();
+}
+
+void DwarfGenDisposeResult(DwarfGenResultRef result) {
+  delete result;
+}
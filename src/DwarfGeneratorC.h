@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stable C interface of LLVMDwarfCore, for embedders that cannot use the C++
+// API in DwarfGenerator.h
+// - Plain structs in, an opaque result handle out; no C++ type crosses it
+// - Section bytes are copied into buffers the caller owns
+// - Nothing is read from or written to the filesystem
+// - Different results may be used from different threads; one result is not
+//   synchronized
+
+typedef enum {
+  DwarfGenSuccess = 0,
+  // Null pointer, unknown flag, kind or section, or a too small options struct
+  DwarfGenInvalidArgument = 1,
+  // The JSON or type table was rejected; see DwarfGenGetErrorMessage()
+  DwarfGenInvalidLayout = 2,
+  DwarfGenGenerationFailed = 3,
+  DwarfGenBufferTooSmall = 4,
+} DwarfGenStatus;
+
+// DwarfGenOptions::flags
+enum {
+  DwarfGenDedupTypes = 1u << 0,
+  DwarfGenTypeUnits = 1u << 1,
+  DwarfGenStringIndices = 1u << 2,
+  DwarfGenTailMergeStrings = 1u << 3,
+  DwarfGenNameIndex = 1u << 4,
+  DwarfGenShareAbbrevs = 1u << 5,
+  DwarfGenNarrowRefs = 1u << 6,
+  DwarfGenImplicitConsts = 1u << 7,
+};
+
+// Fields are only ever appended; structSize tells which ones the caller knows.
+// Fields past structSize keep their DwarfGenInitOptions() defaults.
+typedef struct {
+  // sizeof(DwarfGenOptions) where the caller was compiled
+  uint32_t structSize;
+  uint32_t flags;
+  uint32_t compileUnits;
+  // Threads for multi-unit builds (0 = all cores)
+  uint32_t jobs;
+} DwarfGenOptions;
+
+// Defaults of LLVMDwarf_Simple: deduplicated types, one compile unit, all cores
+void DwarfGenInitOptions(DwarfGenOptions *options);
+
+typedef enum {
+  DwarfGenBase = 0,
+  DwarfGenPointer = 1,
+  DwarfGenStruct = 2,
+  DwarfGenClass = 3,
+} DwarfGenTypeKind;
+
+// Same fields as the layout JSON (see LayoutTable.h). Names are NUL-terminated
+// and may be null; type references are indices into the type array.
+typedef struct {
+  const char *name;
+  uint32_t type;
+  uint64_t offset;
+} DwarfGenMember;
+
+typedef struct {
+  uint32_t kind;
+  const char *name;
+  uint64_t byteSize;
+  // DW_ATE_* of base types
+  uint32_t encoding;
+  // Pointee index of pointer types
+  uint32_t pointee;
+  const DwarfGenMember *members;
+  size_t numMembers;
+} DwarfGenType;
+
+typedef struct DwarfGenOpaqueResult *DwarfGenResultRef;
+
+// Generate the DWARF of one layout. Unless the status is
+// DwarfGenInvalidArgument with a null result pointer, *result receives a
+// handle, holding either the sections or the error message, that the caller
+// releases with DwarfGenDisposeResult(). The inputs are not used after the call.
+DwarfGenStatus DwarfGenGenerateFromJSON(const char *json, size_t length, const DwarfGenOptions *options, DwarfGenResultRef *result);
+// producer may be null for the default
+DwarfGenStatus DwarfGenGenerate(const char *producer, const DwarfGenType *types, size_t numTypes, const DwarfGenOptions *options,
+                                DwarfGenResultRef *result);
+
+typedef enum {
+  DwarfGenSectionInfo = 0,
+  DwarfGenSectionAbbrev = 1,
+  DwarfGenSectionStr = 2,
+  // Empty without DwarfGenStringIndices
+  DwarfGenSectionStrOffsets = 3,
+  // Empty without DwarfGenNameIndex
+  DwarfGenSectionNames = 4,
+  // Every type unit back to back, as .debug_types; empty without DwarfGenTypeUnits
+  DwarfGenSectionTypes = 5,
+} DwarfGenSection;
+
+// 0 for unknown sections and failed results
+size_t DwarfGenGetSectionSize(DwarfGenResultRef result, DwarfGenSection section);
+// Copies the section to the start of buffer, or returns DwarfGenBufferTooSmall
+// and copies nothing when it needs more than bufferSize bytes
+DwarfGenStatus DwarfGenCopySection(DwarfGenResultRef result, DwarfGenSection section, void *buffer, size_t bufferSize);
+uint64_t DwarfGenGetNumTypeDIEs(DwarfGenResultRef result);
+// snprintf-style: writes at most bufferSize bytes including the NUL and returns
+// the full message length; "" for successful results
+size_t DwarfGenGetErrorMessage(DwarfGenResultRef result, char *buffer, size_t bufferSize);
+void DwarfGenDisposeResult(DwarfGenResultRef result);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+
+#include "src/ByteEncoding.h"
+#include "src/DwarfNameIndex.h"
+
+using namespace llvm;
+
+// Same heuristic as AccelTableBase::computeBucketCount()
+static uint32_t getBucketCount(uint32_t uniqueHashCount) {
+  if (uniqueHashCount > 1024)
+    return uniqueHashCount / 4;
+  if (uniqueHashCount > 16)
+    return uniqueHashCount / 2;
+  return std::max<uint32_t>(uniqueHashCount, 1);
+}
+
+// Smallest data form that holds every unit index
+static dwarf::Form getUnitIndexForm(size_t numUnits) {
+  if (numUnits <= UINT8_MAX + 1)
+    return dwarf::DW_FORM_data1;
+  if (numUnits <= UINT16_MAX + 1)
+    return dwarf::DW_FORM_data2;
+  return dwarf::DW_FORM_data4;
+}
+
+void writeDebugNames(SmallVectorImpl<uint8_t> &out, MutableArrayRef<DwarfNameEntry> entries, ArrayRef<uint64_t> unitOffsets,
+                     const dwarf::FormParams &formParams) {
+  unsigned offsetSize = formParams.getDwarfOffsetByteSize();
+
+  DenseSet<uint32_t> uniqueHashes;
+  uniqueHashes.reserve(entries.size());
+  for (const DwarfNameEntry &entry : entries)
+    uniqueHashes.insert(entry.hash);
+  uint32_t bucketCount = getBucketCount(uniqueHashes.size());
+
+  // Names grouped by bucket, sorted by hash within a bucket. Entries of one
+  // name stay together in unit/offset order.
+  auto getKey = [&](const DwarfNameEntry &entry) { return uint64_t(entry.hash % bucketCount) << 32 | entry.hash; };
+  std::sort(entries.begin(), entries.end(), [&](const DwarfNameEntry &a, const DwarfNameEntry &b) {
+    uint64_t keyA = getKey(a), keyB = getKey(b);
+    if (keyA != keyB)
+      return keyA < keyB;
+    if (a.strOffset != b.strOffset)
+      return a.strOffset < b.strOffset;
+    return a.unit != b.unit ? a.unit < b.unit : a.dieOffset < b.dieOffset;
+  });
+
+  // [begin, end) of each name's entries
+  std::vector<std::pair<uint32_t, uint32_t>> names;
+  for (uint32_t i = 0; i < entries.size(); ++i) {
+    if (i == 0 || entries[i].strOffset != entries[i - 1].strOffset)
+      names.push_back({i, i});
+    names.back().second = i + 1;
+  }
+
+  // One abbreviation per tag, numbered in order of first use
+  bool withUnit = unitOffsets.size() > 1;
+  dwarf::Form unitForm = getUnitIndexForm(unitOffsets.size());
+  unsigned unitSize = unitForm == dwarf::DW_FORM_data1 ? 1 : unitForm == dwarf::DW_FORM_data2 ? 2 : 4;
+  DenseMap<unsigned, unsigned> abbrevCodes;
+  SmallVector<uint8_t, 64> abbrevTable;
+  for (const DwarfNameEntry &entry : entries) {
+    if (!abbrevCodes.insert({entry.tag, abbrevCodes.size() + 1}).second)
+      continue;
+    writeULEB(abbrevTable, abbrevCodes.size());
+    writeULEB(abbrevTable, entry.tag);
+    if (withUnit) {
+      writeULEB(abbrevTable, dwarf::DW_IDX_compile_unit);
+      writeULEB(abbrevTable, unitForm);
+    }
+    writeULEB(abbrevTable, dwarf::DW_IDX_die_offset);
+    writeULEB(abbrevTable, dwarf::DW_FORM_ref4);
+    writeULEB(abbrevTable, 0);
+    writeULEB(abbrevTable, 0);
+  }
+  abbrevTable.push_back(0);
+
+  // Header; unit_length is patched once the size is known
+  if (formParams.Format == dwarf::DWARF64)
+    writeInt(out, 0xffffffff, 4);
+  writeInt(out, 0, offsetSize);
+  size_t lengthEnd = out.size();
+  writeInt(out, 5, 2);
+  writeInt(out, 0, 2);
+  writeInt(out, unitOffsets.size(), 4);
+  writeInt(out, 0, 4);
+  writeInt(out, 0, 4);
+  writeInt(out, bucketCount, 4);
+  writeInt(out, names.size(), 4);
+  writeInt(out, abbrevTable.size(), 4);
+  writeInt(out, 0, 4);
+
+  for (uint64_t unitOffset : unitOffsets)
+    writeInt(out, unitOffset, offsetSize);
+
+  // Buckets hold the 1-based index of their first name, 0 when empty
+  std::vector<uint32_t> buckets(bucketCount);
+  for (size_t i = names.size(); i-- > 0;)
+    buckets[entries[names[i].first].hash % bucketCount] = i + 1;
+  for (uint32_t bucket : buckets)
+    writeInt(out, bucket, 4);
+  for (const std::pair<uint32_t, uint32_t> &name : names)
+    writeInt(out, entries[name.first].hash, 4);
+  for (const std::pair<uint32_t, uint32_t> &name : names)
+    writeInt(out, entries[name.first].strOffset, offsetSize);
+
+  // Entry offsets are relative to the entry pool, which follows the abbreviations
+  size_t entryOffsetsAt = out.size();
+  out.resize(out.size() + names.size() * offsetSize);
+  out.append(abbrevTable.begin(), abbrevTable.end());
+  size_t poolStart = out.size();
+  for (size_t i = 0; i < names.size(); ++i) {
+    patchInt(out, entryOffsetsAt + i * offsetSize, out.size() - poolStart, offsetSize);
+    for (uint32_t e = names[i].first; e < names[i].second; ++e) {
+      const DwarfNameEntry &entry = entries[e];
+      writeULEB(out, abbrevCodes.lookup(entry.tag));
+      if (withUnit)
+        writeInt(out, entry.unit, unitSize);
+      writeInt(out, entry.dieOffset, 4);
+    }
+    out.push_back(0);
+  }
+
+  patchInt(out, lengthEnd - offsetSize, out.size() - lengthEnd, offsetSize);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+
+// One named DIE for the name index
+struct DwarfNameEntry {
+  // .debug_str offset of the name, and caseFoldingDjbHash() of it
+  uint32_t strOffset;
+  uint32_t hash;
+  // Index into the compile unit list, and the DIE's offset within that unit
+  uint32_t unit;
+  uint32_t dieOffset;
+  llvm::dwarf::Tag tag;
+};
+
+// Write a DWARF 5 .debug_names section holding a single name index over the
+// compile units at unitOffsets (.debug_info offsets)
+// - Entries with the same strOffset share one name; each entry records its tag,
+//   its unit (only with more than one unit) and its unit-relative DIE offset
+// - Bucket count and name order follow LLVM's AccelTable, so the output does
+//   not depend on the order of entries
+void writeDebugNames(llvm::SmallVectorImpl<uint8_t> &out, llvm::MutableArrayRef<DwarfNameEntry> entries,
+                     llvm::ArrayRef<uint64_t> unitOffsets, const llvm::dwarf::FormParams &formParams);
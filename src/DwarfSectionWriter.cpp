@@ -0,0 +1,258 @@
+#include <cassert>
+
+#include "src/ByteEncoding.h"
+#include "src/DwarfSectionWriter.h"
+
+using namespace llvm;
+
+static Error unsupportedForm(dwarf::Form form) {
+  return createStringError(inconvertibleErrorCode(), "unsupported DWARF form %s", dwarf::FormEncodingString(form).str().c_str());
+}
+
+unsigned getCompileUnitHeaderSize(const dwarf::FormParams &formParams) {
+  // unit_length + version + debug_abbrev_offset + address_size (+ unit_type in DWARF 5)
+  unsigned size = formParams.getDwarfOffsetByteSize() + (formParams.Format == dwarf::DWARF64 ? 4 : 0) + 2 +
+                  formParams.getDwarfOffsetByteSize() + 1;
+  if (formParams.Version >= 5)
+    size += 1;
+  return size;
+}
+
+unsigned getTypeUnitHeaderSize(const dwarf::FormParams &formParams) {
+  return getCompileUnitHeaderSize(formParams) + 8 + formParams.getDwarfOffsetByteSize();
+}
+
+DwarfUnitOffsets computeCompileUnitOffsets(ArrayRef<DIE *> unitDies, const dwarf::FormParams &formParams) {
+  DwarfUnitOffsets offsets;
+  uint64_t offset = 0;
+  for (const DIE *unitDie : unitDies) {
+    offsets[unitDie] = offset;
+    offset += getCompileUnitHeaderSize(formParams) + unitDie->getSize();
+  }
+  return offsets;
+}
+
+void DwarfSectionWriter::flushAbbrevTable() {
+  if (abbrevDecls.empty())
+    return;
+  for (const SmallVectorImpl<uint8_t> &decl : abbrevDecls)
+    abbrev.append(decl.begin(), decl.end());
+  abbrev.push_back(0);
+  abbrevDecls.clear();
+}
+
+void DwarfSectionWriter::startAbbrevTable() {
+  flushAbbrevTable();
+}
+
+void DwarfSectionWriter::recordAbbrev(const DIE &die) {
+  unsigned number = die.getAbbrevNumber();
+  if (number >= abbrevDecls.size())
+    abbrevDecls.resize(number + 1);
+  SmallVectorImpl<uint8_t> &decl = abbrevDecls[number];
+  if (!decl.empty())
+    return;
+
+  DIEAbbrev abbrev = die.generateAbbrev();
+  writeULEB(decl, number);
+  writeULEB(decl, abbrev.getTag());
+  decl.push_back(abbrev.hasChildren() ? dwarf::DW_CHILDREN_yes : dwarf::DW_CHILDREN_no);
+  for (const DIEAbbrevData &data : abbrev.getData()) {
+    writeULEB(decl, data.getAttribute());
+    writeULEB(decl, data.getForm());
+    if (data.getForm() == dwarf::DW_FORM_implicit_const)
+      writeSLEB(decl, data.getValue());
+  }
+  decl.push_back(0);
+  decl.push_back(0);
+}
+
+Error DwarfSectionWriter::emitDIEValues(SmallVectorImpl<uint8_t> &out, const DIE &die, uint64_t unitOffset) {
+  recordAbbrev(die);
+  writeULEB(out, die.getAbbrevNumber());
+
+  unsigned offsetSize = formParams.getDwarfOffsetByteSize();
+  for (const DIEValue &V : die.values()) {
+    dwarf::Form form = V.getForm();
+    uint64_t value;
+
+    switch (V.getType()) {
+    case DIEValue::isInteger:
+      value = V.getDIEInteger().getValue();
+      break;
+    case DIEValue::isEntry: {
+      const DIE &entry = V.getDIEEntry().getEntry();
+      value = entry.getOffset();
+      if (form == dwarf::DW_FORM_ref_addr) {
+        // Without unit offsets, only references into the current unit resolve
+        uint64_t targetUnitOffset = unitOffset;
+        if (unitOffsets) {
+          auto it = unitOffsets->find(entry.getUnitDie());
+          if (it != unitOffsets->end())
+            targetUnitOffset = it->second;
+        }
+        value += targetUnitOffset;
+      }
+      break;
+    }
+    default:
+      return unsupportedForm(form);
+    }
+
+    switch (form) {
+    case dwarf::DW_FORM_flag_present:
+    case dwarf::DW_FORM_implicit_const:
+      break;
+    case dwarf::DW_FORM_data1:
+    case dwarf::DW_FORM_ref1:
+    case dwarf::DW_FORM_flag:
+    case dwarf::DW_FORM_strx1:
+      writeInt(out, value, 1);
+      break;
+    case dwarf::DW_FORM_data2:
+    case dwarf::DW_FORM_ref2:
+    case dwarf::DW_FORM_strx2:
+      writeInt(out, value, 2);
+      break;
+    case dwarf::DW_FORM_strx3:
+      writeInt(out, value, 3);
+      break;
+    case dwarf::DW_FORM_data4:
+    case dwarf::DW_FORM_ref4:
+    case dwarf::DW_FORM_strx4:
+      writeInt(out, value, 4);
+      break;
+    case dwarf::DW_FORM_data8:
+    case dwarf::DW_FORM_ref8:
+    case dwarf::DW_FORM_ref_sig8:
+      writeInt(out, value, 8);
+      break;
+    case dwarf::DW_FORM_udata:
+    case dwarf::DW_FORM_ref_udata:
+    case dwarf::DW_FORM_strx:
+      writeULEB(out, value);
+      break;
+    case dwarf::DW_FORM_sdata:
+      writeSLEB(out, value);
+      break;
+    case dwarf::DW_FORM_strp:
+    case dwarf::DW_FORM_sec_offset:
+    case dwarf::DW_FORM_ref_addr:
+      writeInt(out, value, offsetSize);
+      break;
+    case dwarf::DW_FORM_addr:
+      writeInt(out, value, formParams.AddrSize);
+      break;
+    default:
+      return unsupportedForm(form);
+    }
+  }
+  return Error::success();
+}
+
+Error DwarfSectionWriter::emitDIE(SmallVectorImpl<uint8_t> &out, const DIE &die, uint64_t unitOffset) {
+  if (Error err = emitDIEValues(out, die, unitOffset))
+    return err;
+  for (const DIE &child : die.children()) {
+    if (Error err = emitDIE(out, child, unitOffset))
+      return err;
+  }
+  if (die.hasChildren())
+    out.push_back(0);
+  return Error::success();
+}
+
+void DwarfSectionWriter::emitUnitHeader(SmallVectorImpl<uint8_t> &out, uint64_t unitSize, uint8_t unitType) {
+  unsigned offsetSize = formParams.getDwarfOffsetByteSize();
+  // unit_length excludes itself (and the DWARF64 escape)
+  if (formParams.Format == dwarf::DWARF64) {
+    writeInt(out, 0xffffffff, 4);
+    writeInt(out, unitSize - 12, 8);
+  } else {
+    writeInt(out, unitSize - 4, 4);
+  }
+  writeInt(out, formParams.Version, 2);
+  if (formParams.Version >= 5) {
+    out.push_back(unitType);
+    out.push_back(formParams.AddrSize);
+    writeInt(out, abbrev.size(), offsetSize);
+  } else {
+    writeInt(out, abbrev.size(), offsetSize);
+    out.push_back(formParams.AddrSize);
+  }
+}
+
+Error DwarfSectionWriter::emitCompileUnit(const DIE &unitDie) {
+  uint64_t unitOffset = infoDrained + info.size();
+  uint64_t unitSize = getCompileUnitHeaderSize(formParams) + unitDie.getSize();
+  assert((!unitOffsets || !unitOffsets->count(&unitDie) || unitOffsets->lookup(&unitDie) == unitOffset) &&
+         "compile units emitted out of the planned order");
+  info.reserve(info.size() + unitSize);
+
+  emitUnitHeader(info, unitSize, dwarf::DW_UT_compile);
+  if (Error err = emitDIE(info, unitDie, unitOffset))
+    return err;
+  assert(infoDrained + info.size() - unitOffset == unitSize && "DIE sizes out of sync with computeOffsetsAndAbbrevs()");
+  return Error::success();
+}
+
+Error DwarfSectionWriter::beginCompileUnit(const DIE &unitDie, uint64_t unitSize) {
+  assert(unitDie.hasChildren() && unitDie.children().empty() && "streamed unit DIE needs forced children and none attached");
+  streamUnitOffset = infoDrained + info.size();
+  streamUnitEnd = streamUnitOffset + unitSize;
+  emitUnitHeader(info, unitSize, dwarf::DW_UT_compile);
+  return emitDIEValues(info, unitDie, streamUnitOffset);
+}
+
+Error DwarfSectionWriter::emitChildDIE(const DIE &die) {
+  assert(streamUnitOffset + die.getOffset() == infoDrained + info.size() && "child DIE not laid out at the stream position");
+  return emitDIE(info, die, streamUnitOffset);
+}
+
+void DwarfSectionWriter::endCompileUnit() {
+  info.push_back(0);
+  assert(infoDrained + info.size() == streamUnitEnd && "streamed unit size out of sync with the layout pass");
+}
+
+Error DwarfSectionWriter::emitSubtree(SmallVectorImpl<uint8_t> &out, const DIE &die) {
+  return emitDIE(out, die, 0);
+}
+
+void DwarfSectionWriter::drainInfo(raw_ostream &OS) {
+  OS.write(reinterpret_cast<const char *>(info.data()), info.size());
+  infoDrained += info.size();
+  info.clear();
+}
+
+Error DwarfSectionWriter::emitTypeUnit(const DIE &unitDie, uint64_t signature, const DIE &typeDie) {
+  DwarfTypeUnitSection unit{signature, {}};
+  uint64_t unitSize = getTypeUnitHeaderSize(formParams) + unitDie.getSize();
+  unit.bytes.reserve(unitSize);
+
+  emitUnitHeader(unit.bytes, unitSize, dwarf::DW_UT_type);
+  writeInt(unit.bytes, signature, 8);
+  writeInt(unit.bytes, typeDie.getOffset(), formParams.getDwarfOffsetByteSize());
+  if (Error err = emitDIE(unit.bytes, unitDie, 0))
+    return err;
+  assert(unit.bytes.size() == unitSize && "DIE sizes out of sync with computeOffsetsAndAbbrevs()");
+  typeUnits.push_back(std::move(unit));
+  return Error::success();
+}
+
+DwarfSections DwarfSectionWriter::finish(const SimpleStringPool &stringPool) {
+  DwarfSections sections;
+  flushAbbrevTable();
+  if (abbrev.empty())
+    abbrev.push_back(0);
+  sections.abbrev = std::move(abbrev);
+  sections.info = std::move(info);
+  sections.str = stringPool.getData();
+  if (stringPool.getNumIndices())
+    stringPool.writeStrOffsets(sections.strOffsets);
+  sections.typeUnits = std::move(typeUnits);
+  abbrev.clear();
+  info.clear();
+  infoDrained = 0;
+  typeUnits.clear();
+  return sections;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/CodeGen/DIE.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/SimpleStringPool.h"
+
+// One serialized type unit, identified by its type signature. Wasm output
+// gives each unit its own .debug_types section; nothing groups them for the
+// linker to deduplicate.
+struct DwarfTypeUnitSection {
+  uint64_t signature;
+  llvm::SmallVector<uint8_t, 0> bytes;
+};
+
+// Raw contents of the DWARF sections produced from a DIE tree
+struct DwarfSections {
+  llvm::SmallVector<uint8_t, 0> info;
+  llvm::SmallVector<uint8_t, 0> abbrev;
+  // .debug_str is the string pool buffer itself, so this is only a view into it
+  llvm::StringRef str;
+  // DWARF 5 string index table; empty unless the pool has indices
+  llvm::SmallVector<uint8_t, 0> strOffsets;
+  // DWARF 5 name index; empty unless asked for
+  llvm::SmallVector<uint8_t, 0> names;
+  std::vector<DwarfTypeUnitSection> typeUnits;
+};
+
+// Non-owning view of the same sections, e.g. of a memory-mapped cache entry
+struct DwarfSectionsRef {
+  llvm::ArrayRef<uint8_t> info;
+  llvm::ArrayRef<uint8_t> abbrev;
+  llvm::StringRef str;
+  llvm::ArrayRef<uint8_t> strOffsets;
+  llvm::ArrayRef<uint8_t> names;
+  llvm::SmallVector<llvm::ArrayRef<uint8_t>, 0> typeUnits;
+
+  DwarfSectionsRef() = default;
+  DwarfSectionsRef(const DwarfSections &sections)
+      : info(sections.info), abbrev(sections.abbrev), str(sections.str), strOffsets(sections.strOffsets),
+        names(sections.names) {
+    for (const DwarfTypeUnitSection &unit : sections.typeUnits)
+      typeUnits.push_back(unit.bytes);
+  }
+};
+
+// Size of the compile unit header that precedes the unit DIE in .debug_info.
+// Pass this as the CUOffset to DIE::computeOffsetsAndAbbrevs().
+unsigned getCompileUnitHeaderSize(const llvm::dwarf::FormParams &formParams);
+// Same for type units (adds type_signature and type_offset)
+unsigned getTypeUnitHeaderSize(const llvm::dwarf::FormParams &formParams);
+
+// .debug_info offset of each compile unit, keyed by unit DIE
+using DwarfUnitOffsets = llvm::DenseMap<const llvm::DIE *, uint64_t>;
+// Offsets of compile units emitted back to back in this order. Resolves
+// DW_FORM_ref_addr into units that have not been emitted yet.
+DwarfUnitOffsets computeCompileUnitOffsets(llvm::ArrayRef<llvm::DIE *> unitDies, const llvm::dwarf::FormParams &formParams);
+
+// Direct little-endian DWARF serializer for DIE trees
+// - No MC layer, AsmPrinter, IR module or pass manager involved
+// - Expects computeOffsetsAndAbbrevs() to have run on every unit DIE, so the
+//   abbreviation numbers, offsets and sizes stored in the DIEs are final
+class DwarfSectionWriter {
+  llvm::dwarf::FormParams formParams;
+  // Encoded abbreviation declarations indexed by abbreviation number
+  llvm::SmallVector<llvm::SmallVector<uint8_t, 16>, 16> abbrevDecls;
+  // Finished abbreviation tables; the current one starts at abbrev.size()
+  llvm::SmallVector<uint8_t, 0> abbrev;
+  llvm::SmallVector<uint8_t, 0> info;
+  // .debug_info bytes already handed out by drainInfo()
+  uint64_t infoDrained = 0;
+  // Streamed unit: its offset, and the bytes expected by endCompileUnit()
+  uint64_t streamUnitOffset = 0;
+  uint64_t streamUnitEnd = 0;
+  std::vector<DwarfTypeUnitSection> typeUnits;
+  const DwarfUnitOffsets *unitOffsets;
+
+  void flushAbbrevTable();
+  void recordAbbrev(const llvm::DIE &die);
+  void emitUnitHeader(llvm::SmallVectorImpl<uint8_t> &out, uint64_t unitSize, uint8_t unitType);
+  llvm::Error emitDIEValues(llvm::SmallVectorImpl<uint8_t> &out, const llvm::DIE &die, uint64_t unitOffset);
+  llvm::Error emitDIE(llvm::SmallVectorImpl<uint8_t> &out, const llvm::DIE &die, uint64_t unitOffset);
+
+public:
+  // unitOffsets is needed once DW_FORM_ref_addr points into other compile units
+  explicit DwarfSectionWriter(const llvm::dwarf::FormParams &formParams, const DwarfUnitOffsets *unitOffsets = nullptr)
+      : formParams(formParams), unitOffsets(unitOffsets) {
+  }
+
+  // Close the current abbreviation table. Units emitted afterwards use a new
+  // one, for DIE trees laid out with their own DIEAbbrevSet.
+  void startAbbrevTable();
+
+  // Append one compile unit (header + DIE tree) to .debug_info.
+  llvm::Error emitCompileUnit(const llvm::DIE &unitDie);
+
+  // Streaming: one compile unit emitted piece by piece, so its children can be
+  // released as soon as they are written. unitDie is laid out with
+  // setForceChildren(true) and no children; unitSize covers the header, the
+  // unit DIE and every child, as found by an earlier layout pass. Each child
+  // must be laid out at its final unit offset before emitChildDIE().
+  llvm::Error beginCompileUnit(const llvm::DIE &unitDie, uint64_t unitSize);
+  llvm::Error emitChildDIE(const llvm::DIE &die);
+  void endCompileUnit();
+  // Move the pending .debug_info bytes to OS
+  void drainInfo(llvm::raw_ostream &OS);
+
+  // Serialize one laid-out subtree of the first unit to out, e.g. to patch it
+  // into an existing .debug_info. Its abbreviations are recorded as usual.
+  llvm::Error emitSubtree(llvm::SmallVectorImpl<uint8_t> &out, const llvm::DIE &die);
+  // Highest abbreviation number recorded for the current table, and the
+  // encoded declaration of one (empty if no emitted DIE used it)
+  unsigned getNumAbbrevDecls() const {
+    return abbrevDecls.empty() ? 0 : abbrevDecls.size() - 1;
+  }
+  llvm::ArrayRef<uint8_t> getAbbrevDecl(unsigned number) const {
+    return number < abbrevDecls.size() ? llvm::ArrayRef<uint8_t>(abbrevDecls[number]) : llvm::ArrayRef<uint8_t>();
+  }
+
+  // Serialize a type unit into its own contribution. typeDie is the DIE the
+  // signature describes and must be a descendant of unitDie.
+  llvm::Error emitTypeUnit(const llvm::DIE &unitDie, uint64_t signature, const llvm::DIE &typeDie);
+
+  // Hand out the finished sections; the writer is empty afterwards. info only
+  // holds what drainInfo() has not taken yet.
+  DwarfSections finish(const SimpleStringPool &stringPool);
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+#include "src/ByteEncoding.h"
+
+// Wire format of the --serve Unix socket, shared by the server and clients
+//
+// A connection carries any number of requests, answered in order:
+//
+//   request:  u32 size, layout JSON (see LayoutTable.h); size 0 = built-in MyClass example
+//   response: u32 status, u32 count, count x (u32 size, bytes)
+//
+// On success (status 0) the parts are .debug_info, .debug_abbrev, .debug_str,
+// .debug_str_offsets (empty without string indices), .debug_names (empty
+// without the name index) and .debug_types (empty without type units). On
+// failure (status 1) the only part is the error message. Integers are little-endian.
+
+enum class DwarfServeStatus : uint32_t { Ok = 0, Failed = 1 };
+
+// Upper bound on a request, so a corrupt size cannot make the server allocate gigabytes
+constexpr uint32_t DwarfServeMaxRequestSize = 1u << 30;
+
+#ifndef MSG_NOSIGNAL
+// No per-call flag (macOS); the server ignores SIGPIPE instead
+#define MSG_NOSIGNAL 0
+#endif
+
+inline bool serveWriteAll(int fd, const void *data, size_t size) {
+  const char *ptr = static_cast<const char *>(data);
+  while (size) {
+    ssize_t n = ::send(fd, ptr, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+inline bool serveReadAll(int fd, void *data, size_t size) {
+  char *ptr = static_cast<char *>(data);
+  while (size) {
+    ssize_t n = ::read(fd, ptr, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+inline bool serveReadU32(int fd, uint32_t &value) {
+  uint8_t bytes[4];
+  if (!serveReadAll(fd, bytes, 4))
+    return false;
+  value = readLE(bytes, 4);
+  return true;
+}
+
+// One size-prefixed part of a request or response. Both are assembled in memory,
+// u32 fields with writeInt(out, value, 4), and sent with one serveWriteAll().
+inline void appendServePart(llvm::SmallVectorImpl<uint8_t> &out, llvm::ArrayRef<uint8_t> bytes) {
+  writeInt(out, bytes.size(), 4);
+  out.append(bytes.begin(), bytes.end());
+}
+
+inline bool serveReadPart(int fd, std::string &bytes, uint32_t maxSize = DwarfServeMaxRequestSize) {
+  uint32_t size;
+  if (!serveReadU32(fd, size) || size > maxSize)
+    return false;
+  bytes.resize(size);
+  return serveReadAll(fd, &bytes[0], size);
+}
+
+// false if path does not fit into sockaddr_un
+inline bool makeServeSocketAddress(llvm::StringRef path, sockaddr_un &addr) {
+  addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path))
+    return false;
+  std::memcpy(addr.sun_path, path.data(), path.size());
+  return true;
+}
@@ -0,0 +1,148 @@
+#include <cerrno>
+#include <csignal>
+#include <string>
+#include <system_error>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include "src/DwarfServeProtocol.h"
+#include "src/DwarfServer.h"
+#include "src/LayoutTable.h"
+
+using namespace llvm;
+
+#if LLVM_VERSION_MAJOR >= 18
+using ConnectionThreadPool = DefaultThreadPool;
+#else
+using ConnectionThreadPool = ThreadPool;
+#endif
+
+static Error socketError(const char *what, StringRef path) {
+  std::error_code ec(errno, std::generic_category());
+  return createStringError(ec, "%s %s: %s", what, path.str().c_str(), ec.message().c_str());
+}
+
+// Generate the DWARF for one request and encode the response
+static void handleRequest(StringRef json, const DwarfGeneratorOptions &options, SmallVectorImpl<uint8_t> &response) {
+  auto fail = [&](Error err) {
+    std::string message = toString(std::move(err));
+    writeInt(response, uint32_t(DwarfServeStatus::Failed), 4);
+    writeInt(response, 1, 4);
+    appendServePart(response, arrayRefFromStringRef(message));
+  };
+
+  LayoutTable table;
+  if (json.empty()) {
+    makeSampleLayout(table);
+  } else if (Error err = parseLayoutJSON(json, table)) {
+    fail(std::move(err));
+    return;
+  }
+
+  Expected<std::unique_ptr<GeneratedDwarf>> generated = generateDwarf(table, options);
+  if (!generated) {
+    fail(generated.takeError());
+    return;
+  }
+  const DwarfSections &sections = (*generated)->sections;
+
+  size_t typeUnitBytes = 0;
+  for (const DwarfTypeUnitSection &unit : sections.typeUnits)
+    typeUnitBytes += unit.bytes.size();
+  response.reserve(8 * 4 + sections.info.size() + sections.abbrev.size() + sections.str.size() + sections.strOffsets.size() +
+                   sections.names.size() + typeUnitBytes);
+  writeInt(response, uint32_t(DwarfServeStatus::Ok), 4);
+  writeInt(response, 6, 4);
+  appendServePart(response, sections.info);
+  appendServePart(response, sections.abbrev);
+  appendServePart(response, arrayRefFromStringRef(sections.str));
+  appendServePart(response, sections.strOffsets);
+  appendServePart(response, sections.names);
+  writeInt(response, typeUnitBytes, 4);
+  for (const DwarfTypeUnitSection &unit : sections.typeUnits)
+    response.append(unit.bytes.begin(), unit.bytes.end());
+}
+
+// Answer requests in order until the client disconnects or sends garbage
+static void handleConnection(int fd, const DwarfGeneratorOptions &options) {
+  std::string request;
+  SmallVector<uint8_t, 0> response;
+  while (serveReadPart(fd, request)) {
+    response.clear();
+    handleRequest(request, options, response);
+    if (!serveWriteAll(fd, response.data(), response.size()))
+      break;
+  }
+  ::close(fd);
+}
+
+// A socket file that refuses connections was left by a killed server and is
+// removed; one that accepts them belongs to a running server
+static Error removeStaleSocket(StringRef socketPath, const sockaddr_un &addr) {
+  sys::fs::file_status status;
+  if (sys::fs::status(socketPath, status) || status.type() != sys::fs::file_type::socket_file)
+    return Error::success();
+  int probeFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (probeFd < 0)
+    return socketError("cannot create socket for", socketPath);
+  int result = ::connect(probeFd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr));
+  int connectErrno = errno;
+  ::close(probeFd);
+  if (result == 0)
+    return createStringError(std::make_error_code(std::errc::address_in_use), "a server is already serving on %s",
+                             socketPath.str().c_str());
+  if (connectErrno != ECONNREFUSED) {
+    errno = connectErrno;
+    return socketError("cannot connect to", socketPath);
+  }
+  ::unlink(addr.sun_path);
+  return Error::success();
+}
+
+Error runDwarfServer(StringRef socketPath, const DwarfGeneratorOptions &options, unsigned maxConnections,
+                     function_ref<void()> onListening) {
+  sockaddr_un addr;
+  if (!makeServeSocketAddress(socketPath, addr))
+    return createStringError(inconvertibleErrorCode(), "socket path too long: %s", socketPath.str().c_str());
+
+  // Clients that hang up early must not kill the server
+  std::signal(SIGPIPE, SIG_IGN);
+
+  if (Error err = removeStaleSocket(socketPath, addr))
+    return err;
+
+  int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFd < 0)
+    return socketError("cannot create socket for", socketPath);
+  if (::bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(listenFd, SOMAXCONN) < 0) {
+    Error err = socketError("cannot listen on", socketPath);
+    ::close(listenFd);
+    return err;
+  }
+  if (onListening)
+    onListening();
+
+  // Every connection in flight may be generating, so their number bounds the
+  // memory in use; further connections wait in the queue until one closes
+  ConnectionThreadPool pool(hardware_concurrency(maxConnections));
+  for (;;) {
+    int fd = ::accept(listenFd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      Error err = socketError("cannot accept on", socketPath);
+      ::close(listenFd);
+      // The connections still use options
+      pool.wait();
+      return err;
+    }
+    pool.async([fd, &options] { handleConnection(fd, options); });
+  }
+}
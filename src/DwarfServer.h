@@ -0,0 +1,21 @@
+#pragma once
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include "src/DwarfGenerator.h"
+
+// Warm generator process: serves DWARF for layout tables sent over a Unix
+// domain socket (protocol in DwarfServeProtocol.h) until the process is killed
+// - Pays process start and LLVM static initialization once, not per module
+// - Up to maxConnections connections (0 = one per hardware thread) are served
+//   concurrently, each on its own pool thread; further ones wait until one
+//   closes. Each request has its own table, DIEs and string pool
+// - Every request is generated by generateDwarf() with the same options
+// - A stale socket file left at socketPath by a killed server is replaced;
+//   fails if a running server still listens on it
+// onListening runs once clients can connect. Only returns on a socket error,
+// once the open connections have closed.
+llvm::Error runDwarfServer(llvm::StringRef socketPath, const DwarfGeneratorOptions &options, unsigned maxConnections = 0,
+                           llvm::function_ref<void()> onListening = {});
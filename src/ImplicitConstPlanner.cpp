@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+#include "llvm/Support/LEB128.h"
+
+#include "src/ImplicitConstPlanner.h"
+
+using namespace llvm;
+
+// .debug_info bytes of a constant attribute value; 0 for anything else
+static unsigned getConstantSize(const DIEValue &V) {
+  if (V.getType() != DIEValue::isInteger)
+    return 0;
+  uint64_t value = V.getDIEInteger().getValue();
+  switch (V.getForm()) {
+  case dwarf::DW_FORM_data1:
+    return 1;
+  case dwarf::DW_FORM_data2:
+    return 2;
+  case dwarf::DW_FORM_data4:
+    return 4;
+  case dwarf::DW_FORM_data8:
+    return 8;
+  case dwarf::DW_FORM_udata:
+    return getULEB128Size(value);
+  case dwarf::DW_FORM_sdata:
+    return getSLEB128Size(int64_t(value));
+  default:
+    return 0;
+  }
+}
+
+// .debug_abbrev bytes of the declaration of abbrev, assuming a one-byte code
+static unsigned getAbbrevDeclSize(const DIEAbbrev &abbrev) {
+  unsigned size = 1 + getULEB128Size(abbrev.getTag()) + 1 + 2;
+  for (const DIEAbbrevData &data : abbrev.getData()) {
+    size += getULEB128Size(data.getAttribute()) + getULEB128Size(data.getForm());
+    if (data.getForm() == dwarf::DW_FORM_implicit_const)
+      size += getSLEB128Size(data.getValue());
+  }
+  return size;
+}
+
+ImplicitConstPlanner::ImplicitConstPlanner(unsigned numUnits) {
+  for (unsigned i = 0; i < numUnits; ++i)
+    units.push_back(std::make_unique<UnitState>());
+}
+
+void ImplicitConstPlanner::count(UnitState &state, DIE &die) {
+  unsigned number = state.abbrevSet.uniqueAbbreviation(die).getNumber();
+  if (number > state.shapes.size())
+    state.shapes.push_back(&die);
+  std::vector<uint64_t> profile = {number};
+  uint64_t index = 0;
+  for (const DIEValue &V : die.values()) {
+    if (unsigned size = getConstantSize(V)) {
+      uint64_t value = V.getDIEInteger().getValue();
+      Uses &uses = state.uses[{uint64_t(number) << 32 | index, value}];
+      ++uses.count;
+      uses.bytes += size;
+      profile.push_back(index);
+      profile.push_back(value);
+    }
+    ++index;
+  }
+  state.profiles.insert(std::move(profile));
+  for (DIE &child : die.children())
+    count(state, child);
+}
+
+void ImplicitConstPlanner::countUnit(unsigned unit, ArrayRef<DIE *> unitDies) {
+  for (DIE *die : unitDies)
+    count(*units[unit], *die);
+}
+
+void ImplicitConstPlanner::plan(bool sharedAbbrevTable, unsigned maxAbbrevs) {
+  // Unify the unit-local abbreviations in unit order. Uniquing sets the
+  // DIE's abbreviation number, which applyUnit() still needs to be the local one.
+  BumpPtrAllocator allocator;
+  DIEAbbrevSet seen(allocator);
+  std::vector<DIE *> shapes;
+  for (const std::unique_ptr<UnitState> &state : units) {
+    state->globalShapes.assign(state->shapes.size() + 1, 0);
+    for (uint32_t local = 1; local <= state->shapes.size(); ++local) {
+      DIE &die = *state->shapes[local - 1];
+      uint32_t global = seen.uniqueAbbreviation(die).getNumber();
+      die.setAbbrevNumber(local);
+      if (global > shapes.size())
+        shapes.push_back(&die);
+      state->globalShapes[local] = global;
+    }
+  }
+
+  DenseMap<Key, Uses> merged;
+  for (const std::unique_ptr<UnitState> &state : units) {
+    for (const auto &entry : state->uses) {
+      uint64_t shapeAttr = uint64_t(state->globalShapes[entry.first.first >> 32]) << 32 | (entry.first.first & UINT32_MAX);
+      Uses &uses = merged[{shapeAttr, entry.first.second}];
+      uses.count += entry.second.count;
+      uses.bytes += entry.second.bytes;
+      ++uses.units;
+    }
+  }
+
+  // Estimated savings of each candidate, used as the order to try them in:
+  // the value bytes minus one split-off declaration per table that needs it
+  std::vector<std::pair<int64_t, Key>> candidates;
+  std::vector<unsigned> declSizes(shapes.size() + 1);
+  for (uint32_t global = 1; global <= shapes.size(); ++global)
+    declSizes[global] = getAbbrevDeclSize(shapes[global - 1]->generateAbbrev());
+  for (const auto &entry : merged) {
+    unsigned declSize = declSizes[entry.first.first >> 32] + getSLEB128Size(int64_t(entry.first.second));
+    int64_t savings = int64_t(entry.second.bytes) - int64_t(declSize) * (sharedAbbrevTable ? 1 : entry.second.units);
+    if (savings > 0)
+      candidates.push_back({savings, entry.first});
+  }
+  // Ties broken by key, so the choice does not depend on DenseMap iteration
+  std::sort(candidates.begin(), candidates.end(), [](const std::pair<int64_t, Key> &a, const std::pair<int64_t, Key> &b) {
+    return std::tie(b.first, a.second) < std::tie(a.first, b.second);
+  });
+
+  // Distinct DIE profiles per table, as [table, abbreviation, attribute index, value, ...],
+  // each with the positions of its values that are chosen
+  std::map<std::vector<uint64_t>, std::vector<bool>> profiles;
+  unsigned numTables = sharedAbbrevTable ? 1 : units.size();
+  for (unsigned unit = 0; unit < units.size(); ++unit) {
+    const UnitState &state = *units[unit];
+    for (const std::vector<uint64_t> &local : state.profiles) {
+      std::vector<uint64_t> key = {sharedAbbrevTable ? 0 : unit, state.globalShapes[local[0]]};
+      key.insert(key.end(), local.begin() + 1, local.end());
+      profiles.try_emplace(std::move(key), std::vector<bool>((local.size() - 1) / 2));
+    }
+  }
+  // Where each candidate occurs: profile and value position
+  using Profile = std::pair<const std::vector<uint64_t>, std::vector<bool>>;
+  DenseMap<Key, std::vector<std::pair<Profile *, unsigned>>> positions;
+  for (Profile &profile : profiles) {
+    const std::vector<uint64_t> &key = profile.first;
+    for (unsigned position = 0; position < profile.second.size(); ++position)
+      positions[{key[1] << 32 | key[2 + 2 * position], key[3 + 2 * position]}].push_back({&profile, position});
+  }
+
+  // The abbreviation a profile ends up with: [table, abbreviation, attribute index, value, ...]
+  // holding only the chosen values, so the plain abbreviation is [table, abbreviation]
+  auto getAbbrev = [](const Profile &profile, int extraPosition) {
+    std::vector<uint64_t> abbrev = {profile.first[0], profile.first[1]};
+    for (unsigned position = 0; position < profile.second.size(); ++position) {
+      if (profile.second[position] || int(position) == extraPosition) {
+        abbrev.push_back(profile.first[2 + 2 * position]);
+        abbrev.push_back(profile.first[3 + 2 * position]);
+      }
+    }
+    return abbrev;
+  };
+  auto getDeclSize = [&](const std::vector<uint64_t> &abbrev) {
+    unsigned size = declSizes[abbrev[1]];
+    for (size_t i = 3; i < abbrev.size(); i += 2)
+      size += getSLEB128Size(int64_t(abbrev[i]));
+    return size;
+  };
+  // Resulting abbreviations -> profiles using them, and the size of each table
+  std::map<std::vector<uint64_t>, uint64_t> abbrevs;
+  std::vector<unsigned> tableSizes(numTables);
+  for (const Profile &profile : profiles)
+    if (abbrevs[getAbbrev(profile, -1)]++ == 0)
+      ++tableSizes[profile.first[0]];
+
+  // Try the candidates in order, each against the abbreviations the ones
+  // chosen so far produce. A DIE that gains a value moves to the abbreviation
+  // of its new combination, which may be new, and may leave its old one unused.
+  chosen.clear();
+  abbrevGrowth = 0;
+  for (const std::pair<int64_t, Key> &candidate : candidates) {
+    std::vector<std::pair<Profile *, unsigned>> &moved = positions[candidate.second];
+    std::map<std::vector<uint64_t>, int64_t> changes;
+    for (const std::pair<Profile *, unsigned> &position : moved) {
+      --changes[getAbbrev(*position.first, -1)];
+      ++changes[getAbbrev(*position.first, position.second)];
+    }
+    int64_t declBytes = 0;
+    std::vector<int> tableChanges(numTables);
+    for (const auto &change : changes) {
+      auto it = abbrevs.find(change.first);
+      uint64_t before = it == abbrevs.end() ? 0 : it->second;
+      uint64_t after = before + change.second;
+      if (!before && after) {
+        declBytes += getDeclSize(change.first);
+        ++tableChanges[change.first[0]];
+      } else if (before && !after) {
+        declBytes -= getDeclSize(change.first);
+        --tableChanges[change.first[0]];
+      }
+    }
+    bool fits = true;
+    for (unsigned table = 0; table < numTables; ++table)
+      if (tableChanges[table] > 0 && tableSizes[table] + tableChanges[table] > maxAbbrevs)
+        fits = false;
+    if (!fits || int64_t(merged[candidate.second].bytes) <= declBytes)
+      continue;
+
+    for (const auto &change : changes) {
+      uint64_t &uses = abbrevs[change.first];
+      uses += change.second;
+      if (!uses)
+        abbrevs.erase(change.first);
+    }
+    for (unsigned table = 0; table < numTables; ++table)
+      tableSizes[table] += tableChanges[table];
+    for (const std::pair<Profile *, unsigned> &position : moved)
+      position.first->second[position.second] = true;
+    chosen.insert(candidate.second);
+    abbrevGrowth += declBytes;
+  }
+  numSplitAbbrevs = 0;
+  for (const auto &abbrev : abbrevs)
+    numSplitAbbrevs += abbrev.first.size() > 2;
+}
+
+void ImplicitConstPlanner::apply(UnitState &state, DIE &die) {
+  uint64_t global = state.globalShapes[die.getAbbrevNumber()];
+  uint64_t index = 0;
+  for (DIEValue &V : die.values()) {
+    if (unsigned size = getConstantSize(V)) {
+      uint64_t value = V.getDIEInteger().getValue();
+      if (chosen.count({global << 32 | index, value})) {
+        V = DIEValue(V.getAttribute(), dwarf::DW_FORM_implicit_const, DIEInteger(value));
+        ++state.numValues;
+        state.savedBytes += size;
+      }
+    }
+    ++index;
+  }
+  for (DIE &child : die.children())
+    apply(state, child);
+}
+
+void ImplicitConstPlanner::applyUnit(unsigned unit, ArrayRef<DIE *> unitDies) {
+  if (chosen.empty())
+    return;
+  for (DIE *die : unitDies)
+    apply(*units[unit], *die);
+}
+
+uint64_t ImplicitConstPlanner::getNumValues() const {
+  uint64_t numValues = 0;
+  for (const std::unique_ptr<UnitState> &state : units)
+    numValues += state->numValues;
+  return numValues;
+}
+
+uint64_t ImplicitConstPlanner::getSavedBytes() const {
+  uint64_t savedBytes = 0;
+  for (const std::unique_ptr<UnitState> &state : units)
+    savedBytes += state->savedBytes;
+  return savedBytes;
+}
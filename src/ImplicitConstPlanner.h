@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/CodeGen/DIE.h"
+#include "llvm/Support/Allocator.h"
+
+// Moves attribute values that recur across an abbreviation class into
+// .debug_abbrev as DWARF 5 DW_FORM_implicit_const
+// - A class is every DIE with the same abbreviation (tag, children, attributes
+//   and forms); a candidate is one constant attribute of a class and one value
+// - DIEs holding a chosen value get a split-off abbreviation with the value
+//   baked in, so the value no longer takes any .debug_info bytes
+// - A DIE holding several chosen values gets one abbreviation for that
+//   combination; plan() counts the abbreviations that actually result
+// - A value is only chosen when the bytes it saves exceed the declarations it
+//   adds to the abbreviation tables, and only while every table keeps one-byte
+//   abbreviation codes
+// - countUnit() and applyUnit() of different units may run concurrently;
+//   plan() runs in between, on one thread, and its choice does not depend on
+//   the thread count
+class ImplicitConstPlanner {
+  // Per candidate: DIEs with the value, .debug_info bytes of the value, units it occurs in
+  struct Uses {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    uint32_t units = 0;
+  };
+  // (abbreviation << 32 | attribute index, value)
+  using Key = std::pair<uint64_t, uint64_t>;
+
+  struct UnitState {
+    llvm::BumpPtrAllocator allocator;
+    llvm::DIEAbbrevSet abbrevSet{allocator};
+    // First DIE of each unit-local abbreviation number
+    std::vector<llvm::DIE *> shapes;
+    llvm::DenseMap<Key, Uses> uses;
+    // Constant values of each DIE: [abbreviation, attribute index, value, ...]
+    std::set<std::vector<uint64_t>> profiles;
+    // Unit-local abbreviation number -> plan-wide one
+    std::vector<uint32_t> globalShapes;
+    uint64_t numValues = 0;
+    uint64_t savedBytes = 0;
+  };
+  std::vector<std::unique_ptr<UnitState>> units;
+  llvm::DenseSet<Key> chosen;
+  unsigned numSplitAbbrevs = 0;
+  int64_t abbrevGrowth = 0;
+
+  void count(UnitState &state, llvm::DIE &die);
+  void apply(UnitState &state, llvm::DIE &die);
+
+public:
+  explicit ImplicitConstPlanner(unsigned numUnits);
+
+  // Count the constant values of unitDies and every DIE below them
+  void countUnit(unsigned unit, llvm::ArrayRef<llvm::DIE *> unitDies);
+  // Choose the values to move. With sharedAbbrevTable, all units use one
+  // table, so a split-off abbreviation is only paid for once.
+  void plan(bool sharedAbbrevTable, unsigned maxAbbrevs = 127);
+  // Rewrite the chosen values of unitDies (the DIEs given to countUnit) as implicit constants
+  void applyUnit(unsigned unit, llvm::ArrayRef<llvm::DIE *> unitDies);
+
+  // Abbreviations holding implicit constants, counted once per table
+  unsigned getNumSplitAbbrevs() const {
+    return numSplitAbbrevs;
+  }
+  // .debug_abbrev bytes the split-off declarations add
+  int64_t getAbbrevGrowth() const {
+    return abbrevGrowth;
+  }
+  // Attribute values rewritten, and the .debug_info bytes they took
+  uint64_t getNumValues() const;
+  uint64_t getSavedBytes() const;
+};
@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/ByteEncoding.h"
+#include "src/IncrementalUnitLayout.h"
+
+using namespace llvm;
+
+IncrementalUnitLayout::IncrementalUnitLayout(LayoutTable &table, const dwarf::FormParams &formParams)
+    : table(table), plan(table, 1, /*dedupTypes=*/false), formParams(formParams), writer(formParams) {
+  assert(formParams.Format == dwarf::DWARF32 && "offsets and unit_length are patched as 32-bit values");
+}
+
+// The type whose DIE starts at offset
+uint32_t IncrementalUnitLayout::getTypeAt(uint32_t offset) const {
+  auto it = std::lower_bound(segments.begin(), segments.end(), offset,
+                             [&](uint32_t type, uint32_t offset) { return typeOffsets[type] < offset; });
+  assert(it != segments.end() && typeOffsets[*it] == offset && "DW_AT_type does not point at a type DIE");
+  return *it;
+}
+
+void IncrementalUnitLayout::collectRefs(const DIE &die, uint32_t typeOffset, SmallVectorImpl<TypeRef> &refs) const {
+  uint32_t position = die.getOffset() + getULEB128Size(die.getAbbrevNumber());
+  for (const DIEValue &V : die.values()) {
+    if (V.getForm() == dwarf::DW_FORM_ref4) {
+      uint32_t target = V.getType() == DIEValue::isEntry ? V.getDIEEntry().getEntry().getOffset() : V.getDIEInteger().getValue();
+      refs.push_back({position - typeOffset, getTypeAt(target), 0});
+    }
+    position += V.sizeOf(formParams);
+  }
+  for (const DIE &child : die.children())
+    collectRefs(child, typeOffset, refs);
+}
+
+Error IncrementalUnitLayout::checkTargets(uint32_t index) const {
+  const LayoutType &type = table.types[index];
+  auto check = [&](uint32_t target) -> Error {
+    if (target == index || (target < segmentOf.size() && segmentOf[target] != NoSegment))
+      return Error::success();
+    return createStringError(inconvertibleErrorCode(), "type #%u refers to type #%u, which is not in the unit", index, target);
+  };
+  if (type.kind == LayoutTypeKind::Pointer)
+    return check(type.pointee);
+  for (const LayoutMember &member : type.members) {
+    if (Error err = check(member.type))
+      return err;
+  }
+  return Error::success();
+}
+
+// DIEs for one type at its current offset, serialized. References to other
+// types are plain ref4 values from typeOffsets.
+Error IncrementalUnitLayout::emitType(uint32_t index, SmallVectorImpl<uint8_t> &bytes, SmallVectorImpl<TypeRef> &refs) {
+  LayoutDIEBuilder builder(scratch, stringPool, plan);
+  DIE &die = *builder.buildTypeChunk(index, index + 1, typeOffsets)[0];
+  die.computeOffsetsAndAbbrevs(formParams, abbrevSet, typeOffsets[index]);
+  Error err = writer.emitSubtree(bytes, die);
+  if (!err)
+    collectRefs(die, typeOffsets[index], refs);
+  scratch.Reset();
+  return err;
+}
+
+void IncrementalUnitLayout::setRefs(uint32_t index, ArrayRef<TypeRef> refs) {
+  for (const TypeRef &ref : outgoing[index]) {
+    SmallVectorImpl<IncomingRef> &targetRefs = incoming[ref.target];
+    IncomingRef moved = targetRefs.pop_back_val();
+    if (ref.slot < targetRefs.size()) {
+      targetRefs[ref.slot] = moved;
+      outgoing[moved.source][moved.index].slot = ref.slot;
+    }
+  }
+  outgoing[index].assign(refs.begin(), refs.end());
+  for (uint32_t i = 0; i < refs.size(); ++i) {
+    SmallVectorImpl<IncomingRef> &targetRefs = incoming[refs[i].target];
+    outgoing[index][i].slot = targetRefs.size();
+    targetRefs.push_back({index, i});
+  }
+}
+
+// Splice bytes over the current bytes of the type, then move everything behind it
+void IncrementalUnitLayout::replaceBytes(uint32_t index, ArrayRef<uint8_t> bytes) {
+  uint32_t start = typeOffsets[index];
+  uint32_t oldSize = typeSizes[index];
+  uint32_t newSize = bytes.size();
+  size_t tail = info.size() - (start + oldSize);
+  if (newSize > oldSize)
+    info.resize(info.size() + (newSize - oldSize));
+  std::memmove(info.data() + start + newSize, info.data() + start + oldSize, tail);
+  if (newSize < oldSize)
+    info.resize(info.size() - (oldSize - newSize));
+  std::memcpy(info.data() + start, bytes.data(), newSize);
+  typeSizes[index] = newSize;
+  patchInt(info, 0, info.size() - 4, 4);
+  if (newSize == oldSize)
+    return;
+
+  // Offsets first, so every patched reference sees the final positions of both ends
+  int64_t delta = int64_t(newSize) - int64_t(oldSize);
+  for (uint32_t segment = segmentOf[index] + 1; segment < segments.size(); ++segment)
+    typeOffsets[segments[segment]] += delta;
+  for (uint32_t segment = segmentOf[index] + 1; segment < segments.size(); ++segment) {
+    uint32_t target = segments[segment];
+    for (const IncomingRef &ref : incoming[target])
+      patchInt(info, typeOffsets[ref.source] + outgoing[ref.source][ref.index].position, typeOffsets[target], 4);
+  }
+}
+
+// New abbreviations go behind the existing ones, in front of the table terminator
+void IncrementalUnitLayout::appendNewAbbrevs() {
+  SmallVector<uint8_t, 64> decls;
+  for (unsigned number = numAbbrevs + 1; number <= writer.getNumAbbrevDecls(); ++number) {
+    ArrayRef<uint8_t> decl = writer.getAbbrevDecl(number);
+    decls.append(decl.begin(), decl.end());
+  }
+  abbrev.insert(abbrev.end() - 1, decls.begin(), decls.end());
+  numAbbrevs = writer.getNumAbbrevDecls();
+}
+
+Error IncrementalUnitLayout::build() {
+  uint32_t numTypes = table.types.size();
+  segments.clear();
+  segmentOf.assign(numTypes, NoSegment);
+  typeOffsets.assign(numTypes, 0);
+  typeSizes.assign(numTypes, 0);
+  outgoing.assign(numTypes, {});
+  incoming.assign(numTypes, {});
+
+  LayoutDIEBuilder builder(scratch, stringPool, plan);
+  DIE *unitDie = builder.createUnitDIE();
+  unitDie->setForceChildren(true);
+  uint32_t offset = unitDie->computeOffsetsAndAbbrevs(formParams, abbrevSet, getCompileUnitHeaderSize(formParams)) - 1;
+  std::vector<DIE *> dies = builder.buildTypeChunk(0, numTypes, typeOffsets);
+  for (uint32_t i = 0; i < numTypes; ++i) {
+    typeOffsets[i] = offset;
+    segmentOf[i] = segments.size();
+    segments.push_back(i);
+    offset = dies[i]->computeOffsetsAndAbbrevs(formParams, abbrevSet, offset);
+    typeSizes[i] = offset - typeOffsets[i];
+  }
+
+  SmallString<0> unitBytes;
+  raw_svector_ostream infoOS(unitBytes);
+  if (Error err = writer.beginCompileUnit(*unitDie, offset + 1))
+    return err;
+  for (DIE *die : dies) {
+    if (Error err = writer.emitChildDIE(*die))
+      return err;
+  }
+  writer.endCompileUnit();
+  writer.drainInfo(infoOS);
+  info.assign(unitBytes.begin(), unitBytes.end());
+
+  for (uint32_t i = 0; i < numTypes; ++i) {
+    SmallVector<TypeRef, 4> refs;
+    collectRefs(*dies[i], typeOffsets[i], refs);
+    setRefs(i, refs);
+  }
+  scratch.Reset();
+
+  abbrev.assign(1, 0);
+  numAbbrevs = 0;
+  appendNewAbbrevs();
+  return Error::success();
+}
+
+Error IncrementalUnitLayout::updateType(uint32_t index) {
+  if (index >= segmentOf.size() || segmentOf[index] == NoSegment)
+    return createStringError(inconvertibleErrorCode(), "type #%u is not in the unit", index);
+  if (Error err = checkTargets(index))
+    return err;
+  SmallVector<uint8_t, 256> bytes;
+  SmallVector<TypeRef, 4> refs;
+  if (Error err = emitType(index, bytes, refs))
+    return err;
+  setRefs(index, refs);
+  replaceBytes(index, bytes);
+  appendNewAbbrevs();
+  return Error::success();
+}
+
+Error IncrementalUnitLayout::addType(uint32_t index) {
+  if (index >= table.types.size() || (index < segmentOf.size() && segmentOf[index] != NoSegment))
+    return createStringError(inconvertibleErrorCode(), "type #%u is not a new type", index);
+  uint32_t numTypes = table.types.size();
+  segmentOf.resize(numTypes, NoSegment);
+  typeOffsets.resize(numTypes, 0);
+  typeSizes.resize(numTypes, 0);
+  outgoing.resize(numTypes);
+  incoming.resize(numTypes);
+  if (Error err = checkTargets(index))
+    return err;
+
+  // An empty segment in front of the unit's terminating null entry, then filled like an update
+  typeOffsets[index] = info.size() - 1;
+  segmentOf[index] = segments.size();
+  segments.push_back(index);
+  SmallVector<uint8_t, 256> bytes;
+  SmallVector<TypeRef, 4> refs;
+  if (Error err = emitType(index, bytes, refs)) {
+    segments.pop_back();
+    segmentOf[index] = NoSegment;
+    return err;
+  }
+  setRefs(index, refs);
+  replaceBytes(index, bytes);
+  appendNewAbbrevs();
+  return Error::success();
+}
+
+Error IncrementalUnitLayout::removeType(uint32_t index) {
+  if (index >= segmentOf.size() || segmentOf[index] == NoSegment)
+    return createStringError(inconvertibleErrorCode(), "type #%u is not in the unit", index);
+  for (const IncomingRef &ref : incoming[index]) {
+    if (ref.source != index)
+      return createStringError(inconvertibleErrorCode(), "type #%u is still referenced by type #%u", index, ref.source);
+  }
+
+  setRefs(index, {});
+  replaceBytes(index, {});
+  uint32_t segment = segmentOf[index];
+  segments.erase(segments.begin() + segment);
+  for (uint32_t i = segment; i < segments.size(); ++i)
+    segmentOf[segments[i]] = i;
+  segmentOf[index] = NoSegment;
+  return Error::success();
+}
+
+DwarfSectionsRef IncrementalUnitLayout::getSections() const {
+  DwarfSectionsRef sections;
+  sections.info = info;
+  sections.abbrev = abbrev;
+  sections.str = stringPool.getData();
+  return sections;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/CodeGen/DIE.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Error.h"
+
+#include "src/DwarfSectionWriter.h"
+#include "src/LayoutDIEBuilder.h"
+#include "src/LayoutTable.h"
+#include "src/SimpleStringPool.h"
+
+// One compile unit kept laid out and serialized across single-type edits
+// - Every top-level type DIE is a segment of .debug_info. Instead of a DIE
+//   tree, the unit keeps the bytes, the offset and size of each type and the
+//   position and target of every DW_AT_type reference.
+// - An edit builds DIEs for the edited type only, splices its bytes into
+//   .debug_info, shifts the offsets of the types after it and rewrites just
+//   the references that point into the shifted range
+// - New strings and abbreviations are appended to .debug_str and
+//   .debug_abbrev. The sections stay valid but are not byte-identical to a
+//   full rebuild; strings an edit stops using are kept.
+// - One DIE per type in table order: no deduplication, no type units
+// - Only LLVMDwarf_IncrementalBench drives it so far; the --serve protocol has
+//   no edit requests yet
+class IncrementalUnitLayout {
+  LayoutTable &table;
+  LayoutUnitPlan plan;
+  llvm::dwarf::FormParams formParams;
+  // DIEs of the build or edit in progress
+  llvm::BumpPtrAllocator scratch;
+  llvm::BumpPtrAllocator abbrevAllocator;
+  llvm::DIEAbbrevSet abbrevSet{abbrevAllocator};
+  SimpleStringPool stringPool;
+  DwarfSectionWriter writer;
+  llvm::SmallVector<uint8_t, 0> info;
+  llvm::SmallVector<uint8_t, 0> abbrev;
+  unsigned numAbbrevs = 0;
+
+  struct TypeRef {
+    // Offset of the DW_FORM_ref4 value from the start of the source type
+    uint32_t position;
+    uint32_t target;
+    // Slot of this reference in incoming[target]
+    uint32_t slot;
+  };
+  // A reference into a type: the source type and its index in outgoing[source].
+  // Unordered, so base types referenced by every struct drop entries in O(1).
+  struct IncomingRef {
+    uint32_t source;
+    uint32_t index;
+  };
+
+  // Types in unit order
+  std::vector<uint32_t> segments;
+  // Indexed by type
+  std::vector<uint32_t> segmentOf;
+  std::vector<uint32_t> typeOffsets;
+  std::vector<uint32_t> typeSizes;
+  std::vector<llvm::SmallVector<TypeRef, 4>> outgoing;
+  std::vector<llvm::SmallVector<IncomingRef, 4>> incoming;
+
+  uint32_t getTypeAt(uint32_t offset) const;
+  void collectRefs(const llvm::DIE &die, uint32_t typeOffset, llvm::SmallVectorImpl<TypeRef> &refs) const;
+  llvm::Error checkTargets(uint32_t index) const;
+  llvm::Error emitType(uint32_t index, llvm::SmallVectorImpl<uint8_t> &bytes, llvm::SmallVectorImpl<TypeRef> &refs);
+  void setRefs(uint32_t index, llvm::ArrayRef<TypeRef> refs);
+  void replaceBytes(uint32_t index, llvm::ArrayRef<uint8_t> bytes);
+  void appendNewAbbrevs();
+
+public:
+  static constexpr uint32_t NoSegment = UINT32_MAX;
+
+  IncrementalUnitLayout(LayoutTable &table, const llvm::dwarf::FormParams &formParams);
+
+  // Full layout of the table, the baseline for the edits
+  llvm::Error build();
+
+  // table.types[index] was changed in place
+  llvm::Error updateType(uint32_t index);
+  // table.types[index] is new (appended to the table); it goes to the end of the unit
+  llvm::Error addType(uint32_t index);
+  // Drop the DIE of table.types[index], which nothing may reference any more
+  llvm::Error removeType(uint32_t index);
+
+  DwarfSectionsRef getSections() const;
+  // Type indices in the order of their DIEs
+  llvm::ArrayRef<uint32_t> getUnitOrder() const {
+    return segments;
+  }
+  size_t getNumTypeDIEs() const {
+    return segments.size();
+  }
+};
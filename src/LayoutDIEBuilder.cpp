@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+
+#include "src/DwarfFormSelection.h"
+#include "src/LayoutDIEBuilder.h"
+
+using namespace llvm;
+
+static dwarf::Tag getTypeTag(LayoutTypeKind kind) {
+  switch (kind) {
+  case LayoutTypeKind::Base:
+    return dwarf::DW_TAG_base_type;
+  case LayoutTypeKind::Pointer:
+    return dwarf::DW_TAG_pointer_type;
+  case LayoutTypeKind::Struct:
+    return dwarf::DW_TAG_structure_type;
+  case LayoutTypeKind::Class:
+    return dwarf::DW_TAG_class_type;
+  }
+  llvm_unreachable("unknown layout type kind");
+}
+
+LayoutUnitPlan::LayoutUnitPlan(const LayoutTable &table, unsigned numUnits, bool dedupTypes, bool typeUnits)
+    : table(table), typeUnits(typeUnits), typeDies(table.types.size()) {
+  uint32_t numTypes = table.types.size();
+  numUnits = std::max(1u, std::min<unsigned>(numUnits, numTypes));
+  unitDies.resize(numUnits);
+  if (dedupTypes)
+    interner.emplace(table);
+
+  if (typeUnits) {
+    signatures.emplace(table);
+    ownsTypeUnit.resize(numTypes);
+    DenseSet<uint64_t> seen;
+    for (uint32_t i = 0; i < numTypes; ++i) {
+      if (getCanonical(i) == i && table.types[i].isAggregate())
+        ownsTypeUnit[i] = seen.insert(signatures->get(i)).second;
+    }
+  }
+
+  // Cut the table where the running DIE count crosses each multiple of total / numUnits
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < numTypes; ++i) {
+    if (getCanonical(i) == i)
+      total += 1 + table.types[i].members.size();
+  }
+  unitBegin.push_back(0);
+  uint64_t count = 0;
+  for (uint32_t i = 0; i < numTypes; ++i) {
+    while (unitBegin.size() < numUnits && count * numUnits >= total * unitBegin.size())
+      unitBegin.push_back(i);
+    if (getCanonical(i) == i)
+      count += 1 + table.types[i].members.size();
+  }
+  while (unitBegin.size() <= numUnits)
+    unitBegin.push_back(numTypes);
+}
+
+unsigned LayoutUnitPlan::getUnitOf(uint32_t index) const {
+  return std::upper_bound(unitBegin.begin() + 1, unitBegin.end(), index) - unitBegin.begin() - 1;
+}
+
+// Per type unit state: the local copies of base and pointer types it needs
+struct LayoutDIEBuilder::TypeUnitContext {
+  DIE &unitDie;
+  DenseMap<uint32_t, DIE *> localTypes;
+};
+
+void LayoutDIEBuilder::addTypeAttributes(DIE &typeDie, const LayoutType &type, TypeRefFn addTypeRef) {
+  if (!type.name.empty())
+    typeDie.addValue(allocator, dwarf::DW_AT_name, dwarf::DW_FORM_strp, DIEInteger(stringPool.add(type.name)));
+  switch (type.kind) {
+  case LayoutTypeKind::Base:
+    typeDie.addValue(allocator, dwarf::DW_AT_encoding, getConstantForm(type.encoding), DIEInteger(type.encoding));
+    typeDie.addValue(allocator, dwarf::DW_AT_byte_size, getConstantForm(type.byteSize), DIEInteger(type.byteSize));
+    break;
+  case LayoutTypeKind::Pointer:
+    typeDie.addValue(allocator, dwarf::DW_AT_byte_size, getConstantForm(type.byteSize), DIEInteger(type.byteSize));
+    addTypeRef(typeDie, type.pointee);
+    break;
+  case LayoutTypeKind::Struct:
+  case LayoutTypeKind::Class:
+    typeDie.addValue(allocator, dwarf::DW_AT_byte_size, getConstantForm(type.byteSize), DIEInteger(type.byteSize));
+    for (const LayoutMember &member : type.members) {
+      DIE *memberDie = DIE::get(allocator, dwarf::DW_TAG_member);
+      memberDie->addValue(allocator, dwarf::DW_AT_name, dwarf::DW_FORM_strp, DIEInteger(stringPool.add(member.name)));
+      addTypeRef(*memberDie, member.type);
+      memberDie->addValue(allocator, dwarf::DW_AT_data_member_location, getConstantForm(member.offset),
+                          DIEInteger(member.offset));
+      typeDie.addChild(memberDie);
+    }
+    break;
+  }
+}
+
+void LayoutDIEBuilder::addCompileUnitRef(DIE &die, uint32_t index) {
+  if (plan.typeUnits && plan.table.types[index].isAggregate()) {
+    die.addValue(allocator, dwarf::DW_AT_type, dwarf::DW_FORM_ref_sig8, DIEInteger(plan.signatures->get(index)));
+    return;
+  }
+  uint32_t target = plan.getCanonical(index);
+  dwarf::Form form = plan.getUnitOf(target) == unit ? dwarf::DW_FORM_ref4 : dwarf::DW_FORM_ref_addr;
+  die.addValue(allocator, dwarf::DW_AT_type, form, DIEEntry(*plan.typeDies[target]));
+}
+
+// Pointer chains can be arbitrarily long, so they are copied one type per
+// iteration rather than recursively
+void LayoutDIEBuilder::addTypeUnitRef(TypeUnitContext &ctx, DIE &die, uint32_t index) {
+  DIE *refDie = &die;
+  while (refDie) {
+    index = plan.getCanonical(index);
+    const LayoutType &type = plan.table.types[index];
+    if (type.isAggregate()) {
+      refDie->addValue(allocator, dwarf::DW_AT_type, dwarf::DW_FORM_ref_sig8, DIEInteger(plan.signatures->get(index)));
+      return;
+    }
+
+    DIE *local = ctx.localTypes.lookup(index);
+    DIE *next = nullptr;
+    if (!local) {
+      local = DIE::get(allocator, getTypeTag(type.kind));
+      ++numTypeDIEs;
+      ctx.localTypes[index] = local;
+      ctx.unitDie.addChild(local);
+      // Only a pointer refers on, as its last attribute; the next iteration adds it
+      addTypeAttributes(*local, type, [&](DIE &pointerDie, uint32_t pointee) {
+        next = &pointerDie;
+        index = pointee;
+      });
+    }
+    refDie->addValue(allocator, dwarf::DW_AT_type, dwarf::DW_FORM_ref4, DIEEntry(*local));
+    refDie = next;
+  }
+}
+
+DIE *LayoutDIEBuilder::createUnitDIE() {
+  DIE *cu = DIE::get(allocator, dwarf::DW_TAG_compile_unit);
+  cu->addValue(allocator, dwarf::DW_AT_producer, dwarf::DW_FORM_strp, DIEInteger(stringPool.add(plan.table.producer)));
+  cu->addValue(allocator, dwarf::DW_AT_language, dwarf::DW_FORM_data2, DIEInteger(dwarf::DW_LANG_C_plus_plus));
+  return cu;
+}
+
+void LayoutDIEBuilder::createDIEs() {
+  const LayoutTable &table = plan.table;
+  DIE *cu = createUnitDIE();
+  plan.unitDies[unit] = cu;
+
+  // Duplicates get no DIE of their own; references go to their canonical type
+  numTypeDIEs = 0;
+  units.clear();
+  for (uint32_t i = plan.unitBegin[unit]; i < plan.unitBegin[unit + 1]; ++i) {
+    if (plan.getCanonical(i) != i)
+      continue;
+    plan.typeDies[i] = DIE::get(allocator, getTypeTag(table.types[i].kind));
+    cu->addChild(plan.typeDies[i]);
+    ++numTypeDIEs;
+  }
+}
+
+DIE *LayoutDIEBuilder::buildCompileUnit() {
+  const LayoutTable &table = plan.table;
+  auto addRef = [&](DIE &die, uint32_t ref) { addCompileUnitRef(die, ref); };
+  for (uint32_t i = plan.unitBegin[unit]; i < plan.unitBegin[unit + 1]; ++i) {
+    if (plan.getCanonical(i) != i)
+      continue;
+    const LayoutType &type = table.types[i];
+    DIE *typeDie = plan.typeDies[i];
+    if (!plan.typeUnits || !type.isAggregate()) {
+      addTypeAttributes(*typeDie, type, addRef);
+      continue;
+    }
+
+    // Type unit mode: aggregates are declared in the CU and defined in their type unit
+    uint64_t signature = plan.signatures->get(i);
+    typeDie->addValue(allocator, dwarf::DW_AT_declaration, dwarf::DW_FORM_flag_present, DIEInteger(1));
+    typeDie->addValue(allocator, dwarf::DW_AT_signature, dwarf::DW_FORM_ref_sig8, DIEInteger(signature));
+    if (!plan.ownsTypeUnit[i])
+      continue;
+
+    DIE *unitDie = DIE::get(allocator, dwarf::DW_TAG_type_unit);
+    unitDie->addValue(allocator, dwarf::DW_AT_language, dwarf::DW_FORM_data2, DIEInteger(dwarf::DW_LANG_C_plus_plus));
+    DIE *definition = DIE::get(allocator, getTypeTag(type.kind));
+    ++numTypeDIEs;
+    unitDie->addChild(definition);
+    TypeUnitContext ctx{*unitDie, DenseMap<uint32_t, DIE *>()};
+    addTypeAttributes(*definition, type, [&](DIE &die, uint32_t ref) { addTypeUnitRef(ctx, die, ref); });
+    units.push_back({signature, unitDie, definition});
+  }
+  return plan.unitDies[unit];
+}
+
+std::vector<DIE *> LayoutDIEBuilder::buildTypeChunk(uint32_t begin, uint32_t end, ArrayRef<uint32_t> typeOffsets) {
+  assert(plan.getNumUnits() == 1 && !plan.typeUnits && "streaming needs a single unit without type units");
+  const LayoutTable &table = plan.table;
+  std::vector<DIE *> chunkDies(end - begin);
+  for (uint32_t i = begin; i < end; ++i) {
+    if (plan.getCanonical(i) != i)
+      continue;
+    chunkDies[i - begin] = DIE::get(allocator, getTypeTag(table.types[i].kind));
+    ++numTypeDIEs;
+  }
+
+  for (uint32_t i = begin; i < end; ++i) {
+    if (!chunkDies[i - begin])
+      continue;
+    addTypeAttributes(*chunkDies[i - begin], table.types[i], [&](DIE &die, uint32_t ref) {
+      uint32_t target = plan.getCanonical(ref);
+      if (target >= begin && target < end)
+        die.addValue(allocator, dwarf::DW_AT_type, dwarf::DW_FORM_ref4, DIEEntry(*chunkDies[target - begin]));
+      else
+        die.addValue(allocator, dwarf::DW_AT_type, dwarf::DW_FORM_ref4, DIEInteger(typeOffsets[target]));
+    });
+  }
+  return chunkDies;
+}
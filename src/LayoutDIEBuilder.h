@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/CodeGen/DIE.h"
+#include "llvm/Support/Allocator.h"
+
+#include "src/LayoutTable.h"
+#include "src/LayoutTypeInterner.h"
+#include "src/LayoutTypeSignatures.h"
+#include "src/SimpleStringPool.h"
+
+// A DW_TAG_type_unit holding one aggregate type
+struct LayoutTypeUnit {
+  uint64_t signature;
+  llvm::DIE *unitDie;
+  // The aggregate itself; its offset is the header's type_offset
+  llvm::DIE *typeDie;
+};
+
+// How a LayoutTable is split into compile units, plus the analysis all units share
+// - Units are contiguous ranges of the table, balanced by DIE count (one per type and member)
+// - The split only depends on the unit count, so the DWARF does not depend on how
+//   many threads build it
+// - Read-only once constructed, except for the DIE slots each unit fills in for itself
+class LayoutUnitPlan {
+  friend class LayoutDIEBuilder;
+
+  const LayoutTable &table;
+  bool typeUnits;
+  std::optional<LayoutTypeInterner> interner;
+  std::optional<LayoutTypeSignatures> signatures;
+  // Set on the first canonical aggregate of every signature, which emits its type unit
+  std::vector<bool> ownsTypeUnit;
+  // getNumUnits() + 1 boundaries into table.types
+  std::vector<uint32_t> unitBegin;
+  // Indexed by canonical type / unit; written by LayoutDIEBuilder::createDIEs()
+  std::vector<llvm::DIE *> typeDies;
+  std::vector<llvm::DIE *> unitDies;
+
+  uint32_t getCanonical(uint32_t index) const {
+    return interner ? interner->getCanonical(index) : index;
+  }
+  unsigned getUnitOf(uint32_t index) const;
+
+public:
+  LayoutUnitPlan(const LayoutTable &table, unsigned numUnits, bool dedupTypes = true, bool typeUnits = false);
+
+  const LayoutTable &getTable() const {
+    return table;
+  }
+  unsigned getNumUnits() const {
+    return unitBegin.size() - 1;
+  }
+};
+
+// Builds the compile unit DIE for one unit of a LayoutUnitPlan
+// - Every type DIE is created up front, so DW_AT_type references may point forward;
+//   references into another unit of the plan use DW_FORM_ref_addr
+// - Attribute forms match the hand-written MyClass example (strp names, ref4 types), except
+//   that sizes, offsets and encodings take the narrowest form that holds them (data1 for
+//   the example); see getConstantForm()
+// - With dedupTypes, structurally identical types share one DIE (see LayoutTypeInterner)
+// - With typeUnits, every struct/class moves into its own type unit keyed by a
+//   structural signature; the compile unit keeps a declaration stub and every
+//   reference to the aggregate becomes DW_FORM_ref_sig8. Base and pointer types
+//   a type unit needs are copied into it, as LLVM does.
+// - Builders of different units may run concurrently as long as each has its own
+//   allocator and string pool
+class LayoutDIEBuilder {
+  llvm::BumpPtrAllocator &allocator;
+  SimpleStringPool &stringPool;
+  LayoutUnitPlan &plan;
+  unsigned unit;
+  size_t numTypeDIEs = 0;
+  std::vector<LayoutTypeUnit> units;
+
+  struct TypeUnitContext;
+  using TypeRefFn = llvm::function_ref<void(llvm::DIE &, uint32_t)>;
+  void addTypeAttributes(llvm::DIE &die, const LayoutType &type, TypeRefFn addTypeRef);
+  void addCompileUnitRef(llvm::DIE &die, uint32_t index);
+  void addTypeUnitRef(TypeUnitContext &ctx, llvm::DIE &die, uint32_t index);
+
+public:
+  LayoutDIEBuilder(llvm::BumpPtrAllocator &allocator, SimpleStringPool &stringPool, LayoutUnitPlan &plan, unsigned unit = 0)
+      : allocator(allocator), stringPool(stringPool), plan(plan), unit(unit) {
+  }
+
+  // A compile unit DIE with the unit attributes and no children
+  llvm::DIE *createUnitDIE();
+  // First pass: the compile unit DIE and the (still empty) type DIEs of this unit
+  void createDIEs();
+  // Second pass: attributes, members and type units. createDIEs() must have
+  // finished for every unit of the plan, since references may cross units.
+  llvm::DIE *buildCompileUnit();
+
+  // Streaming: the DIEs of the types in [begin, end) of a one-unit plan without
+  // type units, not attached to any unit. References leaving the range are
+  // DW_FORM_ref4 integers taken from typeOffsets (0 while unknown), so the chunk
+  // can be laid out, emitted and released on its own. Indexed by type - begin;
+  // nullptr for types that share the DIE of an earlier type.
+  std::vector<llvm::DIE *> buildTypeChunk(uint32_t begin, uint32_t end, llvm::ArrayRef<uint32_t> typeOffsets);
+
+  // Number of type DIEs created for this unit, type units included
+  size_t getNumTypeDIEs() const {
+    return numTypeDIEs;
+  }
+  // Type units created by buildCompileUnit(), one per distinct signature
+  const std::vector<LayoutTypeUnit> &getTypeUnits() const {
+    return units;
+  }
+};
@@ -0,0 +1,421 @@
+#include <cctype>
+#include <cstdlib>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/Support/ConvertUTF.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include "src/LayoutTable.h"
+
+using namespace llvm;
+
+namespace {
+
+// Single-pass pull parser for the layout JSON format
+// - Fills LayoutTable directly without materializing a json::Value DOM, which
+//   for large tables costs two orders of magnitude more memory than the input
+// - Unknown keys are skipped, so the format can grow without breaking readers
+class LayoutJSONReader {
+  StringRef input;
+  size_t pos = 0;
+  LayoutTable &table;
+  SmallString<64> scratch;
+
+  Error error(const Twine &message) {
+    return createStringError(inconvertibleErrorCode(), "offset %zu: %s", pos, message.str().c_str());
+  }
+
+  void skipWhitespace() {
+    while (pos < input.size() && (input[pos] == ' ' || input[pos] == '\n' || input[pos] == '\r' || input[pos] == '\t'))
+      ++pos;
+  }
+
+  bool consume(char c) {
+    skipWhitespace();
+    if (pos < input.size() && input[pos] == c) {
+      ++pos;
+      return true;
+    }
+    return false;
+  }
+
+  Error expect(char c) {
+    if (consume(c))
+      return Error::success();
+    return error(Twine("expected '") + Twine(c) + "'");
+  }
+
+  Error parseHex4(unsigned &value) {
+    if (pos + 4 > input.size())
+      return error("truncated \\u escape");
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+      char c = input[pos++];
+      value <<= 4;
+      if (c >= '0' && c <= '9')
+        value |= c - '0';
+      else if (c >= 'a' && c <= 'f')
+        value |= c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F')
+        value |= c - 'A' + 10;
+      else
+        return error("invalid \\u escape");
+    }
+    return Error::success();
+  }
+
+  // The result points into the input when the string has no escapes, else into scratch.
+  Error parseString(StringRef &out) {
+    if (!consume('"'))
+      return error("expected string");
+    size_t start = pos;
+    while (pos < input.size() && input[pos] != '"' && input[pos] != '\\')
+      ++pos;
+    if (pos < input.size() && input[pos] == '"') {
+      out = input.slice(start, pos++);
+      return Error::success();
+    }
+
+    scratch.assign(input.begin() + start, input.begin() + pos);
+    while (pos < input.size() && input[pos] != '"') {
+      char c = input[pos++];
+      if (c != '\\') {
+        scratch.push_back(c);
+        continue;
+      }
+      if (pos >= input.size())
+        break;
+      switch (char e = input[pos++]) {
+      case 'b':
+        scratch.push_back('\b');
+        break;
+      case 'f':
+        scratch.push_back('\f');
+        break;
+      case 'n':
+        scratch.push_back('\n');
+        break;
+      case 'r':
+        scratch.push_back('\r');
+        break;
+      case 't':
+        scratch.push_back('\t');
+        break;
+      case 'u': {
+        unsigned codePoint;
+        if (Error err = parseHex4(codePoint))
+          return err;
+        // .debug_str entries end at the first NUL
+        if (codePoint == 0)
+          return error("\\u0000 in a string");
+        if (codePoint >= 0xd800 && codePoint < 0xdc00) {
+          if (pos + 1 >= input.size() || input[pos] != '\\' || input[pos + 1] != 'u')
+            return error("unpaired surrogate in \\u escape");
+          pos += 2;
+          unsigned low;
+          if (Error err = parseHex4(low))
+            return err;
+          if (low < 0xdc00 || low > 0xdfff)
+            return error("unpaired surrogate in \\u escape");
+          codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+        } else if (codePoint >= 0xdc00 && codePoint <= 0xdfff) {
+          return error("unpaired surrogate in \\u escape");
+        }
+        char utf8[UNI_MAX_UTF8_BYTES_PER_CODE_POINT];
+        char *end = utf8;
+        if (!ConvertCodePointToUTF8(codePoint, end))
+          return error("invalid code point in \\u escape");
+        scratch.append(utf8, end);
+        break;
+      }
+      default:
+        scratch.push_back(e);
+        break;
+      }
+    }
+    if (!consume('"'))
+      return error("unterminated string");
+    out = scratch;
+    return Error::success();
+  }
+
+  Error parseInteger(int64_t &out) {
+    skipWhitespace();
+    size_t start = pos;
+    if (pos < input.size() && input[pos] == '-')
+      ++pos;
+    while (pos < input.size() && isdigit(static_cast<unsigned char>(input[pos])))
+      ++pos;
+    if (input.slice(start, pos).getAsInteger(10, out))
+      return error("expected integer");
+    return Error::success();
+  }
+
+  Error parseUnsigned(uint64_t &out, const char *what) {
+    int64_t value;
+    if (Error err = parseInteger(value))
+      return err;
+    if (value < 0)
+      return error(Twine(what) + " must not be negative");
+    out = value;
+    return Error::success();
+  }
+
+  // Type indices are stored in 32 bits; larger ones are rejected rather than truncated
+  Error parseTypeIndex(uint32_t &out, const char *what) {
+    uint64_t value;
+    if (Error err = parseUnsigned(value, what))
+      return err;
+    if (value > UINT32_MAX)
+      return error(Twine(what) + " index out of range");
+    out = value;
+    return Error::success();
+  }
+
+  // Parses "{ key: value, ... }", calling onKey with the cursor on each value
+  template <typename Fn> Error parseObject(Fn onKey) {
+    if (Error err = expect('{'))
+      return err;
+    if (consume('}'))
+      return Error::success();
+    do {
+      StringRef key;
+      if (Error err = parseString(key))
+        return err;
+      // Keys are only compared, but the scratch buffer is reused while parsing the value
+      SmallString<32> keyCopy(key);
+      if (Error err = expect(':'))
+        return err;
+      if (Error err = onKey(StringRef(keyCopy)))
+        return err;
+    } while (consume(','));
+    return expect('}');
+  }
+
+  template <typename Fn> Error parseArray(Fn onElement) {
+    if (Error err = expect('['))
+      return err;
+    if (consume(']'))
+      return Error::success();
+    do {
+      if (Error err = onElement())
+        return err;
+    } while (consume(','));
+    return expect(']');
+  }
+
+  Error skipValue() {
+    skipWhitespace();
+    if (pos >= input.size())
+      return error("unexpected end of input");
+    char c = input[pos];
+    if (c == '{')
+      return parseObject([this](StringRef) { return skipValue(); });
+    if (c == '[')
+      return parseArray([this] { return skipValue(); });
+    if (c == '"') {
+      StringRef ignored;
+      return parseString(ignored);
+    }
+    // Numbers and literals
+    size_t start = pos;
+    while (pos < input.size() && (isalnum(static_cast<unsigned char>(input[pos])) || StringRef("+-.").contains(input[pos])))
+      ++pos;
+    if (start == pos)
+      return error("unexpected character");
+    return Error::success();
+  }
+
+  Error parseMember(LayoutType &type) {
+    LayoutMember member{"", 0, ~0ull};
+    bool hasType = false;
+    if (Error err = parseObject([&](StringRef key) -> Error {
+          if (key == "name") {
+            StringRef name;
+            if (Error err = parseString(name))
+              return err;
+            member.name = table.save(name);
+            return Error::success();
+          }
+          if (key == "type") {
+            hasType = true;
+            return parseTypeIndex(member.type, "member type");
+          }
+          if (key == "offset")
+            return parseUnsigned(member.offset, "member offset");
+          return skipValue();
+        }))
+      return err;
+    if (!hasType || member.offset == ~0ull)
+      return error("member needs \"type\" and \"offset\"");
+    type.members.push_back(member);
+    return Error::success();
+  }
+
+  Error parseType() {
+    LayoutType type;
+    SmallString<16> kind;
+    bool hasSize = false, hasPointee = false;
+    SmallString<32> encoding;
+    if (Error err = parseObject([&](StringRef key) -> Error {
+          if (key == "kind") {
+            StringRef value;
+            if (Error err = parseString(value))
+              return err;
+            kind = value;
+            return Error::success();
+          }
+          if (key == "name") {
+            StringRef name;
+            if (Error err = parseString(name))
+              return err;
+            type.name = table.save(name);
+            return Error::success();
+          }
+          if (key == "size") {
+            hasSize = true;
+            return parseUnsigned(type.byteSize, "size");
+          }
+          if (key == "encoding") {
+            StringRef value;
+            if (Error err = parseString(value))
+              return err;
+            encoding = value;
+            return Error::success();
+          }
+          if (key == "type") {
+            hasPointee = true;
+            return parseTypeIndex(type.pointee, "pointer type");
+          }
+          if (key == "members")
+            return parseArray([&] { return parseMember(type); });
+          return skipValue();
+        }))
+      return err;
+
+    size_t index = table.types.size();
+    auto typeError = [index](const Twine &message) {
+      return createStringError(inconvertibleErrorCode(), "type #%zu: %s", index, message.str().c_str());
+    };
+    if (kind == "base")
+      type.kind = LayoutTypeKind::Base;
+    else if (kind == "pointer")
+      type.kind = LayoutTypeKind::Pointer;
+    else if (kind == "struct")
+      type.kind = LayoutTypeKind::Struct;
+    else if (kind == "class")
+      type.kind = LayoutTypeKind::Class;
+    else
+      return typeError("unknown kind '" + kind + "'");
+    if (!hasSize)
+      return typeError("missing \"size\"");
+    if (type.kind == LayoutTypeKind::Base) {
+      type.encoding = dwarf::getAttributeEncoding(encoding);
+      if (!type.encoding)
+        return typeError("unknown encoding '" + encoding + "'");
+    }
+    if (type.kind == LayoutTypeKind::Pointer && !hasPointee)
+      return typeError("pointer has no \"type\"");
+    table.types.push_back(std::move(type));
+    return Error::success();
+  }
+
+public:
+  LayoutJSONReader(StringRef input, LayoutTable &table) : input(input), table(table) {
+  }
+
+  Error read() {
+    table.types.clear();
+    if (Error err = parseObject([&](StringRef key) -> Error {
+          if (key == "producer") {
+            StringRef producer;
+            if (Error err = parseString(producer))
+              return err;
+            table.producer = table.save(producer);
+            return Error::success();
+          }
+          if (key == "types")
+            return parseArray([&] { return parseType(); });
+          return skipValue();
+        }))
+      return err;
+    skipWhitespace();
+    if (pos != input.size())
+      return error("trailing characters after layout object");
+
+    return validateLayoutTable(table);
+  }
+};
+
+} // namespace
+
+size_t LayoutTable::getNumMembers() const {
+  size_t count = 0;
+  for (const LayoutType &type : types)
+    count += type.members.size();
+  return count;
+}
+
+void makeSampleLayout(LayoutTable &table) {
+  table.producer = "warpo";
+  table.types.clear();
+
+  table.types.push_back({LayoutTypeKind::Base, "int", 4, dwarf::DW_ATE_signed, 0, {}});
+  table.types.push_back({LayoutTypeKind::Base, "char", 1, dwarf::DW_ATE_signed_char, 0, {}});
+  table.types.push_back({LayoutTypeKind::Pointer, "", 8, 0, 1, {}});
+  table.types.push_back({LayoutTypeKind::Struct, "MyClass", 24, 0, 0, {{"x", 0, 0}, {"y", 0, 4}, {"name", 2, 8}}});
+}
+
+void makeClassSampleLayout(LayoutTable &table) {
+  table.producer = "warpo";
+  table.types.clear();
+
+  table.types.push_back({LayoutTypeKind::Class, "MyClass", 16, 0, 0, {{"x", 1, 0, 4}, {"y", 1, 4, 4}, {"name", 3, 8, 8}}, 8});
+  table.types.push_back({LayoutTypeKind::Base, "int", 4, dwarf::DW_ATE_signed, 0, {}});
+  table.types.push_back({LayoutTypeKind::Base, "char", 1, dwarf::DW_ATE_signed_char, 0, {}});
+  table.types.push_back({LayoutTypeKind::Pointer, "", 8, 0, 2, {}});
+}
+
+Error validateLayoutTable(const LayoutTable &table) {
+  // References may point forward, so they can only be checked once every type is known
+  size_t numTypes = table.types.size();
+  for (size_t i = 0; i < numTypes; ++i) {
+    const LayoutType &type = table.types[i];
+    bool valid = type.kind != LayoutTypeKind::Pointer || type.pointee < numTypes;
+    for (const LayoutMember &member : type.members)
+      valid &= member.type < numTypes;
+    if (!valid)
+      return createStringError(inconvertibleErrorCode(), "type #%zu: reference to an unknown type index", i);
+  }
+
+  // A chain of pointers must end in a non-pointer type
+  enum : uint8_t { Unvisited, OnPath, Done };
+  std::vector<uint8_t> state(numTypes, Unvisited);
+  SmallVector<uint32_t, 8> path;
+  for (uint32_t i = 0; i < numTypes; ++i) {
+    uint32_t j = i;
+    while (table.types[j].kind == LayoutTypeKind::Pointer && state[j] == Unvisited) {
+      state[j] = OnPath;
+      path.push_back(j);
+      j = table.types[j].pointee;
+    }
+    if (state[j] == OnPath)
+      return createStringError(inconvertibleErrorCode(), "type #%u: pointer cycle without an aggregate", j);
+    for (uint32_t k : path)
+      state[k] = Done;
+    path.clear();
+  }
+  return Error::success();
+}
+
+Error parseLayoutJSON(StringRef json, LayoutTable &table) {
+  return LayoutJSONReader(json, table).read();
+}
+
+Error readLayoutFile(StringRef path, LayoutTable &table) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> bufferOrErr = MemoryBuffer::getFile(path);
+  if (!bufferOrErr)
+    return createStringError(bufferOrErr.getError(), "cannot read %s: %s", path.str().c_str(), bufferOrErr.getError().message().c_str());
+  return parseLayoutJSON((*bufferOrErr)->getBuffer(), table);
+}
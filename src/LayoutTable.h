@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/StringSaver.h"
+
+// Batch description of the class layouts a module needs DWARF for.
+//
+// JSON input format (type references are indices into "types", forward
+// references are allowed):
+//
+//   {
+//     "producer": "warpo",
+//     "types": [
+//       {"kind": "base", "name": "int", "size": 4, "encoding": "DW_ATE_signed"},
+//       {"kind": "pointer", "size": 8, "type": 0},
+//       {"kind": "struct", "name": "MyClass", "size": 16,
+//        "members": [{"name": "x", "type": 0, "offset": 0}]}
+//     ]
+//   }
+//
+// "kind" is one of base, pointer, struct or class. Sizes and offsets are in bytes.
+
+enum class LayoutTypeKind : uint8_t { Base, Pointer, Struct, Class };
+
+struct LayoutMember {
+  llvm::StringRef name;
+  uint32_t type;
+  uint64_t offset;
+  // DW_AT_alignment in bytes, 0 for none; see LayoutType::alignment
+  uint32_t alignment = 0;
+};
+
+struct LayoutType {
+  LayoutTypeKind kind;
+  llvm::StringRef name;
+  uint64_t byteSize = 0;
+  // DW_ATE_* for base types
+  unsigned encoding = 0;
+  // Pointee index for pointer types
+  uint32_t pointee = 0;
+  std::vector<LayoutMember> members;
+  // DW_AT_alignment in bytes, 0 for none. Only the DIBuilder path emits it and
+  // the JSON format has no field for it; makeClassSampleLayout() sets it.
+  uint32_t alignment = 0;
+
+  bool isAggregate() const {
+    return kind == LayoutTypeKind::Struct || kind == LayoutTypeKind::Class;
+  }
+};
+
+struct LayoutTable {
+  // Owns every name referenced by the table
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringRef producer = "warpo";
+  std::vector<LayoutType> types;
+
+  llvm::StringRef save(llvm::StringRef str) {
+    return llvm::StringSaver(allocator).save(str);
+  }
+  size_t getNumMembers() const;
+};
+
+// The built-in MyClass example (x:int, y:int, name:char*) of LLVMDwarf_Simple:
+// a 24-byte DW_TAG_structure_type
+void makeSampleLayout(LayoutTable &table);
+
+// The built-in MyClass example of LLVMDwarf: a 16-byte DW_TAG_class_type, listed
+// before the types it uses so the DIBuilder emits them in the original order
+void makeClassSampleLayout(LayoutTable &table);
+
+// Checks what the type fields alone cannot: every type index is in range and
+// every pointer chain ends in a non-pointer type. parseLayoutJSON() runs it;
+// tables filled by hand should too before being built.
+llvm::Error validateLayoutTable(const LayoutTable &table);
+
+llvm::Error parseLayoutJSON(llvm::StringRef json, LayoutTable &table);
+llvm::Error readLayoutFile(llvm::StringRef path, LayoutTable &table);
@@ -0,0 +1,186 @@
+#include <unordered_map>
+#include <utility>
+
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include "src/LayoutTypeInterner.h"
+
+using namespace llvm;
+
+namespace {
+
+// Calls fn(ref) for every type index that type `index` refers to, in order
+template <typename Fn> void forEachReference(const LayoutType &type, Fn fn) {
+  if (type.kind == LayoutTypeKind::Pointer)
+    fn(type.pointee);
+  for (const LayoutMember &member : type.members)
+    fn(member.type);
+}
+
+// Numbers equivalence classes densely in table order: classOf[i] is the class of
+// the first earlier type that compares equal to i, or a fresh id
+template <typename HashFn, typename EqualFn> size_t assignClasses(size_t numTypes, HashFn hash, EqualFn equal, std::vector<uint32_t> &classOf) {
+  std::unordered_map<uint64_t, SmallVector<uint32_t, 1>> buckets;
+  buckets.reserve(numTypes);
+  uint32_t numClasses = 0;
+  for (uint32_t i = 0; i < numTypes; ++i) {
+    SmallVectorImpl<uint32_t> &candidates = buckets[hash(i)];
+    bool found = false;
+    for (uint32_t rep : candidates) {
+      if (equal(rep, i)) {
+        classOf[i] = classOf[rep];
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      candidates.push_back(i);
+      classOf[i] = numClasses++;
+    }
+  }
+  return numClasses;
+}
+
+} // namespace
+
+LayoutTypeInterner::LayoutTypeInterner(const LayoutTable &table) {
+  const std::vector<LayoutType> &types = table.types;
+  size_t numTypes = types.size();
+  std::vector<uint32_t> classOf(numTypes);
+
+  // Start from the local shape: everything except the identity of referenced types
+  auto localHash = [&](uint32_t i) -> uint64_t {
+    const LayoutType &type = types[i];
+    hash_code hash = hash_combine(type.kind, type.name, type.byteSize, type.encoding, type.members.size());
+    for (const LayoutMember &member : type.members)
+      hash = hash_combine(hash, member.name, member.offset);
+    return hash;
+  };
+  auto sameLocal = [&](uint32_t a, uint32_t b) {
+    const LayoutType &x = types[a], &y = types[b];
+    if (x.kind != y.kind || x.name != y.name || x.byteSize != y.byteSize || x.encoding != y.encoding || x.members.size() != y.members.size())
+      return false;
+    for (size_t m = 0; m < x.members.size(); ++m) {
+      if (x.members[m].name != y.members[m].name || x.members[m].offset != y.members[m].offset)
+        return false;
+    }
+    return true;
+  };
+  size_t numClasses = assignClasses(numTypes, localHash, sameLocal, classOf);
+
+  // Reverse references: the (user, position) pairs that refer to each type
+  std::vector<uint32_t> usersBegin(numTypes + 1, 0);
+  for (const LayoutType &type : types)
+    forEachReference(type, [&](uint32_t ref) { ++usersBegin[ref + 1]; });
+  for (size_t i = 0; i < numTypes; ++i)
+    usersBegin[i + 1] += usersBegin[i];
+  std::vector<std::pair<uint32_t, uint32_t>> users(usersBegin[numTypes]);
+  {
+    std::vector<uint32_t> fill(usersBegin.begin(), usersBegin.end() - 1);
+    for (uint32_t i = 0; i < numTypes; ++i) {
+      uint32_t position = 0;
+      forEachReference(types[i], [&](uint32_t ref) { users[fill[ref]++] = {position++, i}; });
+    }
+  }
+
+  // Every class is a contiguous range of `order`; marked types of a class are
+  // moved to the front of its range
+  std::vector<uint32_t> order(numTypes), slot(numTypes);
+  std::vector<uint32_t> classBegin(numClasses + 1, 0), classEnd, numMarked(numClasses, 0);
+  for (uint32_t i = 0; i < numTypes; ++i)
+    ++classBegin[classOf[i] + 1];
+  for (size_t c = 0; c < numClasses; ++c)
+    classBegin[c + 1] += classBegin[c];
+  classEnd.assign(classBegin.begin() + 1, classBegin.end());
+  classBegin.pop_back();
+  {
+    std::vector<uint32_t> fill(classBegin);
+    for (uint32_t i = 0; i < numTypes; ++i) {
+      slot[i] = fill[classOf[i]]++;
+      order[slot[i]] = i;
+    }
+  }
+
+  // Hopcroft-style refinement: a class on the worklist splits every class whose
+  // members refer to it at some position from only some of them. Types have one
+  // reference per position, so once a class was processed, only the smaller half
+  // of a later split of it needs processing, and only the users of a class that
+  // split are looked at again.
+  std::vector<uint32_t> worklist(numClasses);
+  std::vector<bool> onWorklist(numClasses, true);
+  for (uint32_t c = 0; c < numClasses; ++c)
+    worklist[c] = numClasses - 1 - c;
+  std::vector<std::pair<uint32_t, uint32_t>> incoming;
+  std::vector<uint32_t> touched;
+  while (!worklist.empty()) {
+    uint32_t splitter = worklist.back();
+    worklist.pop_back();
+    onWorklist[splitter] = false;
+
+    // Snapshot the users first: the splitter itself may split below
+    incoming.clear();
+    for (uint32_t s = classBegin[splitter]; s < classEnd[splitter]; ++s) {
+      uint32_t type = order[s];
+      incoming.insert(incoming.end(), users.begin() + usersBegin[type], users.begin() + usersBegin[type + 1]);
+    }
+    llvm::sort(incoming);
+
+    for (size_t groupBegin = 0; groupBegin < incoming.size();) {
+      size_t groupEnd = groupBegin;
+      while (groupEnd < incoming.size() && incoming[groupEnd].first == incoming[groupBegin].first)
+        ++groupEnd;
+
+      // Mark the users referring to the splitter at this position
+      touched.clear();
+      for (size_t e = groupBegin; e < groupEnd; ++e) {
+        uint32_t user = incoming[e].second;
+        uint32_t c = classOf[user];
+        if (numMarked[c] == 0)
+          touched.push_back(c);
+        uint32_t target = classBegin[c] + numMarked[c]++;
+        uint32_t other = order[target];
+        std::swap(order[slot[user]], order[target]);
+        slot[other] = slot[user];
+        slot[user] = target;
+      }
+
+      // Split the marked types off every class that has unmarked ones too
+      for (uint32_t c : touched) {
+        uint32_t split = classBegin[c] + numMarked[c];
+        numMarked[c] = 0;
+        if (split == classEnd[c])
+          continue;
+        uint32_t fresh = numClasses++;
+        classBegin.push_back(classBegin[c]);
+        classEnd.push_back(split);
+        numMarked.push_back(0);
+        classBegin[c] = split;
+        for (uint32_t s = classBegin[fresh]; s < split; ++s)
+          classOf[order[s]] = fresh;
+        uint32_t smaller = classEnd[fresh] - classBegin[fresh] <= classEnd[c] - classBegin[c] ? fresh : c;
+        onWorklist.push_back(false);
+        if (onWorklist[c]) {
+          worklist.push_back(fresh);
+          onWorklist[fresh] = true;
+        } else {
+          worklist.push_back(smaller);
+          onWorklist[smaller] = true;
+        }
+      }
+      groupBegin = groupEnd;
+    }
+  }
+
+  // The first type of each class is its representative
+  std::vector<uint32_t> representative(numClasses, ~0u);
+  canonical.resize(numTypes);
+  for (uint32_t i = 0; i < numTypes; ++i) {
+    uint32_t &rep = representative[classOf[i]];
+    if (rep == ~0u)
+      rep = i;
+    canonical[i] = rep;
+  }
+  numUnique = numClasses;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "src/LayoutTable.h"
+
+// Structural type deduplication (hash-consing) for layout tables
+// - Two types are merged when tag, name, size, encoding and member list match
+//   and every referenced type is itself merged, so identical `int`, `char *`
+//   and struct shapes collapse onto a single DIE
+// - Uses partition refinement, which also merges recursive types (a struct
+//   holding a pointer to itself) that naive bottom-up hashing cannot handle
+// - Refinement is worklist driven (Hopcroft): only the types referring to a
+//   class that just split are looked at again, so long reference chains take
+//   O(references * log types) instead of one whole-table pass per split
+// - The canonical representative of a class is its first type in table order,
+//   so the output does not depend on hash values
+class LayoutTypeInterner {
+  std::vector<uint32_t> canonical;
+  size_t numUnique = 0;
+
+public:
+  explicit LayoutTypeInterner(const LayoutTable &table);
+
+  uint32_t getCanonical(uint32_t index) const {
+    return canonical[index];
+  }
+  bool isCanonical(uint32_t index) const {
+    return canonical[index] == index;
+  }
+  size_t getNumUnique() const {
+    return numUnique;
+  }
+};
@@ -0,0 +1,134 @@
+#include <utility>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+
+#include "src/ByteEncoding.h"
+#include "src/LayoutTypeSignatures.h"
+
+using namespace llvm;
+
+static void hashInt(MD5 &hash, uint64_t value) {
+  uint8_t bytes[8];
+  writeLE(bytes, value, 8);
+  hash.update(ArrayRef<uint8_t>(bytes));
+}
+
+static void hashString(MD5 &hash, StringRef str) {
+  hash.update(str);
+  hash.update(ArrayRef<uint8_t>(uint8_t(0)));
+}
+
+static void hashTag(MD5 &hash, char tag) {
+  hash.update(ArrayRef<uint8_t>(static_cast<uint8_t>(tag)));
+}
+
+LayoutTypeSignatures::LayoutTypeSignatures(const LayoutTable &table)
+    : table(table), signatures(table.types.size()), inProgress(table.types.size()) {
+  for (uint32_t i = 0; i < table.types.size(); ++i) {
+    if (table.types[i].isAggregate())
+      compute(i);
+  }
+}
+
+// Named aggregates behind a pointer are referenced by name only, which breaks cycles
+static bool isReferencedByName(const LayoutType &pointee) {
+  return pointee.isAggregate() && !pointee.name.empty();
+}
+
+// The aggregate whose signature hashTypeRef(index) hashes, if any: index itself
+// or the end of its pointer chain, unless a named aggregate ends it
+uint32_t LayoutTypeSignatures::getReferencedAggregate(uint32_t index) const {
+  while (table.types[index].kind == LayoutTypeKind::Pointer) {
+    uint32_t pointee = table.types[index].pointee;
+    if (isReferencedByName(table.types[pointee]))
+      return ~0u;
+    index = pointee;
+  }
+  return table.types[index].isAggregate() ? index : ~0u;
+}
+
+// Follows pointer chains in a loop; validateLayoutTable() guarantees they end
+void LayoutTypeSignatures::hashTypeRef(MD5 &hash, uint32_t index) const {
+  for (;;) {
+    const LayoutType &type = table.types[index];
+    switch (type.kind) {
+    case LayoutTypeKind::Base:
+      hashTag(hash, 'B');
+      hashString(hash, type.name);
+      hashInt(hash, type.byteSize);
+      hashInt(hash, type.encoding);
+      return;
+    case LayoutTypeKind::Pointer: {
+      hashTag(hash, 'P');
+      hashString(hash, type.name);
+      hashInt(hash, type.byteSize);
+      const LayoutType &pointee = table.types[type.pointee];
+      if (isReferencedByName(pointee)) {
+        hashTag(hash, 'N');
+        hashTag(hash, pointee.kind == LayoutTypeKind::Class ? 'C' : 'S');
+        hashString(hash, pointee.name);
+        return;
+      }
+      index = type.pointee;
+      break;
+    }
+    case LayoutTypeKind::Struct:
+    case LayoutTypeKind::Class:
+      // Still 0 for an anonymous aggregate that (indirectly) contains itself
+      hashTag(hash, 'R');
+      hashInt(hash, signatures[index]);
+      return;
+    }
+  }
+}
+
+// Every aggregate a member refers to is hashed before the aggregate itself,
+// except the ones still in progress further up the worklist
+void LayoutTypeSignatures::compute(uint32_t root) {
+  if (signatures[root])
+    return;
+  // Aggregate and the next member to look at
+  SmallVector<std::pair<uint32_t, uint32_t>, 16> worklist;
+  worklist.push_back({root, 0});
+  inProgress[root] = true;
+  while (!worklist.empty()) {
+    auto &[index, nextMember] = worklist.back();
+    const std::vector<LayoutMember> &members = table.types[index].members;
+    uint32_t next = ~0u;
+    while (nextMember < members.size() && next == ~0u) {
+      uint32_t ref = getReferencedAggregate(members[nextMember++].type);
+      if (ref != ~0u && !signatures[ref] && !inProgress[ref])
+        next = ref;
+    }
+    if (next != ~0u) {
+      inProgress[next] = true;
+      worklist.push_back({next, 0});
+      continue;
+    }
+    hashAggregate(index);
+    inProgress[index] = false;
+    worklist.pop_back();
+  }
+}
+
+void LayoutTypeSignatures::hashAggregate(uint32_t index) {
+  const LayoutType &type = table.types[index];
+  MD5 hash;
+  hashTag(hash, 'T');
+  hashInt(hash, type.kind == LayoutTypeKind::Class ? dwarf::DW_TAG_class_type : dwarf::DW_TAG_structure_type);
+  hashString(hash, type.name);
+  hashInt(hash, type.byteSize);
+  hashInt(hash, type.members.size());
+  for (const LayoutMember &member : type.members) {
+    hashString(hash, member.name);
+    hashInt(hash, member.offset);
+    hashTypeRef(hash, member.type);
+  }
+
+  MD5::MD5Result result;
+  hash.final(result);
+  // 0 marks "not computed", so keep it out of the signature space
+  signatures[index] = result.low() ? result.low() : 1;
+}
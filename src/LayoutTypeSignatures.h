@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "llvm/Support/MD5.h"
+
+#include "src/LayoutTable.h"
+
+// 64-bit type signatures of aggregate layout types, for DW_FORM_ref_sig8
+// - Low 64 bits of an MD5 over the structural description, like LLVM's DIEHash,
+//   so the same layout gets the same signature in every module
+// - An aggregate reached through a pointer contributes only its tag and name,
+//   which keeps recursive types finite; a by-value aggregate member contributes
+//   its own signature
+// - Computed in post-order with an explicit worklist, so nesting depth is not
+//   bounded by the stack
+class LayoutTypeSignatures {
+  const LayoutTable &table;
+  // 0 for non-aggregates
+  std::vector<uint64_t> signatures;
+  std::vector<bool> inProgress;
+
+  uint32_t getReferencedAggregate(uint32_t index) const;
+  void compute(uint32_t index);
+  void hashAggregate(uint32_t index);
+  void hashTypeRef(llvm::MD5 &hash, uint32_t index) const;
+
+public:
+  explicit LayoutTypeSignatures(const LayoutTable &table);
+
+  uint64_t get(uint32_t index) const {
+    return signatures[index];
+  }
+};
@@ -0,0 +1,74 @@
+#include <mutex>
+#include <optional>
+
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/TargetParser/Host.h"
+
+#include "src/ObjectDwarfGenerator.h"
+#include "src/PhaseTiming.h"
+
+using namespace llvm;
+
+static void initializeTargetsOnce(bool allTargets) {
+  static std::once_flag nativeOnce;
+  static std::once_flag allOnce;
+  if (allTargets) {
+    std::call_once(allOnce, [] {
+      InitializeAllTargetInfos();
+      InitializeAllTargets();
+      InitializeAllTargetMCs();
+      InitializeAllAsmPrinters();
+    });
+  } else {
+    std::call_once(nativeOnce, [] {
+      InitializeNativeTarget();
+      InitializeNativeTargetAsmPrinter();
+    });
+  }
+}
+
+ObjectDwarfGenerator::ObjectDwarfGenerator(std::string triple, std::unique_ptr<TargetMachine> targetMachine)
+    : triple(std::move(triple)), targetMachine(std::move(targetMachine)), dataLayout(this->targetMachine->createDataLayout()) {
+}
+
+Expected<std::unique_ptr<ObjectDwarfGenerator>> ObjectDwarfGenerator::create(StringRef triple, bool allTargets) {
+  initializeTargetsOnce(allTargets);
+
+  std::string targetTriple = triple.empty() ? sys::getProcessTriple() : triple.str();
+  std::string error;
+  const Target *target = TargetRegistry::lookupTarget(targetTriple, error);
+  if (!target) {
+    return createStringError(inconvertibleErrorCode(), "%s", error.c_str());
+  }
+
+  TargetOptions opt;
+  auto RM = std::optional<Reloc::Model>();
+  std::unique_ptr<TargetMachine> targetMachine(target->createTargetMachine(targetTriple, "generic", "", opt, RM));
+  if (!targetMachine) {
+    return createStringError(inconvertibleErrorCode(), "Could not create TargetMachine for %s", targetTriple.c_str());
+  }
+
+  return std::unique_ptr<ObjectDwarfGenerator>(new ObjectDwarfGenerator(std::move(targetTriple), std::move(targetMachine)));
+}
+
+Error ObjectDwarfGenerator::emitObject(Module &module, SmallVectorImpl<char> &objBuffer) {
+  module.setTargetTriple(triple);
+  module.setDataLayout(dataLayout);
+
+  // Emit to in-memory buffer instead of file
+  raw_svector_ostream objStream(objBuffer);
+
+  // The pass pipeline binds the output stream, so it is rebuilt per module
+  legacy::PassManager pass;
+  if (targetMachine->addPassesToEmitFile(pass, objStream, nullptr, CodeGenFileType::ObjectFile)) {
+    return createStringError(inconvertibleErrorCode(), "TargetMachine can't emit object file");
+  }
+
+  PhaseScope phase("Codegen", module.getModuleIdentifier());
+  pass.run(module);
+  return Error::success();
+}
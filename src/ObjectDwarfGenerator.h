@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Target/TargetMachine.h"
+
+// Long-lived DIBuilder module -> object file generator
+// - Registers targets once per process (only the native one unless asked otherwise)
+// - Owns a single TargetMachine and DataLayout and reuses them for every module,
+//   so per-module cost is just the codegen pass pipeline
+class ObjectDwarfGenerator {
+  std::string triple;
+  std::unique_ptr<llvm::TargetMachine> targetMachine;
+  llvm::DataLayout dataLayout;
+
+  ObjectDwarfGenerator(std::string triple, std::unique_ptr<llvm::TargetMachine> targetMachine);
+
+public:
+  // An empty triple selects the host. Cross triples need allTargets = true.
+  static llvm::Expected<std::unique_ptr<ObjectDwarfGenerator>> create(llvm::StringRef triple = "", bool allTargets = false);
+
+  // Codegen one module into an in-memory object file. Can be called any number of times.
+  llvm::Error emitObject(llvm::Module &module, llvm::SmallVectorImpl<char> &objBuffer);
+
+  llvm::StringRef getTriple() const {
+    return triple;
+  }
+  llvm::TargetMachine &getTargetMachine() const {
+    return *targetMachine;
+  }
+  const llvm::DataLayout &getDataLayout() const {
+    return dataLayout;
+  }
+};
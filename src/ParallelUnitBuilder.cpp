@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <string>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/DJB.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/TimeProfiler.h"
+
+#include "src/DwarfFormSelection.h"
+#include "src/DwarfNameIndex.h"
+#include "src/DwarfSectionWriter.h"
+#include "src/ImplicitConstPlanner.h"
+#include "src/ParallelUnitBuilder.h"
+#include "src/PhaseTiming.h"
+
+using namespace llvm;
+
+#if LLVM_VERSION_MAJOR >= 18
+using UnitThreadPool = DefaultThreadPool;
+#else
+using UnitThreadPool = ThreadPool;
+#endif
+
+// Point every DW_FORM_strp below die at the merged string pool
+static void remapStrings(DIE &die, const DenseMap<uint32_t, uint32_t> &remap) {
+  for (DIEValue &V : die.values()) {
+    if (V.getForm() == dwarf::DW_FORM_strp && V.getType() == DIEValue::isInteger)
+      V = DIEValue(V.getAttribute(), V.getForm(), DIEInteger(remap.lookup(V.getDIEInteger().getValue())));
+  }
+  for (DIE &child : die.children())
+    remapStrings(child, remap);
+}
+
+// Layouts after which reference narrowing only widens, see fitUnitRefForms()
+static constexpr unsigned MaxNarrowingPasses = 8;
+
+// Rewrite the names collected for .debug_names the same way
+static void remapNames(std::vector<DwarfNameEntry> &names, const DenseMap<uint32_t, uint32_t> &remap) {
+  for (DwarfNameEntry &entry : names)
+    entry.strOffset = remap.lookup(entry.strOffset);
+}
+
+// Index entries for the named type DIEs of a laid-out unit, which are all
+// children of the unit DIE. stringPool is the pool the DW_AT_name values
+// currently point into.
+static void collectNames(LayoutCompileUnit &unit, uint32_t unitIndex, const SimpleStringPool &stringPool) {
+  unit.names.clear();
+  for (const DIE &child : unit.unitDie->children()) {
+    for (const DIEValue &V : child.values()) {
+      if (V.getAttribute() != dwarf::DW_AT_name || V.getType() != DIEValue::isInteger)
+        continue;
+      uint32_t value = V.getDIEInteger().getValue();
+      uint32_t strOffset = V.getForm() == dwarf::DW_FORM_strp ? value : stringPool.getOffsetOfIndex(value);
+      unit.names.push_back(
+          {strOffset, caseFoldingDjbHash(stringPool.getStringAt(strOffset)), unitIndex, uint32_t(child.getOffset()), child.getTag()});
+      break;
+    }
+  }
+}
+
+static void countStrings(const DIE &die, DenseMap<uint32_t, uint32_t> &uses) {
+  for (const DIEValue &V : die.values()) {
+    if (V.getForm() == dwarf::DW_FORM_strp && V.getType() == DIEValue::isInteger)
+      ++uses[V.getDIEInteger().getValue()];
+  }
+  for (const DIE &child : die.children())
+    countStrings(child, uses);
+}
+
+// Smallest DW_FORM_strx* that holds index
+static dwarf::Form getStrxForm(uint32_t index) {
+  if (index <= UINT8_MAX)
+    return dwarf::DW_FORM_strx1;
+  if (index <= UINT16_MAX)
+    return dwarf::DW_FORM_strx2;
+  if (index < (1u << 24))
+    return dwarf::DW_FORM_strx3;
+  return dwarf::DW_FORM_strx4;
+}
+
+// Replace every DW_FORM_strp below die by the string's index
+static void indexStrings(DIE &die, const DenseMap<uint32_t, uint32_t> &indices) {
+  for (DIEValue &V : die.values()) {
+    if (V.getForm() == dwarf::DW_FORM_strp && V.getType() == DIEValue::isInteger) {
+      uint32_t index = indices.lookup(V.getDIEInteger().getValue());
+      V = DIEValue(V.getAttribute(), getStrxForm(index), DIEInteger(index));
+    }
+  }
+  for (DIE &child : die.children())
+    indexStrings(child, indices);
+}
+
+// DWARF 5 string indices: the most used strings get the smallest indices and
+// so the one-byte forms. Every unit shares the one .debug_str_offsets contribution.
+static void indexStrings(LayoutCompileUnits &result) {
+  DenseMap<uint32_t, uint32_t> uses;
+  uses.reserve(result.stringPool.getNumStrings());
+  for (const std::unique_ptr<LayoutCompileUnit> &unit : result.units) {
+    countStrings(*unit->unitDie, uses);
+    for (const LayoutTypeUnit &typeUnit : unit->typeUnits)
+      countStrings(*typeUnit.unitDie, uses);
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> byUses;
+  byUses.reserve(uses.size());
+  for (const auto &entry : uses)
+    byUses.push_back({entry.second, entry.first});
+  // Ties broken by offset, so the order does not depend on DenseMap iteration
+  std::sort(byUses.begin(), byUses.end(), [](const std::pair<uint32_t, uint32_t> &a, const std::pair<uint32_t, uint32_t> &b) {
+    return a.first != b.first ? a.first > b.first : a.second < b.second;
+  });
+  std::vector<uint32_t> offsets;
+  DenseMap<uint32_t, uint32_t> indices;
+  offsets.reserve(byUses.size());
+  indices.reserve(byUses.size());
+  for (const std::pair<uint32_t, uint32_t> &entry : byUses) {
+    indices[entry.second] = offsets.size();
+    offsets.push_back(entry.second);
+  }
+  result.stringPool.setIndexedOffsets(std::move(offsets));
+
+  auto addBase = [&](LayoutCompileUnit &unit, DIE &unitDie) {
+    unitDie.addValue(unit.allocator, dwarf::DW_AT_str_offsets_base, dwarf::DW_FORM_sec_offset,
+                     DIEInteger(SimpleStringPool::StrOffsetsHeaderSize));
+  };
+  for (const std::unique_ptr<LayoutCompileUnit> &unit : result.units) {
+    indexStrings(*unit->unitDie, indices);
+    addBase(*unit, *unit->unitDie);
+    for (const LayoutTypeUnit &typeUnit : unit->typeUnits) {
+      indexStrings(*typeUnit.unitDie, indices);
+      addBase(*unit, *typeUnit.unitDie);
+    }
+  }
+}
+
+// Give every DIE below die its unit-local abbreviation and count the uses of
+// each; uses[number] holds the count and the first DIE with that number
+static void countAbbrevs(DIE &die, DIEAbbrevSet &abbrevSet, std::vector<std::pair<uint32_t, DIE *>> &uses) {
+  unsigned number = abbrevSet.uniqueAbbreviation(die).getNumber();
+  if (number >= uses.size())
+    uses.resize(number + 1, {0, nullptr});
+  if (!uses[number].first++)
+    uses[number].second = &die;
+  for (DIE &child : die.children())
+    countAbbrevs(child, abbrevSet, uses);
+}
+
+// Number the abbreviations of all units by total use count, most used first,
+// so the common shapes get one-byte ULEB codes. unitUses comes from
+// countAbbrevs() on each unit; sharedSet is left holding every abbreviation in
+// planned order. Ties keep first-seen order, so the plan is deterministic.
+static unsigned planAbbrevs(ArrayRef<std::vector<std::pair<uint32_t, DIE *>>> unitUses, DIEAbbrevSet &sharedSet) {
+  BumpPtrAllocator allocator;
+  DIEAbbrevSet seen(allocator);
+  std::vector<std::pair<uint64_t, DIE *>> shapes;
+  for (const std::vector<std::pair<uint32_t, DIE *>> &uses : unitUses) {
+    for (const std::pair<uint32_t, DIE *> &use : uses) {
+      if (!use.second)
+        continue;
+      unsigned number = seen.uniqueAbbreviation(*use.second).getNumber();
+      if (number > shapes.size())
+        shapes.push_back({0, use.second});
+      shapes[number - 1].first += use.first;
+    }
+  }
+  std::stable_sort(shapes.begin(), shapes.end(),
+                   [](const std::pair<uint64_t, DIE *> &a, const std::pair<uint64_t, DIE *> &b) { return a.first > b.first; });
+  for (const std::pair<uint64_t, DIE *> &shape : shapes)
+    sharedSet.uniqueAbbreviation(*shape.second);
+  return shapes.size();
+}
+
+std::vector<DIE *> LayoutCompileUnits::getUnitDies() const {
+  std::vector<DIE *> unitDies;
+  for (const std::unique_ptr<LayoutCompileUnit> &unit : units)
+    unitDies.push_back(unit->unitDie);
+  return unitDies;
+}
+
+size_t LayoutCompileUnits::getNumTypeDIEs() const {
+  size_t numTypeDIEs = 0;
+  for (const std::unique_ptr<LayoutCompileUnit> &unit : units)
+    numTypeDIEs += unit->numTypeDIEs;
+  return numTypeDIEs;
+}
+
+LayoutCompileUnits buildCompileUnits(LayoutUnitPlan &plan, const DwarfGeneratorOptions &options) {
+  dwarf::FormParams formParams = options.getFormParams();
+  const LayoutTable &table = plan.getTable();
+  unsigned numUnits = plan.getNumUnits();
+  LayoutCompileUnits result;
+  result.nameIndex = options.nameIndex;
+  result.sharedAbbrevs = options.shareAbbrevs;
+  std::vector<LayoutDIEBuilder> builders;
+  result.units.reserve(numUnits);
+  builders.reserve(numUnits);
+  for (unsigned i = 0; i < numUnits; ++i) {
+    result.units.push_back(std::make_unique<LayoutCompileUnit>());
+    LayoutCompileUnit &unit = *result.units.back();
+    unit.stringPool.reserve((table.types.size() + table.getNumMembers()) / numUnits + 1);
+    builders.emplace_back(unit.allocator, unit.stringPool, plan, i);
+  }
+
+  // Run one pass over every unit and wait for all of them; references may point into any unit
+  std::optional<UnitThreadPool> pool;
+  if (numUnits > 1)
+    pool.emplace(hardware_concurrency(options.jobs));
+  auto runPass = [&](StringRef name, function_ref<void(unsigned)> body) {
+    PhaseScope phase(name);
+    if (!pool) {
+      body(0);
+      return;
+    }
+    for (unsigned i = 0; i < numUnits; ++i) {
+      pool->async([&, i] {
+        PhaseWorkerScope worker;
+        TimeTraceScope trace(name, [&] { return "unit " + std::to_string(i); });
+        body(i);
+      });
+    }
+    pool->wait();
+  };
+
+  runPass("Create DIEs", [&](unsigned i) { builders[i].createDIEs(); });
+  runPass("DIE build", [&](unsigned i) {
+    LayoutCompileUnit &unit = *result.units[i];
+    unit.unitDie = builders[i].buildCompileUnit();
+    unit.typeUnits = builders[i].getTypeUnits();
+    unit.numTypeDIEs = builders[i].getNumTypeDIEs();
+  });
+  // With shared abbreviations, every unit is laid out against one planned set.
+  // All of its abbreviations exist before the layout pass, so the workers only
+  // look them up. Every layout starts from fresh sets, so abbreviations that
+  // narrowed references no longer use do not take up numbers.
+  BumpPtrAllocator sharedAllocator;
+  std::optional<DIEAbbrevSet> sharedSet;
+  auto layoutOnce = [&] {
+    if (options.shareAbbrevs) {
+      std::vector<std::vector<std::pair<uint32_t, DIE *>>> unitUses(numUnits);
+      runPass("Count abbreviations", [&](unsigned i) {
+        LayoutCompileUnit &unit = *result.units[i];
+        DIEAbbrevSet abbrevSet(unit.allocator);
+        countAbbrevs(*unit.unitDie, abbrevSet, unitUses[i]);
+        for (const LayoutTypeUnit &typeUnit : unit.typeUnits)
+          countAbbrevs(*typeUnit.unitDie, abbrevSet, unitUses[i]);
+      });
+      PhaseScope phase("Plan abbreviations");
+      sharedSet.emplace(sharedAllocator);
+      result.numSharedAbbrevs = planAbbrevs(unitUses, *sharedSet);
+    }
+    runPass("computeOffsetsAndAbbrevs", [&](unsigned i) {
+      LayoutCompileUnit &unit = *result.units[i];
+      // Abbreviation numbers are local to the unit, so each unit needs its own set
+      std::optional<DIEAbbrevSet> unitSet;
+      if (!options.shareAbbrevs)
+        unitSet.emplace(unit.allocator);
+      DIEAbbrevSet &abbrevSet = options.shareAbbrevs ? *sharedSet : *unitSet;
+      unit.unitDie->computeOffsetsAndAbbrevs(formParams, abbrevSet, getCompileUnitHeaderSize(formParams));
+      for (const LayoutTypeUnit &typeUnit : unit.typeUnits)
+        typeUnit.unitDie->computeOffsetsAndAbbrevs(formParams, abbrevSet, getTypeUnitHeaderSize(formParams));
+      // The offsets are final now (unless references get narrowed below);
+      // names are hashed while the unit is hot
+      if (options.nameIndex)
+        collectNames(unit, i, options.stringIndices ? result.stringPool : unit.stringPool);
+    });
+  };
+  // References are built as ref4. Narrowing them changes DIE sizes and so the
+  // offsets they hold, hence lay out and refit until nothing changes.
+  auto getAllUnitDies = [&](unsigned i) {
+    SmallVector<DIE *, 1> dies = {result.units[i]->unitDie};
+    for (const LayoutTypeUnit &typeUnit : result.units[i]->typeUnits)
+      dies.push_back(typeUnit.unitDie);
+    return dies;
+  };
+  auto layoutUnits = [&] {
+    // Constants are layout independent, so they are moved once, up front
+    if (options.implicitConsts) {
+      ImplicitConstPlanner planner(numUnits);
+      runPass("Count constants", [&](unsigned i) { planner.countUnit(i, getAllUnitDies(i)); });
+      {
+        PhaseScope phase("Plan implicit constants");
+        planner.plan(options.shareAbbrevs || numUnits == 1);
+      }
+      runPass("Apply implicit constants", [&](unsigned i) { planner.applyUnit(i, getAllUnitDies(i)); });
+      result.numImplicitConstAbbrevs = planner.getNumSplitAbbrevs();
+      result.numImplicitConstValues = planner.getNumValues();
+      result.implicitConstSavedBytes = planner.getSavedBytes();
+      result.implicitConstAbbrevBytes = planner.getAbbrevGrowth();
+    }
+    layoutOnce();
+    ++result.numLayoutPasses;
+    if (!options.narrowRefs)
+      return;
+    std::vector<uint64_t> offsetHashes(numUnits);
+    for (unsigned iteration = 0;; ++iteration) {
+      std::vector<UnitRefFit> fits(numUnits);
+      runPass("Fit reference forms", [&](unsigned i) {
+        LayoutCompileUnit &unit = *result.units[i];
+        bool widenOnly = iteration >= MaxNarrowingPasses;
+        fits[i] = fitUnitRefForms(*unit.unitDie, widenOnly);
+        for (const LayoutTypeUnit &typeUnit : unit.typeUnits) {
+          UnitRefFit fit = fitUnitRefForms(*typeUnit.unitDie, widenOnly);
+          fits[i].numChanged += fit.numChanged;
+          fits[i].offsetHash = fits[i].offsetHash * 31 + fit.offsetHash;
+        }
+      });
+      // The first layout had no ref_udata, so it was exact; later ones are
+      // exact once no DIE moved since the previous one
+      bool changed = false;
+      for (unsigned i = 0; i < numUnits; ++i) {
+        changed |= fits[i].numChanged || (iteration && fits[i].offsetHash != offsetHashes[i]);
+        offsetHashes[i] = fits[i].offsetHash;
+      }
+      if (!changed)
+        return;
+      layoutOnce();
+      ++result.numLayoutPasses;
+    }
+  };
+  // strp is fixed size, so the string merge below keeps the layout valid;
+  // string indices are only known once every string is
+  if (!options.stringIndices)
+    layoutUnits();
+
+  if (numUnits == 1) {
+    result.stringPool = std::move(result.units[0]->stringPool);
+  } else {
+    // Deterministic merge: intern every unit's strings in unit order, then
+    // rewrite the offsets
+    std::optional<PhaseScope> mergePhase(std::in_place, "Merge strings");
+    size_t numStrings = 0;
+    for (const std::unique_ptr<LayoutCompileUnit> &unit : result.units)
+      numStrings += unit->stringPool.getNumStrings();
+    result.stringPool.reserve(numStrings);
+    std::vector<DenseMap<uint32_t, uint32_t>> remaps(numUnits);
+    for (unsigned i = 0; i < numUnits; ++i) {
+      const SimpleStringPool &local = result.units[i]->stringPool;
+      remaps[i].reserve(local.getNumStrings());
+      for (uint32_t offset = 0; offset < local.getSize();) {
+        StringRef str = local.getStringAt(offset);
+        remaps[i][offset] = result.stringPool.add(str);
+        offset += str.size() + 1;
+      }
+    }
+    mergePhase.reset();
+    runPass("Remap strings", [&](unsigned i) {
+      LayoutCompileUnit &unit = *result.units[i];
+      remapStrings(*unit.unitDie, remaps[i]);
+      for (const LayoutTypeUnit &typeUnit : unit.typeUnits)
+        remapStrings(*typeUnit.unitDie, remaps[i]);
+      remapNames(unit.names, remaps[i]);
+      unit.stringPool = SimpleStringPool();
+    });
+  }
+
+  if (options.tailMergeStrings) {
+    std::optional<PhaseScope> tailMergePhase(std::in_place, "Tail-merge strings");
+    auto start = std::chrono::steady_clock::now();
+    uint32_t sizeBefore = result.stringPool.getSize();
+    SimpleStringPool::TailMergeResult merged = result.stringPool.tailMerge();
+    const DenseMap<uint32_t, uint32_t> &remap = merged.remap;
+    result.numTailMergedStrings = merged.numMerged;
+    result.tailMergeSavedBytes = sizeBefore - result.stringPool.getSize();
+    tailMergePhase.reset();
+    runPass("Remap strings", [&](unsigned i) {
+      LayoutCompileUnit &unit = *result.units[i];
+      remapStrings(*unit.unitDie, remap);
+      for (const LayoutTypeUnit &typeUnit : unit.typeUnits)
+        remapStrings(*typeUnit.unitDie, remap);
+      remapNames(unit.names, remap);
+    });
+    result.tailMergeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  if (options.stringIndices) {
+    {
+      PhaseScope phase("Index strings");
+      indexStrings(result);
+    }
+    layoutUnits();
+  }
+  return result;
+}
+
+Expected<DwarfSections> serializeCompileUnits(const LayoutCompileUnits &units, const dwarf::FormParams &formParams,
+                                              const DwarfUnitOffsets &unitOffsets) {
+  PhaseScope phase("Serialize");
+  DwarfSectionWriter writer(formParams, &unitOffsets);
+  for (const std::unique_ptr<LayoutCompileUnit> &unit : units.units) {
+    // A shared table is written once, and every header points at offset 0
+    if (!units.sharedAbbrevs)
+      writer.startAbbrevTable();
+    if (Error err = writer.emitCompileUnit(*unit->unitDie))
+      return std::move(err);
+    for (const LayoutTypeUnit &typeUnit : unit->typeUnits) {
+      if (Error err = writer.emitTypeUnit(*typeUnit.unitDie, typeUnit.signature, *typeUnit.typeDie))
+        return std::move(err);
+    }
+  }
+  DwarfSections sections = writer.finish(units.stringPool);
+
+  if (units.nameIndex) {
+    PhaseScope namesPhase("Name index");
+    std::vector<DwarfNameEntry> names;
+    std::vector<uint64_t> offsets;
+    for (const std::unique_ptr<LayoutCompileUnit> &unit : units.units) {
+      names.insert(names.end(), unit->names.begin(), unit->names.end());
+      offsets.push_back(unitOffsets.lookup(unit->unitDie));
+    }
+    writeDebugNames(sections.names, names, offsets, formParams);
+  }
+  return sections;
+}
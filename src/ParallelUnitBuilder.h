@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/CodeGen/DIE.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Error.h"
+
+#include "src/DwarfGenerator.h"
+#include "src/DwarfNameIndex.h"
+#include "src/DwarfSectionWriter.h"
+#include "src/LayoutDIEBuilder.h"
+#include "src/SimpleStringPool.h"
+
+// One compile unit of a LayoutUnitPlan, with the memory its DIEs live in
+struct LayoutCompileUnit {
+  llvm::BumpPtrAllocator allocator;
+  SimpleStringPool stringPool;
+  llvm::DIE *unitDie = nullptr;
+  std::vector<LayoutTypeUnit> typeUnits;
+  size_t numTypeDIEs = 0;
+  // .debug_names entries of the unit's named types, when asked for
+  std::vector<DwarfNameEntry> names;
+};
+
+// Every unit of a plan, laid out and ready for DwarfSectionWriter
+struct LayoutCompileUnits {
+  std::vector<std::unique_ptr<LayoutCompileUnit>> units;
+  // The unit pools merged in unit order; DW_FORM_strp values point into this one
+  SimpleStringPool stringPool;
+  // Tail merging: strings stored inside another one, .debug_str bytes saved and time taken
+  uint32_t numTailMergedStrings = 0;
+  uint64_t tailMergeSavedBytes = 0;
+  double tailMergeSeconds = 0;
+  // Whether serializeCompileUnits() emits .debug_names
+  bool nameIndex = false;
+  // All units use one abbreviation table with this many entries, numbered by use count
+  bool sharedAbbrevs = false;
+  unsigned numSharedAbbrevs = 0;
+  // computeOffsetsAndAbbrevs passes over every unit; more than one with narrowed references
+  unsigned numLayoutPasses = 0;
+  // Implicit constants: split-off abbreviations, values moved, the .debug_info
+  // bytes they took and the .debug_abbrev bytes their declarations add
+  unsigned numImplicitConstAbbrevs = 0;
+  uint64_t numImplicitConstValues = 0;
+  uint64_t implicitConstSavedBytes = 0;
+  int64_t implicitConstAbbrevBytes = 0;
+
+  std::vector<llvm::DIE *> getUnitDies() const;
+  size_t getNumTypeDIEs() const;
+};
+
+// Build and lay out (computeOffsetsAndAbbrevs) every unit of the plan on a thread pool
+// - The plan already applies dedupTypes, typeUnits and compileUnits; the other
+//   options are read here, and the DWARF version comes from getFormParams()
+// - Each unit has its own allocator, string pool and abbreviation set, so the
+//   workers share nothing but the read-only plan (and a shared set they only read)
+// - String offsets are merged afterwards in unit order, so the result is
+//   byte-identical for any jobs (0 = one per hardware thread)
+// - A single unit is built on the calling thread
+// - With stringIndices (DWARF 5), names use DW_FORM_strx1-4 into the merged
+//   pool's index table instead of DW_FORM_strp; see SimpleStringPool::writeStrOffsets()
+// - With tailMergeStrings, the merged pool is tail merged and the string
+//   references rewritten; see SimpleStringPool::tailMerge()
+// - With nameIndex (DWARF 5), each unit's named types are collected for
+//   .debug_names by the same worker, right after its layout
+// - With shareAbbrevs, the abbreviation uses of every unit are counted first,
+//   the most used shapes get the lowest numbers, and all units (type units
+//   included) are laid out against that one table
+// - With narrowRefs, unit-relative references take the narrowest of
+//   ref1/ref2/ref4/ref_udata for their target offset, laying the units out
+//   again until the forms and offsets reach a fixpoint
+// - With implicitConsts (DWARF 5), constant values that recur across an
+//   abbreviation class move into split-off abbreviations as
+//   DW_FORM_implicit_const; see ImplicitConstPlanner
+LayoutCompileUnits buildCompileUnits(LayoutUnitPlan &plan, const DwarfGeneratorOptions &options);
+
+// Serialize every unit, each with its own abbreviation table (or all with the
+// shared one) and followed by its type units. unitOffsets comes from computeCompileUnitOffsets(units.getUnitDies()).
+// .debug_str is a view into units.stringPool; .debug_str_offsets is only
+// produced with string indices, .debug_names only with the name index.
+llvm::Expected<DwarfSections> serializeCompileUnits(const LayoutCompileUnits &units, const llvm::dwarf::FormParams &formParams,
+                                                    const DwarfUnitOffsets &unitOffsets);
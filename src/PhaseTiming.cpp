@@ -0,0 +1,53 @@
+#include <string>
+
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/PhaseTiming.h"
+
+using namespace llvm;
+
+static PhaseTimingSettings settings;
+static bool started = false;
+static bool traceEnabled = false;
+static std::string traceProcName;
+
+bool isPhaseTimingEnabled() {
+  return settings.timePhases;
+}
+
+bool isPhaseTimingStarted() {
+  return started;
+}
+
+void startPhaseTiming(StringRef procName, const PhaseTimingSettings &newSettings) {
+  settings = newSettings;
+  started = true;
+  traceEnabled = !settings.traceFile.empty();
+  traceProcName = procName.str();
+  if (traceEnabled)
+    timeTraceProfilerInitialize(settings.traceGranularity, traceProcName);
+}
+
+Error finishPhaseTiming() {
+  PhaseTimingSettings finished = std::move(settings);
+  settings = {};
+  started = false;
+  if (finished.timePhases)
+    TimerGroup::printAll(errs());
+  if (!traceEnabled)
+    return Error::success();
+  Error err = timeTraceProfilerWrite(finished.traceFile, traceProcName);
+  timeTraceProfilerCleanup();
+  traceEnabled = false;
+  return err;
+}
+
+PhaseWorkerScope::PhaseWorkerScope() : tracing(traceEnabled && !timeTraceProfilerEnabled()) {
+  if (tracing)
+    timeTraceProfilerInitialize(settings.traceGranularity, traceProcName);
+}
+
+PhaseWorkerScope::~PhaseWorkerScope() {
+  if (tracing)
+    timeTraceProfilerFinishThread();
+}
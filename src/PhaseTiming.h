@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Timer.h"
+
+// Opt-in phase instrumentation shared by both generators
+// - A llvm::TimerGroup summary table printed to stderr
+// - A Chrome trace JSON (chrome://tracing, Perfetto) written through
+//   llvm::timeTraceProfiler
+// Both are off by default, where a PhaseScope costs two branches. Settings
+// come from the caller, so LLVMDwarfCore registers no command-line options.
+
+struct PhaseTimingSettings {
+  bool timePhases = false;
+  // Trace file; empty for no trace
+  std::string traceFile;
+  // Minimum trace event duration in microseconds
+  unsigned traceGranularity = 0;
+
+  bool isEnabled() const {
+    return timePhases || !traceFile.empty();
+  }
+};
+
+// --time-phases, --time-trace=<file> and --time-trace-granularity; defined in
+// PhaseTimingOptions.cpp, which only the executables link
+PhaseTimingSettings getPhaseTimingSettingsFromOptions();
+
+bool isPhaseTimingEnabled();
+// Whether startPhaseTiming() has run without finishPhaseTiming() yet
+bool isPhaseTimingStarted();
+
+// Timing is process-wide: start it once, on the thread that runs the phases
+void startPhaseTiming(llvm::StringRef procName, const PhaseTimingSettings &settings);
+// Print the summary table and write the trace file
+llvm::Error finishPhaseTiming();
+
+// Times one phase on the thread that starts phase timing. The name is both the
+// timer name and the trace event name.
+class PhaseScope {
+  llvm::NamedRegionTimer timer;
+  llvm::TimeTraceScope trace;
+
+public:
+  explicit PhaseScope(llvm::StringRef name, llvm::StringRef detail = "")
+      : timer(name, name, "dwarf", "DWARF generation phases", isPhaseTimingEnabled()), trace(name, detail) {
+  }
+};
+
+// Wraps one task on a worker thread so its llvm::TimeTraceScopes reach the
+// trace. Timers are not thread-safe, so workers only contribute trace events.
+class PhaseWorkerScope {
+  bool tracing;
+
+public:
+  PhaseWorkerScope();
+  ~PhaseWorkerScope();
+};
@@ -0,0 +1,21 @@
+#include <string>
+
+#include "llvm/Support/CommandLine.h"
+
+#include "src/PhaseTiming.h"
+
+using namespace llvm;
+
+static cl::opt<bool> TimePhases("time-phases", cl::desc("Print a per-phase timing table to stderr"), cl::init(false));
+static cl::opt<std::string> TimeTraceFile("time-trace", cl::desc("Write a Chrome trace of the phases to <file>"),
+                                          cl::value_desc("file"), cl::init(""));
+static cl::opt<unsigned> TimeTraceGranularity("time-trace-granularity",
+                                              cl::desc("Minimum event duration in microseconds for --time-trace"), cl::init(0));
+
+PhaseTimingSettings getPhaseTimingSettingsFromOptions() {
+  PhaseTimingSettings settings;
+  settings.timePhases = TimePhases;
+  settings.traceFile = TimeTraceFile;
+  settings.traceGranularity = TimeTraceGranularity;
+  return settings;
+}
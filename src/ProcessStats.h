@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// Peak resident set size of the current process in bytes (0 where unsupported)
+inline uint64_t getPeakRSSBytes() {
+#if defined(__APPLE__)
+  struct rusage usage;
+  return getrusage(RUSAGE_SELF, &usage) == 0 ? uint64_t(usage.ru_maxrss) : 0;
+#elif defined(__unix__)
+  struct rusage usage;
+  return getrusage(RUSAGE_SELF, &usage) == 0 ? uint64_t(usage.ru_maxrss) * 1024 : 0;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/xxhash.h"
+
+#include "src/ByteEncoding.h"
+
+// Simple string pool for offset tracking
+// - All strings live NUL-terminated in one contiguous buffer (the future .debug_str)
+// - Interning goes through an open-addressing hash table whose keys are
+//   (offset, length) views into that buffer, so add() never copies a key
+// - Optionally indexes its strings for DWARF 5 DW_FORM_strx*, backed by a
+//   .debug_str_offsets table
+// - Optionally tail merges, storing strings that end another string only once
+class SimpleStringPool {
+  static constexpr uint32_t EmptySlot = ~0u;
+
+  struct Slot {
+    uint64_t hash = 0;
+    uint32_t offset = EmptySlot;
+    uint32_t length = 0;
+  };
+
+  std::string data;
+  std::vector<Slot> slots;
+  uint32_t numStrings = 0;
+  // .debug_str offset of every string index, in index order
+  std::vector<uint32_t> indexOffsets;
+
+  void rehash(size_t newSize) {
+    std::vector<Slot> old = std::move(slots);
+    slots.assign(newSize, Slot());
+    size_t mask = newSize - 1;
+    for (const Slot &s : old) {
+      if (s.offset == EmptySlot)
+        continue;
+      size_t i = s.hash & mask;
+      while (slots[i].offset != EmptySlot)
+        i = (i + 1) & mask;
+      slots[i] = s;
+    }
+  }
+
+public:
+  explicit SimpleStringPool(size_t expectedStrings = 0) {
+    reserve(expectedStrings);
+  }
+
+  // Pre-size the table so that expectedStrings insertions never rehash.
+  void reserve(size_t expectedStrings) {
+    size_t wanted = llvm::PowerOf2Ceil(std::max<size_t>(16, expectedStrings * 4 / 3 + 1));
+    if (wanted > slots.size())
+      rehash(wanted);
+  }
+
+  uint32_t add(llvm::StringRef str) {
+    // Keep the load factor below 3/4 so probe sequences stay short.
+    if ((numStrings + 1) * 4 > slots.size() * 3)
+      rehash(slots.size() * 2);
+
+    uint64_t hash = llvm::xxHash64(str);
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+      Slot &s = slots[i];
+      if (s.offset == EmptySlot) {
+        uint32_t offset = data.size();
+        data.append(str.data(), str.size());
+        data += '\0';
+        s.hash = hash;
+        s.offset = offset;
+        s.length = str.size();
+        ++numStrings;
+        return offset;
+      }
+      if (s.hash == hash && s.length == str.size() && std::memcmp(data.data() + s.offset, str.data(), str.size()) == 0) {
+        return s.offset;
+      }
+    }
+  }
+
+  llvm::StringRef getData() const {
+    return data;
+  }
+  uint32_t getSize() const {
+    return data.size();
+  }
+  uint32_t getNumStrings() const {
+    return numStrings;
+  }
+
+  // Tail merging, as llvm::StringTableBuilder does: a string that is a suffix
+  // of another one ("name" of "classname") points into the longer one instead
+  // of being stored. The remaining strings keep their order. remap has the
+  // new offset of every string added so far, for rewriting the offsets
+  // already handed out. add() keeps working afterwards.
+  struct TailMergeResult {
+    llvm::DenseMap<uint32_t, uint32_t> remap;
+    // Strings that are no longer stored on their own
+    uint32_t numMerged = 0;
+  };
+  TailMergeResult tailMerge() {
+    struct Entry {
+      // Position in the buffer, i.e. in the order the strings were added
+      uint32_t rank;
+      uint32_t offset;
+      uint32_t length;
+      // Up to the last 16 characters, last one in the top byte of tail[0], so
+      // most comparisons below never touch the string data
+      uint64_t tail[2];
+    };
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data.data());
+    std::vector<Entry> entries;
+    entries.reserve(numStrings);
+    for (uint32_t offset = 0; offset < data.size();) {
+      Entry e{uint32_t(entries.size()), offset, uint32_t(std::strlen(data.c_str() + offset)), {0, 0}};
+      for (uint32_t i = 0; i < std::min<uint32_t>(e.length, 16); ++i)
+        e.tail[i / 8] |= uint64_t(bytes[offset + e.length - 1 - i]) << (56 - 8 * (i % 8));
+      entries.push_back(e);
+      offset += e.length + 1;
+    }
+    std::vector<uint32_t> oldOffsets(entries.size());
+    for (const Entry &e : entries)
+      oldOffsets[e.rank] = e.offset;
+
+    // Sort by reversed content, descending: a string directly follows the
+    // longest string it is a suffix of, or another suffix of that one.
+    // Strings have no NUL, so equal tails of short strings mean equal strings.
+    std::sort(entries.begin(), entries.end(), [&](const Entry &a, const Entry &b) {
+      if (a.tail[0] != b.tail[0])
+        return a.tail[0] > b.tail[0];
+      if (a.tail[1] != b.tail[1])
+        return a.tail[1] > b.tail[1];
+      const unsigned char *endA = bytes + a.offset + a.length, *endB = bytes + b.offset + b.length;
+      for (uint32_t i = 17, n = std::min(a.length, b.length); i <= n; ++i) {
+        if (*(endA - i) != *(endB - i))
+          return *(endA - i) > *(endB - i);
+      }
+      return a.length > b.length;
+    });
+    // The entry each one ends up inside (itself if it is stored)
+    std::vector<uint32_t> owner(entries.size());
+    std::vector<bool> isStored(entries.size());
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+      const Entry &e = entries[i];
+      const Entry &prev = entries[i ? i - 1 : 0];
+      bool isSuffix = i && e.length <= prev.length &&
+                      std::memcmp(bytes + prev.offset + prev.length - e.length, bytes + e.offset, e.length) == 0;
+      owner[i] = isSuffix ? owner[i - 1] : i;
+      isStored[e.rank] = !isSuffix;
+    }
+
+    // Stored strings keep their order; suffixes point into their owner
+    std::string merged;
+    merged.reserve(data.size());
+    std::vector<uint32_t> newOffsets(entries.size());
+    for (uint32_t rank = 0; rank < entries.size(); ++rank) {
+      if (!isStored[rank])
+        continue;
+      newOffsets[rank] = merged.size();
+      merged.append(data.c_str() + oldOffsets[rank]);
+      merged += '\0';
+    }
+    TailMergeResult result;
+    llvm::DenseMap<uint32_t, uint32_t> &remap = result.remap;
+    remap.reserve(entries.size());
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+      const Entry &ownerEntry = entries[owner[i]];
+      remap[entries[i].offset] = newOffsets[ownerEntry.rank] + ownerEntry.length - entries[i].length;
+      result.numMerged += owner[i] != i;
+    }
+
+    data = std::move(merged);
+    for (Slot &s : slots) {
+      if (s.offset != EmptySlot)
+        s.offset = remap.lookup(s.offset);
+    }
+    for (uint32_t &offset : indexOffsets)
+      offset = remap.lookup(offset);
+    return result;
+  }
+
+  // Give the strings at these offsets the indices 0, 1, ... in this order
+  void setIndexedOffsets(std::vector<uint32_t> offsets) {
+    indexOffsets = std::move(offsets);
+  }
+  uint32_t getNumIndices() const {
+    return indexOffsets.size();
+  }
+  uint32_t getOffsetOfIndex(uint32_t index) const {
+    return index < indexOffsets.size() ? indexOffsets[index] : EmptySlot;
+  }
+
+  // Size of the .debug_str_offsets header, i.e. the DW_AT_str_offsets_base of
+  // the only contribution
+  static constexpr uint32_t StrOffsetsHeaderSize = 8;
+
+  // .debug_str_offsets for DWARF 5 / DWARF32: unit_length, version 5, padding,
+  // then one 4-byte .debug_str offset per index
+  void writeStrOffsets(llvm::SmallVectorImpl<uint8_t> &out) const {
+    out.reserve(out.size() + StrOffsetsHeaderSize + 4 * indexOffsets.size());
+    writeInt(out, 4 + 4 * indexOffsets.size(), 4);
+    writeInt(out, 5, 2);
+    writeInt(out, 0, 2);
+    for (uint32_t offset : indexOffsets)
+      writeInt(out, offset, 4);
+  }
+
+  // The returned view points into the pool and is only valid until the next add().
+  llvm::StringRef getStringAt(uint32_t offset) const {
+    if (offset >= data.size())
+      return "";
+    return llvm::StringRef(data.c_str() + offset);
+  }
+};
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <cassert>
+
+#include "src/PhaseTiming.h"
+#include "src/StreamingUnitEmitter.h"
+
+using namespace llvm;
+
+StreamingUnitEmitter::StreamingUnitEmitter(LayoutUnitPlan &plan, const dwarf::FormParams &formParams, uint32_t chunkTypes)
+    : plan(plan), formParams(formParams), chunkTypes(std::max<uint32_t>(chunkTypes, 1)) {
+  assert(plan.getNumUnits() == 1 && "streaming emits a single compile unit");
+}
+
+uint64_t StreamingUnitEmitter::layoutUnitDIE(DIE &unitDie) {
+  unitDie.setForceChildren(true);
+  // The size includes the null entry that ends the (still empty) child list
+  return unitDie.computeOffsetsAndAbbrevs(formParams, abbrevSet, getCompileUnitHeaderSize(formParams)) - 1;
+}
+
+void StreamingUnitEmitter::computeLayout() {
+  PhaseScope phase("Stream layout");
+  uint32_t numTypes = plan.getTable().types.size();
+  typeOffsets.assign(numTypes, 0);
+  LayoutDIEBuilder builder(chunkAllocator, stringPool, plan);
+
+  uint64_t offset = layoutUnitDIE(*builder.createUnitDIE());
+  chunkAllocator.Reset();
+  for (uint32_t begin = 0; begin < numTypes; begin += chunkTypes) {
+    uint32_t end = std::min(begin + chunkTypes, numTypes);
+    std::vector<DIE *> dies = builder.buildTypeChunk(begin, end, typeOffsets);
+    for (uint32_t i = begin; i < end; ++i) {
+      if (DIE *die = dies[i - begin]) {
+        typeOffsets[i] = offset;
+        offset = die->computeOffsetsAndAbbrevs(formParams, abbrevSet, offset);
+      }
+    }
+    chunkAllocator.Reset();
+  }
+  unitSize = offset + 1;
+}
+
+Error StreamingUnitEmitter::emit(DwarfSectionWriter &writer, raw_ostream &info, UnitFn onUnit, ChunkFn onChunk) {
+  assert(unitSize && "computeLayout() must run first");
+  PhaseScope phase("Stream emit");
+  uint32_t numTypes = plan.getTable().types.size();
+  LayoutDIEBuilder builder(chunkAllocator, stringPool, plan);
+
+  DIE *unitDie = builder.createUnitDIE();
+  uint64_t offset = layoutUnitDIE(*unitDie);
+  if (Error err = writer.beginCompileUnit(*unitDie, unitSize))
+    return err;
+  onUnit(*unitDie);
+  writer.drainInfo(info);
+  chunkAllocator.Reset();
+
+  for (uint32_t begin = 0; begin < numTypes; begin += chunkTypes) {
+    uint32_t end = std::min(begin + chunkTypes, numTypes);
+    std::vector<DIE *> dies = builder.buildTypeChunk(begin, end, typeOffsets);
+    // References within the chunk are DIEEntries, so every DIE of the chunk has
+    // its offset before the first one is written
+    for (uint32_t i = begin; i < end; ++i) {
+      if (DIE *die = dies[i - begin]) {
+        offset = die->computeOffsetsAndAbbrevs(formParams, abbrevSet, offset);
+        assert(die->getOffset() == typeOffsets[i] && "chunk layout differs between the passes");
+      }
+    }
+    for (DIE *die : dies) {
+      if (!die)
+        continue;
+      if (Error err = writer.emitChildDIE(*die))
+        return err;
+    }
+    onChunk(dies);
+    writer.drainInfo(info);
+    chunkAllocator.Reset();
+  }
+  writer.endCompileUnit();
+  writer.drainInfo(info);
+  numTypeDIEs = builder.getNumTypeDIEs();
+  return Error::success();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/CodeGen/DIE.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/DwarfSectionWriter.h"
+#include "src/LayoutDIEBuilder.h"
+#include "src/SimpleStringPool.h"
+
+// Emits a one-unit plan (no type units) as one compile unit, a chunk of
+// top-level types at a time, for type sets too large to hold as one DIE tree
+// - computeLayout() builds and lays out every chunk once, keeping only each
+//   type's unit offset and the unit size. emit() then rebuilds each chunk with
+//   every DW_AT_type already resolved, so nothing is patched afterwards and
+//   .debug_info can go to a pipe.
+// - A chunk's DIEs are released before the next chunk is built, so DIE memory
+//   is bounded by chunkTypes. The table, one offset per type, the string pool
+//   and the abbreviations still grow with the input.
+// - The output is byte-identical to buildCompileUnits() + emitCompileUnit()
+class StreamingUnitEmitter {
+  LayoutUnitPlan &plan;
+  llvm::dwarf::FormParams formParams;
+  uint32_t chunkTypes;
+  llvm::BumpPtrAllocator chunkAllocator;
+  // Abbreviations outlive the chunks and keep their numbers across both passes
+  llvm::BumpPtrAllocator abbrevAllocator;
+  llvm::DIEAbbrevSet abbrevSet{abbrevAllocator};
+  SimpleStringPool stringPool;
+  // Unit offset of every canonical type, from computeLayout()
+  std::vector<uint32_t> typeOffsets;
+  uint64_t unitSize = 0;
+  size_t numTypeDIEs = 0;
+
+  // Unit DIE laid out with no children yet; returns the offset of its first child
+  uint64_t layoutUnitDIE(llvm::DIE &unitDie);
+
+public:
+  using UnitFn = llvm::function_ref<void(llvm::DIE &unitDie)>;
+  using ChunkFn = llvm::function_ref<void(llvm::ArrayRef<llvm::DIE *> dies)>;
+
+  StreamingUnitEmitter(LayoutUnitPlan &plan, const llvm::dwarf::FormParams &formParams, uint32_t chunkTypes);
+
+  // First pass: type offsets and the unit size
+  void computeLayout();
+  // .debug_info size of the unit, known once computeLayout() has run
+  uint64_t getInfoSize() const {
+    return unitSize;
+  }
+
+  // Second pass: serialize the unit through writer, draining .debug_info into
+  // info after every chunk. onUnit and onChunk see the DIEs (laid out, unit
+  // relative) before they are released; chunk entries may be nullptr.
+  llvm::Error emit(DwarfSectionWriter &writer, llvm::raw_ostream &info, UnitFn onUnit, ChunkFn onChunk);
+
+  SimpleStringPool &getStringPool() {
+    return stringPool;
+  }
+  // Type DIEs emitted, after deduplication
+  size_t getNumTypeDIEs() const {
+    return numTypeDIEs;
+  }
+};
@@ -0,0 +1,179 @@
+#include <cstring>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/WasmSectionWriter.h"
+
+using namespace llvm;
+
+namespace {
+
+const char WasmHeader[] = {'\0', 'a', 's', 'm', 1, 0, 0, 0};
+const uint8_t CustomSectionId = 0;
+
+// One custom section, possibly made of several consecutive buffers
+struct CustomSection {
+  StringRef name;
+  SmallVector<ArrayRef<uint8_t>, 1> parts;
+
+  uint64_t getPayloadSize() const {
+    uint64_t size = 0;
+    for (ArrayRef<uint8_t> part : parts)
+      size += part.size();
+    return size;
+  }
+};
+
+SmallVector<CustomSection, 4> getCustomSections(const DwarfSectionsRef &sections) {
+  SmallVector<CustomSection, 4> result;
+  result.push_back({".debug_abbrev", {sections.abbrev}});
+  result.push_back({".debug_info", {sections.info}});
+  result.push_back({".debug_str", {arrayRefFromStringRef(sections.str)}});
+  if (!sections.strOffsets.empty())
+    result.push_back({".debug_str_offsets", {sections.strOffsets}});
+  if (!sections.names.empty())
+    result.push_back({".debug_names", {sections.names}});
+  for (ArrayRef<uint8_t> unit : sections.typeUnits)
+    result.push_back({".debug_types", {unit}});
+  return result;
+}
+
+SmallVector<StringRef, 4> getSectionNames(ArrayRef<CustomSection> sections) {
+  SmallVector<StringRef, 4> names;
+  for (const CustomSection &section : sections) {
+    // One entry for all the .debug_types sections
+    if (names.empty() || names.back() != section.name)
+      names.push_back(section.name);
+  }
+  return names;
+}
+
+void writeCustomSection(raw_ostream &OS, const CustomSection &section) {
+  writeWasmCustomSectionHeader(OS, section.name, section.getPayloadSize());
+  for (ArrayRef<uint8_t> part : section.parts)
+    OS.write(reinterpret_cast<const char *>(part.data()), part.size());
+}
+
+Error writeCustomSections(raw_fd_ostream &OS, StringRef path, const DwarfSectionsRef &sections) {
+  for (const CustomSection &section : getCustomSections(sections))
+    writeCustomSection(OS, section);
+  return closeWasmDebugStream(OS, path);
+}
+
+// Reads a ULEB128 from buf at *pos, advancing it; false if truncated
+bool readULEB(ArrayRef<uint8_t> buf, size_t &pos, uint64_t &value) {
+  unsigned length = 0;
+  const char *error = nullptr;
+  value = decodeULEB128(buf.data() + pos, &length, buf.data() + buf.size(), &error);
+  pos += length;
+  return !error;
+}
+
+// Walk the section headers with positioned reads and reject modules that
+// already carry one of the sections we are about to add
+Error checkWasmModule(StringRef path, ArrayRef<StringRef> newSections) {
+  Expected<sys::fs::file_t> fileOrErr = sys::fs::openNativeFileForRead(path);
+  if (!fileOrErr)
+    return fileOrErr.takeError();
+  sys::fs::file_t file = *fileOrErr;
+  auto closeFile = make_scope_exit([&] { sys::fs::closeFile(file); });
+  auto invalid = [&](const char *reason) {
+    return createStringError(inconvertibleErrorCode(), "%s: not a valid wasm module (%s)", path.str().c_str(), reason);
+  };
+
+  uint64_t fileSize;
+  if (std::error_code ec = sys::fs::file_size(path, fileSize))
+    return createStringError(ec, "%s: %s", path.str().c_str(), ec.message().c_str());
+
+  char header[sizeof(WasmHeader)];
+  Expected<size_t> readOrErr = sys::fs::readNativeFileSlice(file, header, 0);
+  if (!readOrErr)
+    return readOrErr.takeError();
+  if (*readOrErr != sizeof(header) || std::memcmp(header, WasmHeader, sizeof(header)) != 0)
+    return invalid("bad magic or version");
+
+  // Section id, size and (for custom sections) the start of the name fit in here
+  uint8_t buf[64];
+  for (uint64_t offset = sizeof(WasmHeader); offset < fileSize;) {
+    readOrErr = sys::fs::readNativeFileSlice(file, MutableArrayRef<char>(reinterpret_cast<char *>(buf), sizeof(buf)), offset);
+    if (!readOrErr)
+      return readOrErr.takeError();
+    ArrayRef<uint8_t> data(buf, *readOrErr);
+    size_t pos = 1;
+    uint64_t sectionSize;
+    if (!readULEB(data, pos, sectionSize) || sectionSize > fileSize - offset - pos)
+      return invalid("truncated section");
+
+    if (data[0] == CustomSectionId) {
+      size_t contentStart = pos;
+      uint64_t nameLength;
+      if (readULEB(data, pos, nameLength) && nameLength <= data.size() - pos && nameLength <= sectionSize - (pos - contentStart)) {
+        StringRef name(reinterpret_cast<const char *>(data.data() + pos), nameLength);
+        for (StringRef section : newSections) {
+          if (name == section)
+            return createStringError(inconvertibleErrorCode(), "%s: already has a %s section", path.str().c_str(),
+                                     name.str().c_str());
+        }
+      }
+      pos = contentStart;
+    }
+    offset += pos + sectionSize;
+  }
+  return Error::success();
+}
+
+} // namespace
+
+Error writeWasmDebugModule(StringRef path, const DwarfSectionsRef &sections) {
+  Expected<std::unique_ptr<raw_fd_ostream>> OS = openWasmDebugStream(path, false, {});
+  if (!OS)
+    return OS.takeError();
+  return writeCustomSections(**OS, path, sections);
+}
+
+Error appendWasmDebugSections(StringRef path, const DwarfSectionsRef &sections) {
+  Expected<std::unique_ptr<raw_fd_ostream>> OS = openWasmDebugStream(path, true, getSectionNames(getCustomSections(sections)));
+  if (!OS)
+    return OS.takeError();
+  return writeCustomSections(**OS, path, sections);
+}
+
+Expected<std::unique_ptr<raw_fd_ostream>> openWasmDebugStream(StringRef path, bool append, ArrayRef<StringRef> sectionNames) {
+  if (append) {
+    if (Error err = checkWasmModule(path, sectionNames))
+      return std::move(err);
+  }
+  std::error_code ec;
+  auto OS = std::make_unique<raw_fd_ostream>(path, ec, append ? sys::fs::OF_Append : sys::fs::OF_None);
+  if (ec)
+    return createStringError(ec, "%s: %s", path.str().c_str(), ec.message().c_str());
+  if (!append)
+    OS->write(WasmHeader, sizeof(WasmHeader));
+  return std::move(OS);
+}
+
+void writeWasmCustomSectionHeader(raw_ostream &OS, StringRef name, uint64_t payloadSize) {
+  // Custom section content is the name (a length-prefixed string) followed by the payload
+  uint8_t nameLength[16];
+  unsigned nameLengthSize = encodeULEB128(name.size(), nameLength);
+  OS << char(CustomSectionId);
+  encodeULEB128(nameLengthSize + name.size() + payloadSize, OS);
+  OS.write(reinterpret_cast<const char *>(nameLength), nameLengthSize);
+  OS << name;
+}
+
+Error closeWasmDebugStream(raw_fd_ostream &OS, StringRef path) {
+  OS.close();
+  if (OS.has_error()) {
+    Error err = createStringError(OS.error(), "%s: %s", path.str().c_str(), OS.error().message().c_str());
+    OS.clear_error();
+    return err;
+  }
+  return Error::success();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "src/DwarfSectionWriter.h"
+
+// DWARF sections as WebAssembly custom sections (id 0, named ".debug_*"),
+// the layout wasm-ld and the browser debuggers expect
+// - Every type unit goes into its own ".debug_types" section. No "linking"
+//   section groups them: that would mark the module as a relocatable object,
+//   and the units' abbreviation and string offsets carry no relocations.
+// - Section payloads are streamed from the section buffers, never copied
+
+// Write a module holding only the wasm header and the DWARF custom sections,
+// e.g. a separate debug file next to the stripped module
+llvm::Error writeWasmDebugModule(llvm::StringRef path, const DwarfSectionsRef &sections);
+
+// Append the DWARF custom sections to an existing module in place. Only the
+// section headers are read, so the module is never loaded into memory. Fails
+// if the module already has one of the sections.
+llvm::Error appendWasmDebugSections(llvm::StringRef path, const DwarfSectionsRef &sections);
+
+// Streaming: custom sections written one at a time, for payloads that are never
+// in memory as a whole. Opens a new module, or an existing one to append to
+// that must not have any of sectionNames yet.
+llvm::Expected<std::unique_ptr<llvm::raw_fd_ostream>> openWasmDebugStream(llvm::StringRef path, bool append,
+                                                                          llvm::ArrayRef<llvm::StringRef> sectionNames);
+// Header of a custom section; the caller writes exactly payloadSize bytes next
+void writeWasmCustomSectionHeader(llvm::raw_ostream &OS, llvm::StringRef name, uint64_t payloadSize);
+// Close a stream from openWasmDebugStream(), reporting write errors
+llvm::Error closeWasmDebugStream(llvm::raw_fd_ostream &OS, llvm::StringRef path);
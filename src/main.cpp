@@ -1,171 +1,170 @@
+#include <chrono>
 #include <fstream>
 #include <memory>
-#include <sstream>
+#include <optional>
 
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/BinaryFormat/ELF.h"
 #include "llvm/DebugInfo/DWARF/DWARFContext.h"
-#include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/LLVMContext.h"
-#include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
-#include "llvm/IR/Verifier.h"
-#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Object/Decompressor.h"
+#include "llvm/Object/ELFObjectFile.h"
 #include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Format.h"
-#include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/raw_ostream.h"
-#include "llvm/Target/TargetMachine.h"
-#include "llvm/Target/TargetOptions.h"
 #include "llvm/TargetParser/Host.h"
 
+#include "src/DIBuilderModule.h"
+#include "src/DebugSectionCompression.h"
+#include "src/DwarfCache.h"
+#include "src/LayoutTable.h"
+#include "src/ObjectDwarfGenerator.h"
+#include "src/PhaseTiming.h"
+#include "src/ProcessStats.h"
+
 using namespace llvm;
 using namespace llvm::object;
 
-int main() {
+static cl::opt<std::string> LayoutFile(cl::Positional, cl::desc("[layout.json]"), cl::init(""));
+
+// DIBuilder module -> object file in memory
+static Error generateObject(const LayoutTable &table, SmallVectorImpl<char> &objBuffer) {
   // Create LLVM context and module
   LLVMContext context;
-  auto module = std::make_unique<Module>("test_module", context);
-
-  // Create DIBuilder
-  DIBuilder builder(*module);
-
-  // Create a compile unit with producer "warpo"
-  // Use a placeholder file (required by LLVM, but we won't use line info)
-  DIFile *file = builder.createFile("<unknown>", "");
-
-  DICompileUnit *CU = builder.createCompileUnit(dwarf::DW_LANG_C_plus_plus, // Language
-                                                file,                       // File
-                                                "warpo",                    // Producer (the name we want)
-                                                false,                      // isOptimized
-                                                "",                         // Flags
-                                                0                           // Runtime Version
-  );
-
-  // Create a class/struct type to describe layout
-  // Example: class MyClass with member variables (no functions)
-
-  // Create basic types first
-  DIBasicType *intType = builder.createBasicType("int", 32, dwarf::DW_ATE_signed);
-  DIBasicType *charType = builder.createBasicType("char", 8, dwarf::DW_ATE_signed_char);
-
-  // Create a pointer type
-  DIDerivedType *charPtrType = builder.createPointerType(charType, 64);
-
-  // Create a composite type (class/struct)
-  DICompositeType *classType = builder.createClassType(CU,               // Scope (compile unit)
-                                                       "MyClass",        // Name
-                                                       nullptr,          // File (no source file)
-                                                       0,                // Line number (no line info)
-                                                       128,              // Size in bits (16 bytes)
-                                                       64,               // Alignment in bits
-                                                       0,                // Offset
-                                                       DINode::FlagZero, // Flags
-                                                       nullptr,          // Derived from
-                                                       nullptr           // Elements (will add members)
-  );
-
-  // Create member variables for the class
-  SmallVector<Metadata *, 4> members;
-
-  // Member 1: int x at offset 0
-  DIDerivedType *member1 = builder.createMemberType(classType,        // Scope
-                                                    "x",              // Name
-                                                    nullptr,          // File (no source)
-                                                    0,                // Line (no line info)
-                                                    32,               // Size in bits
-                                                    32,               // Alignment
-                                                    0,                // Offset in bits
-                                                    DINode::FlagZero, // Flags
-                                                    intType           // Type
-  );
-  members.push_back(member1);
-
-  // Member 2: int y at offset 32 bits (4 bytes)
-  DIDerivedType *member2 = builder.createMemberType(classType,        // Scope
-                                                    "y",              // Name
-                                                    nullptr,          // File (no source)
-                                                    0,                // Line (no line info)
-                                                    32,               // Size in bits
-                                                    32,               // Alignment
-                                                    32,               // Offset in bits
-                                                    DINode::FlagZero, // Flags
-                                                    intType           // Type
-  );
-  members.push_back(member2);
-
-  // Member 3: char* name at offset 64 bits (8 bytes)
-  DIDerivedType *member3 = builder.createMemberType(classType,        // Scope
-                                                    "name",           // Name
-                                                    nullptr,          // File (no source)
-                                                    0,                // Line (no line info)
-                                                    64,               // Size in bits (pointer)
-                                                    64,               // Alignment
-                                                    64,               // Offset in bits
-                                                    DINode::FlagZero, // Flags
-                                                    charPtrType       // Type
-  );
-  members.push_back(member3);
-
-  // Replace the class elements with the members array
-  builder.replaceArrays(classType, builder.getOrCreateArray(members));
-
-  // Add the class type to the compile unit's retained types
-  // This ensures the type appears in DWARF even without a variable
-  CU->replaceRetainedTypes(MDTuple::get(context, {classType}));
-
-  // Finalize the debug info
-  builder.finalize();
-
-  // Verify the module
-  std::string errorMsg;
-  raw_string_ostream errorStream(errorMsg);
-  if (verifyModule(*module, &errorStream)) {
-    errs() << "Module verification failed: " << errorMsg << "\n";
-    return 1;
-  }
-
-  // Initialize targets for code generation
-  InitializeAllTargetInfos();
-  InitializeAllTargets();
-  InitializeAllTargetMCs();
-  InitializeAllAsmPrinters();
+  Expected<std::unique_ptr<Module>> moduleOrErr = buildLayoutModule(context, table);
+  if (!moduleOrErr)
+    return moduleOrErr.takeError();
+  std::unique_ptr<Module> &module = *moduleOrErr;
 
-  // Set up target machine
-  std::string targetTriple = sys::getProcessTriple();
-  module->setTargetTriple(targetTriple);
+  // Initialize the native target once and set up the reusable generator
+  Expected<std::unique_ptr<ObjectDwarfGenerator>> generatorOrErr = ObjectDwarfGenerator::create();
+  if (!generatorOrErr)
+    return generatorOrErr.takeError();
 
-  std::string error;
-  const Target *target = TargetRegistry::lookupTarget(targetTriple, error);
-  if (!target) {
-    errs() << "Error: " << error << "\n";
-    return 1;
+  // Emit to in-memory buffer instead of file
+  return (*generatorOrErr)->emitObject(*module, objBuffer);
+}
+
+// The DIDumpType bit DWARFContext::dump() prints a section under, 0 for non-DWARF sections
+static unsigned getSectionDumpType(StringRef name) {
+  name.consume_back(".dwo");
+  return StringSwitch<unsigned>(name)
+#define HANDLE_DWARF_SECTION(ENUM_NAME, ELF_NAME, CMDLINE_NAME, OPTION) .Case(ELF_NAME, DIDT_##ENUM_NAME)
+#include "llvm/BinaryFormat/Dwarf.def"
+      .Case(".eh_frame", DIDT_DebugFrame)
+      .Case(".debug_macinfo", DIDT_DebugMacro)
+      .Default(0);
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "DIBuilder-based DWARF generator\n");
+  startPhaseTiming(argv[0], getPhaseTimingSettingsFromOptions());
+  auto start = std::chrono::steady_clock::now();
+
+  // Load the batch layout table, or fall back to the built-in MyClass example
+  LayoutTable table;
+  if (LayoutFile.empty()) {
+    makeClassSampleLayout(table);
+  } else {
+    PhaseScope phase("Load layout", LayoutFile);
+    if (Error err = readLayoutFile(LayoutFile, table)) {
+      errs() << "Failed to load " << LayoutFile << ": " << toString(std::move(err)) << "\n";
+      return 1;
+    }
   }
 
-  TargetOptions opt;
-  auto RM = std::optional<Reloc::Model>();
-  TargetMachine *targetMachine = target->createTargetMachine(targetTriple, "generic", "", opt, RM);
-  module->setDataLayout(targetMachine->createDataLayout());
-
-  // Emit to in-memory buffer instead of file
-  SmallVector<char, 0> objBuffer;
-  raw_svector_ostream objStream(objBuffer);
+  // The object's DWARF sections are compressed after codegen, one task per section
+  SectionCompressionType compressionType = getSectionCompressionType();
+  if (compressionType != SectionCompressionType::None) {
+    if (Error err = checkSectionCompressionAvailable(compressionType)) {
+      errs() << "Failed to compress DWARF: " << toString(std::move(err)) << "\n";
+      return 1;
+    }
+  }
 
-  legacy::PassManager pass;
-  if (targetMachine->addPassesToEmitFile(pass, objStream, nullptr, CodeGenFileType::ObjectFile)) {
-    errs() << "TargetMachine can't emit object file\n";
+  // An unchanged layout reuses the object file of an earlier run, skipping IR and codegen
+  Expected<std::unique_ptr<DwarfCache>> cacheOrErr = openDwarfCacheFromOptions();
+  if (!cacheOrErr) {
+    errs() << toString(cacheOrErr.takeError()) << "\n";
     return 1;
   }
+  std::unique_ptr<DwarfCache> cache = std::move(*cacheOrErr);
+  std::string cacheKey;
+  std::optional<DwarfCacheEntry> cached;
+  if (cache) {
+    PhaseScope phase("Cache lookup");
+    cacheKey = computeDwarfCacheKey(table, "dibuilder;triple=" + sys::getProcessTriple() + ";compress=" + std::to_string(int(compressionType)) +
+                                          ";level=" + std::to_string(compressionType != SectionCompressionType::None ? getSectionCompressionLevel() : 0));
+    cached = cache->lookup(cacheKey);
+    if (cached && cached->parts.size() != 1)
+      cached.reset();
+  }
 
-  pass.run(*module);
-
-  outs() << "✓ Compile Unit created with DIBuilder\n";
-  outs() << "✓ Producer name: warpo\n";
-  outs() << "✓ Class 'MyClass' defined with 3 members\n";
-  outs() << "✓ Generated object in memory (" << objBuffer.size() << " bytes)\n\n";
+  SmallVector<char, 0> objBuffer;
+  // The object as codegen wrote it when its sections were compressed, which
+  // still holds the section names compressedSections refers to
+  SmallVector<char, 0> uncompressedBuffer;
+  StringRef objData;
+  // Set when this run compressed the sections, with their timings; a cached
+  // object is already compressed and is only measured below
+  std::optional<CompressedDebugSections> compressedSections;
+  bool keptUncompressed = false;
+  if (cached) {
+    objData = toStringRef(cached->parts[0]);
+    outs() << "✓ Cache hit " << cacheKey << "\n";
+  } else {
+    if (Error err = generateObject(table, objBuffer)) {
+      errs() << "Error: " << toString(std::move(err)) << "\n";
+      return 1;
+    }
+    outs() << "✓ Compile Unit created with DIBuilder\n";
+
+    // Replace the DWARF sections of the object with their compressed form
+    if (compressionType != SectionCompressionType::None) {
+      Expected<std::unique_ptr<ObjectFile>> objOrErr =
+          ObjectFile::createObjectFile(MemoryBufferRef(StringRef(objBuffer.data(), objBuffer.size()), "memory"));
+      if (!objOrErr) {
+        errs() << "Failed to parse object file: " << toString(objOrErr.takeError()) << "\n";
+        return 1;
+      }
+      const auto *elfObj = dyn_cast<ELFObjectFileBase>(objOrErr->get());
+      if (elfObj && elfObj->isLittleEndian()) {
+        SmallVector<char, 0> compressedBuffer;
+        Expected<CompressedDebugSections> compressedOrErr = compressElfDebugSections(*elfObj, compressedBuffer);
+        if (!compressedOrErr) {
+          errs() << "Failed to compress DWARF: " << toString(compressedOrErr.takeError()) << "\n";
+          return 1;
+        }
+        compressedSections = std::move(*compressedOrErr);
+        uncompressedBuffer = std::move(objBuffer);
+        objBuffer = std::move(compressedBuffer);
+      } else {
+        keptUncompressed = true;
+      }
+    }
+    objData = StringRef(objBuffer.data(), objBuffer.size());
+  }
+  outs() << "✓ Producer name: " << table.producer << "\n";
+  outs() << "✓ Types: " << table.types.size() << " (" << table.getNumMembers() << " members)\n";
+  outs() << "✓ Generated object in memory (" << objData.size() << " bytes)\n\n";
+
+  if (cache && !cached) {
+    PhaseScope phase("Cache store");
+    if (Error err = cache->store(cacheKey, {arrayRefFromStringRef(objData)}))
+      errs() << "warning: " << toString(std::move(err)) << "\n";
+    else
+      outs() << "✓ Cache miss, stored " << cacheKey << "\n\n";
+  }
 
   // Parse the object file from memory
-  StringRef objData(objBuffer.data(), objBuffer.size());
-  Expected<std::unique_ptr<ObjectFile>> objOrErr = ObjectFile::createObjectFile(MemoryBufferRef(objData, "memory"));
+  Expected<std::unique_ptr<ObjectFile>> objOrErr = [&] {
+    PhaseScope phase("createObjectFile");
+    return ObjectFile::createObjectFile(MemoryBufferRef(objData, "memory"));
+  }();
 
   if (!objOrErr) {
     errs() << "Failed to parse object file\n";
@@ -174,8 +173,14 @@ int main() {
 
   std::unique_ptr<ObjectFile> &obj = objOrErr.get();
 
-  // Get DWARF section sizes (keep in memory, don't write to disk)
+  // Get DWARF section sizes (keep in memory, don't write to disk). An
+  // SHF_COMPRESSED section is measured by the size in its compression header.
   size_t debugInfoSize = 0, debugAbbrevSize = 0, debugStrSize = 0;
+  unsigned presentDumpTypes = 0;
+  CompressedDebugSections objectSections;
+  objectSections.type = compressionType;
+  objectSections.level = compressionType != SectionCompressionType::None ? getSectionCompressionLevel() : 0;
+  const auto *elfObj = dyn_cast<ELFObjectFileBase>(obj.get());
   for (const SectionRef &Section : obj->sections()) {
     Expected<StringRef> nameOrErr = Section.getName();
     if (!nameOrErr)
@@ -187,67 +192,98 @@ int main() {
       continue;
 
     StringRef contents = *contentsOrErr;
+    uint64_t size = contents.size();
+    bool compressed = elfObj && (ELFSectionRef(Section).getFlags() & ELF::SHF_COMPRESSED);
+    if (compressed) {
+      Expected<Decompressor> decompressorOrErr = Decompressor::create(name, contents, elfObj->isLittleEndian(), elfObj->getBytesInAddress() == 8);
+      if (!decompressorOrErr) {
+        errs() << "Failed to read " << name << ": " << toString(decompressorOrErr.takeError()) << "\n";
+        return 1;
+      }
+      size = decompressorOrErr->getDecompressedSize();
+    }
+    if (compressionType != SectionCompressionType::None && !compressedSections && name.substr(0, 7) == ".debug_" && !contents.empty()) {
+      CompressedDebugSection &section = objectSections.sections.emplace_back();
+      section.name = name;
+      section.uncompressedSize = size;
+      section.bytes.assign(contents.bytes_begin(), contents.bytes_end());
+      section.compressed = compressed;
+    }
+    if (!contents.empty())
+      presentDumpTypes |= getSectionDumpType(name);
 
     if (name == ".debug_info") {
-      debugInfoSize = contents.size();
+      debugInfoSize = size;
       outs() << "✓ DWARF .debug_info: " << debugInfoSize << " bytes (in memory)\n";
     } else if (name == ".debug_abbrev") {
-      debugAbbrevSize = contents.size();
+      debugAbbrevSize = size;
       outs() << "✓ DWARF .debug_abbrev: " << debugAbbrevSize << " bytes (in memory)\n";
     } else if (name == ".debug_str") {
-      debugStrSize = contents.size();
+      debugStrSize = size;
       outs() << "✓ DWARF .debug_str: " << debugStrSize << " bytes (in memory)\n";
     }
   }
 
+  // Per-section sizes and compression throughput of this run, or the sections
+  // as a cached object holds them
+  if (compressionType != SectionCompressionType::None) {
+    outs() << "\n";
+    if (keptUncompressed || (cached && !(elfObj && elfObj->isLittleEndian())))
+      outs() << "✓ Not a little-endian ELF object, so the DWARF sections stay uncompressed\n";
+    printCompressionStats(outs(), compressedSections ? *compressedSections : objectSections);
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  outs() << "✓ Generated in " << format("%.3f", seconds * 1e3) << " ms (" << format("%.0f", table.types.size() / seconds)
+         << " types/sec), peak RSS " << format("%.1f", getPeakRSSBytes() / 1048576.0) << " MB\n";
+
   // Create DWARF context and dump to human-readable file
-  std::unique_ptr<DWARFContext> dwCtx = DWARFContext::create(*obj);
+  std::unique_ptr<DWARFContext> dwCtx = [&] {
+    PhaseScope phase("DWARFContext::create");
+    return DWARFContext::create(*obj);
+  }();
 
   std::error_code EC;
-  // First dump to a temporary string
-  std::string tempOutput;
-  raw_string_ostream tempStream(tempOutput);
+  raw_fd_ostream dumpFile("debug.txt", EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << "Failed to write debug.txt: " << EC.message() << "\n";
+    return 1;
+  }
+  // Stream straight to the file through a large buffer instead of staging the dump in memory
+  dumpFile.SetBufferSize(1 << 20);
 
   DIDumpOptions dumpOptions;
+  // Select the non-empty sections except debug_line at the source. Any mask but
+  // DIDT_All makes every selected section print a header even when it is empty,
+  // so only the sections the object has are selected (an empty .debug_frame next
+  // to a non-empty .eh_frame would still get one; this object has neither).
+  dumpOptions.DumpType = presentDumpTypes & ~DIDT_DebugLine;
   dumpOptions.ShowChildren = true;
   dumpOptions.ShowParents = false;
   dumpOptions.ShowForm = true;
   dumpOptions.Verbose = true;
   dumpOptions.SummarizeTypes = false;
-  dwCtx->dump(tempStream, dumpOptions);
-  tempStream.flush();
-
-  // Now filter out the debug_line section
-  raw_fd_ostream dumpFile("debug.txt", EC, sys::fs::OF_None);
-  if (!EC) {
-    std::istringstream iss(tempOutput);
-    std::string line;
-    bool inDebugLine = false;
-
-    while (std::getline(iss, line)) {
-      // Check if we're entering debug_line section
-      if (line.find(".debug_line contents:") != std::string::npos) {
-        inDebugLine = true;
-        continue;
-      }
-      // Check if we're entering a new section (exit debug_line)
-      if (inDebugLine && line.find(".debug_") != std::string::npos && line.find("contents:") != std::string::npos) {
-        inDebugLine = false;
-      }
-      // Output line if not in debug_line section
-      if (!inDebugLine) {
-        dumpFile << line << "\n";
-      }
-    }
+  {
+    PhaseScope phase("Dump", "all sections but .debug_line");
+    dwCtx->dump(dumpFile, dumpOptions);
+  }
 
-    dumpFile.close();
-    outs() << "\n✓ Human-readable DWARF dump written to debug.txt (without debug_line)\n";
-  } else {
-    errs() << "Failed to write debug.txt: " << EC.message() << "\n";
+  dumpFile.close();
+  if (dumpFile.has_error()) {
+    errs() << "Failed to write debug.txt: " << dumpFile.error().message() << "\n";
+    dumpFile.clear_error();
     return 1;
   }
+  outs() << "\n✓ Human-readable DWARF dump written to debug.txt (without debug_line)\n";
 
   outs() << "\n✓ Complete! Binary DWARF kept in memory, human-readable dump in debug.txt\n";
+  if (cache)
+    printDwarfCacheStats(outs(), *cache);
+
+  if (Error err = finishPhaseTiming()) {
+    errs() << "Failed to write the time trace: " << toString(std::move(err)) << "\n";
+    return 1;
+  }
 
   return 0;
 }
\ No newline at end of file
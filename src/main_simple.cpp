@@ -1,203 +1,535 @@
 // Simple DWARF Generator using LLVM's DIE classes
 // - Uses DIEEntry for automatic type reference management
-// - Direct human-readable output (no binary serialization)
-
-#include <map>
+// - Reads a batch layout table (JSON) or uses the built-in MyClass example
+// - Optionally splits the types across compile units built on a thread pool
+// - Direct binary serialization of .debug_info/.debug_abbrev/.debug_str (no MC layer),
+//   optionally as WebAssembly custom sections (uncompressed); optionally reports their zlib/zstd compressed size
+// - Optionally streams one compile unit chunk by chunk, with DIE memory bounded by the chunk
+// - Optionally reuses the output for unchanged layouts from an on-disk cache
+// - Optionally DWARF 5 with names as DW_FORM_strx* string indices
+// - Optionally tail merges .debug_str
+// - Optionally indexes the named types in a DWARF 5 .debug_names table
+// - Optionally shares one use-count ordered abbreviation table across all units
+// - Narrowest data forms for sizes and offsets; optionally narrowest ref forms for references
+// - Optionally DWARF 5 DW_FORM_implicit_const for constants shared across an abbreviation
+// - Human-readable dump of the same DIE tree
+
+#include <chrono>
+#include <optional>
 #include <string>
 
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/BinaryFormat/Dwarf.h"
 #include "llvm/CodeGen/DIE.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include "src/ByteEncoding.h"
+#include "src/DIEPrinter.h"
+#include "src/DebugSectionCompression.h"
+#include "src/DwarfCache.h"
+#include "src/DwarfGenerator.h"
+#include "src/DwarfSectionWriter.h"
+#include "src/DwarfServer.h"
+#include "src/LayoutDIEBuilder.h"
+#include "src/LayoutTable.h"
+#include "src/ParallelUnitBuilder.h"
+#include "src/PhaseTiming.h"
+#include "src/ProcessStats.h"
+#include "src/SimpleStringPool.h"
+#include "src/StreamingUnitEmitter.h"
+#include "src/WasmSectionWriter.h"
+
 using namespace llvm;
 
-// Simple string pool for offset tracking
-class SimpleStringPool {
-  std::string data;
-  std::map<std::string, uint32_t> offsets;
+static cl::opt<std::string> LayoutFile(cl::Positional, cl::desc("[layout.json]"), cl::init(""));
+static cl::opt<bool> DedupTypes("dedup-types", cl::desc("Share one DIE between structurally identical types"), cl::init(true));
+static cl::opt<bool> TypeUnits("type-units", cl::desc("Move each struct/class into a signature-keyed type unit (DW_FORM_ref_sig8)"),
+                               cl::init(false));
+static cl::opt<unsigned> CompileUnits("compile-units", cl::desc("Split the types across this many compile units"), cl::init(1));
+static cl::opt<std::string> WasmOutput("wasm-output", cl::desc("Write the DWARF sections as custom sections of a new wasm module"),
+                                       cl::value_desc("file"), cl::init(""));
+static cl::opt<std::string> WasmAppend("wasm-append", cl::desc("Append the DWARF sections as custom sections to an existing wasm module"),
+                                       cl::value_desc("file"), cl::init(""));
+static cl::opt<unsigned> Threads("jobs", cl::desc("Worker threads for building the compile units (0 = all cores)"), cl::init(0));
+static cl::opt<std::string> Serve("serve", cl::desc("Keep running and serve layout requests on this Unix socket"),
+                                  cl::value_desc("socket"), cl::init(""));
+static cl::opt<unsigned> ServeConnections("serve-connections",
+                                          cl::desc("Connections served at once by --serve, each generating (0 = all cores)"),
+                                          cl::init(0));
+static cl::opt<bool> StringIndices("strx", cl::desc("DWARF 5: reference names by DW_FORM_strx1-4 through .debug_str_offsets"),
+                                   cl::init(false));
+static cl::opt<bool> TailMergeStrings("tail-merge-strings", cl::desc("Store strings that end another string inside that one"),
+                                      cl::init(false));
+static cl::opt<bool> NameIndex("debug-names", cl::desc("DWARF 5: index every named type in a .debug_names accelerator table"),
+                               cl::init(false));
+static cl::opt<bool> ShareAbbrevs("share-abbrevs",
+                                  cl::desc("Number abbreviations by use count and share one table across all units"),
+                                  cl::init(false));
+static cl::opt<bool> NarrowRefs("narrow-refs", cl::desc("Give type references the narrowest of ref1/ref2/ref4/ref_udata"),
+                                cl::init(false));
+static cl::opt<bool> ImplicitConsts("implicit-const",
+                                    cl::desc("DWARF 5: move constants shared across an abbreviation into it (DW_FORM_implicit_const)"),
+                                    cl::init(false));
+static cl::opt<unsigned> DumpJobs("dump-jobs", cl::desc("Threads rendering debug.txt (0 = all cores, 1 = sequential)"), cl::init(1));
+static cl::opt<unsigned> StreamChunk("stream-chunk", cl::desc("Build, emit and release this many top-level types at a time (0 = off)"),
+                                     cl::init(0));
+
+static DwarfGeneratorOptions getGeneratorOptions() {
+  DwarfGeneratorOptions options;
+  options.dedupTypes = DedupTypes;
+  options.typeUnits = TypeUnits;
+  options.compileUnits = CompileUnits;
+  options.jobs = Threads;
+  options.stringIndices = StringIndices;
+  options.tailMergeStrings = TailMergeStrings;
+  options.nameIndex = NameIndex;
+  options.shareAbbrevs = ShareAbbrevs;
+  options.narrowRefs = NarrowRefs;
+  options.implicitConsts = ImplicitConsts;
+  return options;
+}
+
+// Everything besides the layout that the output depends on
+static std::string getCacheConfig(const DwarfGeneratorOptions &options) {
+  dwarf::FormParams formParams = options.getFormParams();
+  std::string config;
+  raw_string_ostream OS(config);
+  OS << "die;version=" << formParams.Version << ";addr=" << unsigned(formParams.AddrSize)
+     << ";format=" << (formParams.Format == dwarf::DWARF64 ? 64 : 32) << ";dedup=" << options.dedupTypes
+     << ";type-units=" << options.typeUnits << ";compile-units=" << options.compileUnits << ";strx=" << options.stringIndices
+     << ";tail-merge=" << options.tailMergeStrings << ";names=" << options.nameIndex
+     << ";share-abbrevs=" << options.shareAbbrevs << ";narrow-refs=" << options.narrowRefs
+     << ";implicit-const=" << options.implicitConsts;
+  return OS.str();
+}
 
-public:
-  uint32_t add(const std::string &str) {
-    auto it = offsets.find(str);
-    if (it != offsets.end()) {
-      return it->second;
+// Cache entry parts: {numTypeDIEs, numTypeUnits, numCompileUnits} as u64, .debug_info, .debug_abbrev,
+// .debug_str, .debug_str_offsets, .debug_names, one part per type unit, the debug.txt dump
+enum CachePart { CacheMeta, CacheInfo, CacheAbbrev, CacheStr, CacheStrOffsets, CacheNames, CacheTypeUnits };
+
+static void printTypeStats(const LayoutTable &table, size_t numTypeDIEs, unsigned numUnits) {
+  outs() << "✓ Producer: " << table.producer << "\n";
+  outs() << "✓ Types: " << table.types.size() << " (" << table.getNumMembers() << " members), " << numTypeDIEs
+         << " type DIEs after deduplication";
+  if (numUnits > 1)
+    outs() << ", " << numUnits << " compile units";
+  outs() << "\n\n";
+}
+
+static void printSectionStats(const LayoutTable &table, const DwarfSectionsRef &sections, std::chrono::steady_clock::time_point start) {
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  outs() << "✓ DWARF .debug_info: " << sections.info.size() << " bytes (in memory)\n";
+  outs() << "✓ DWARF .debug_abbrev: " << sections.abbrev.size() << " bytes (in memory)\n";
+  outs() << "✓ DWARF .debug_str: " << sections.str.size() << " bytes (in memory)\n";
+  if (!sections.strOffsets.empty())
+    outs() << "✓ DWARF .debug_str_offsets: " << sections.strOffsets.size() << " bytes (in memory)\n";
+  if (!sections.names.empty())
+    outs() << "✓ DWARF .debug_names: " << sections.names.size() << " bytes (in memory)\n";
+  if (TypeUnits) {
+    size_t typeUnitBytes = 0;
+    for (ArrayRef<uint8_t> unit : sections.typeUnits)
+      typeUnitBytes += unit.size();
+    outs() << "✓ DWARF .debug_types: " << sections.typeUnits.size() << " type units, " << typeUnitBytes
+           << " bytes (in memory)\n";
+  }
+  outs() << "✓ Generated in " << format("%.3f", seconds * 1e3) << " ms (" << format("%.0f", table.types.size() / seconds)
+         << " types/sec), peak RSS " << format("%.1f", getPeakRSSBytes() / 1048576.0) << " MB\n\n";
+}
+
+// Report what compression would save if asked to, then emit the sections
+// straight into wasm custom sections, no host object in between. Wasm consumers
+// read custom sections as they are, so those stay uncompressed.
+static bool writeSectionOutputs(const DwarfSectionsRef &sections) {
+  if (getSectionCompressionType() != SectionCompressionType::None) {
+    // The type units are measured as one .debug_types section, compressed as a whole
+    SmallVector<uint8_t, 0> typeUnitBytes;
+    for (ArrayRef<uint8_t> unit : sections.typeUnits)
+      typeUnitBytes.append(unit.begin(), unit.end());
+    SmallVector<DebugSectionInput, 4> inputs = {
+        {".debug_info", sections.info}, {".debug_abbrev", sections.abbrev}, {".debug_str", arrayRefFromStringRef(sections.str)}};
+    if (!sections.strOffsets.empty())
+      inputs.push_back({".debug_str_offsets", sections.strOffsets});
+    if (!sections.names.empty())
+      inputs.push_back({".debug_names", sections.names});
+    if (!sections.typeUnits.empty())
+      inputs.push_back({".debug_types", typeUnitBytes});
+    // wasm32, so the 32-bit ELF compression header
+    Expected<CompressedDebugSections> compressedOrErr = compressDebugSections(inputs, /*is64Bit=*/false);
+    if (!compressedOrErr) {
+      errs() << "Failed to compress DWARF: " << toString(compressedOrErr.takeError()) << "\n";
+      return false;
     }
-    uint32_t offset = data.size();
-    offsets[str] = offset;
-    data += str;
-    data += '\0';
-    return offset;
+    printCompressionStats(outs(), *compressedOrErr);
   }
 
-  const std::string &getData() const {
-    return data;
+  if (WasmOutput.empty() && WasmAppend.empty())
+    return true;
+  PhaseScope phase("Write wasm");
+  if (!WasmOutput.empty()) {
+    if (Error err = writeWasmDebugModule(WasmOutput, sections)) {
+      errs() << "Failed to write wasm: " << toString(std::move(err)) << "\n";
+      return false;
+    }
+    outs() << "✓ DWARF custom sections written to " << WasmOutput << "\n";
   }
-  uint32_t getSize() const {
-    return data.size();
+  if (!WasmAppend.empty()) {
+    if (Error err = appendWasmDebugSections(WasmAppend, sections)) {
+      errs() << "Failed to append to wasm: " << toString(std::move(err)) << "\n";
+      return false;
+    }
+    outs() << "✓ DWARF custom sections appended to " << WasmAppend << "\n";
   }
+  return true;
+}
+
+// Views into a cache entry; false if it does not have the expected parts
+static bool decodeCacheEntry(const DwarfCacheEntry &entry, DwarfSectionsRef &sections, uint64_t &numTypeDIEs, uint64_t &numUnits,
+                             StringRef &dump) {
+  ArrayRef<ArrayRef<uint8_t>> parts = entry.parts;
+  if (parts.size() <= CacheTypeUnits || parts[CacheMeta].size() != 24)
+    return false;
+  uint64_t numTypeUnits = readLE(parts[CacheMeta].data() + 8, 8);
+  if (parts.size() != CacheTypeUnits + numTypeUnits + 1)
+    return false;
+
+  numTypeDIEs = readLE(parts[CacheMeta].data(), 8);
+  numUnits = readLE(parts[CacheMeta].data() + 16, 8);
+  sections.info = parts[CacheInfo];
+  sections.abbrev = parts[CacheAbbrev];
+  sections.str = toStringRef(parts[CacheStr]);
+  sections.strOffsets = parts[CacheStrOffsets];
+  sections.names = parts[CacheNames];
+  sections.typeUnits.append(parts.begin() + CacheTypeUnits, parts.end() - 1);
+  dump = toStringRef(parts.back());
+  return true;
+}
+
+// Cache hit: every output comes straight from the mapped entry, nothing is built
+static bool writeCachedOutputs(const LayoutTable &table, const DwarfSectionsRef &sections, uint64_t numTypeDIEs, uint64_t numUnits,
+                               StringRef dump, std::chrono::steady_clock::time_point start) {
+  printTypeStats(table, numTypeDIEs, numUnits);
+  printSectionStats(table, sections, start);
+  if (!writeSectionOutputs(sections))
+    return false;
 
-  std::string getStringAt(uint32_t offset) const {
-    if (offset >= data.size())
-      return "";
-    return std::string(data.c_str() + offset);
+  std::error_code EC;
+  raw_fd_ostream dumpFile("debug.txt", EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << "Error opening debug.txt: " << EC.message() << "\n";
+    return false;
   }
-};
+  dumpFile << dump;
+  dumpFile.close();
+  outs() << "✓ Human-readable DWARF dump written to debug.txt\n";
+  return true;
+}
 
-// Print a single DIE with indentation
-void printDIE(raw_ostream &OS, DIE &die, SimpleStringPool &stringPool, int indent = 0) {
-  std::string indentStr(indent, ' ');
+static void writeDumpHeader(raw_ostream &dumpFile, const LayoutTable &table) {
+  dumpFile << "=== DWARF Debug Information ===\n";
+  dumpFile << "Producer: " << table.producer << "\n";
+  dumpFile << "Language: C++\n\n";
+  dumpFile << ".debug_info contents:\n";
+}
 
-  // Print DIE header
-  OS << indentStr << "0x" << format("%08x", die.getOffset()) << ": ";
-  OS << dwarf::TagString(die.getTag());
-  OS << " [" << die.getAbbrevNumber() << "]";
+// --stream-chunk: .debug_info goes to the wasm module (or nowhere) and the dump
+// to debug.txt as each chunk is done, instead of after the whole unit is built
+static int runStreaming(LayoutUnitPlan &plan, const dwarf::FormParams &formParams, std::chrono::steady_clock::time_point start) {
+  const LayoutTable &table = plan.getTable();
+  StreamingUnitEmitter emitter(plan, formParams, StreamChunk);
+  emitter.computeLayout();
+  SimpleStringPool &stringPool = emitter.getStringPool();
+
+  std::string wasmPath = !WasmOutput.empty() ? WasmOutput : WasmAppend;
+  std::unique_ptr<raw_fd_ostream> wasm;
+  if (!wasmPath.empty()) {
+    Expected<std::unique_ptr<raw_fd_ostream>> wasmOrErr =
+        openWasmDebugStream(wasmPath, WasmOutput.empty(), {".debug_info", ".debug_abbrev", ".debug_str"});
+    if (!wasmOrErr) {
+      errs() << "Failed to open wasm: " << toString(wasmOrErr.takeError()) << "\n";
+      return 1;
+    }
+    wasm = std::move(*wasmOrErr);
+    writeWasmCustomSectionHeader(*wasm, ".debug_info", emitter.getInfoSize());
+  }
+  raw_null_ostream nullSink;
+  raw_ostream &infoSink = wasm ? static_cast<raw_ostream &>(*wasm) : nullSink;
 
-  if (die.hasChildren()) {
-    OS << " *\n";
-  } else {
-    OS << "\n";
+  std::error_code EC;
+  raw_fd_ostream dumpFile("debug.txt", EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << "Error opening debug.txt: " << EC.message() << "\n";
+    return 1;
+  }
+  writeDumpHeader(dumpFile, table);
+
+  DwarfSectionWriter writer(formParams);
+  DwarfUnitOffsets unitOffsets;
+  Error err = emitter.emit(
+      writer, infoSink, [&](DIE &unitDie) { printDIEAttributes(dumpFile, unitDie, stringPool, 0, unitOffsets); },
+      [&](ArrayRef<DIE *> dies) {
+        for (DIE *die : dies) {
+          if (die)
+            printDIE(dumpFile, *die, stringPool, 0, unitOffsets, 2);
+        }
+      });
+  if (err) {
+    errs() << "Failed to serialize DWARF: " << toString(std::move(err)) << "\n";
+    return 1;
+  }
+  dumpFile << "NULL\n";
+  DwarfSections sections = writer.finish(stringPool);
+
+  if (wasm) {
+    writeWasmCustomSectionHeader(*wasm, ".debug_abbrev", sections.abbrev.size());
+    wasm->write(reinterpret_cast<const char *>(sections.abbrev.data()), sections.abbrev.size());
+    writeWasmCustomSectionHeader(*wasm, ".debug_str", sections.str.size());
+    *wasm << sections.str;
+    if (Error err = closeWasmDebugStream(*wasm, wasmPath)) {
+      errs() << "Failed to write wasm: " << toString(std::move(err)) << "\n";
+      return 1;
+    }
   }
 
-  // Print attributes
-  for (const auto &V : die.values()) {
-    OS << indentStr << "  " << dwarf::AttributeString(V.getAttribute()) << " = ";
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  outs() << "✓ Producer: " << table.producer << "\n";
+  outs() << "✓ Types: " << table.types.size() << " (" << table.getNumMembers() << " members), " << emitter.getNumTypeDIEs()
+         << " type DIEs after deduplication\n\n";
+  outs() << "✓ DWARF .debug_info: " << emitter.getInfoSize() << " bytes (streamed in chunks of " << StreamChunk << " types)\n";
+  outs() << "✓ DWARF .debug_abbrev: " << sections.abbrev.size() << " bytes (in memory)\n";
+  outs() << "✓ DWARF .debug_str: " << sections.str.size() << " bytes (in memory)\n";
+  outs() << "✓ Generated in " << format("%.3f", seconds * 1e3) << " ms (" << format("%.0f", table.types.size() / seconds)
+         << " types/sec), peak RSS " << format("%.1f", getPeakRSSBytes() / 1048576.0) << " MB\n\n";
+  if (wasm)
+    outs() << "✓ DWARF custom sections " << (WasmOutput.empty() ? "appended to " : "written to ") << wasmPath << "\n";
 
-    switch (V.getType()) {
-    case DIEValue::isInteger: {
-      uint64_t val = V.getDIEInteger().getValue();
+  dumpFile << "\n.debug_str contents:\n";
+  printStringPool(dumpFile, stringPool);
+  dumpFile.close();
+  outs() << "✓ Human-readable DWARF dump written to debug.txt\n";
+  return 0;
+}
 
-      // Special handling for string offsets
-      if (V.getForm() == dwarf::DW_FORM_strp) {
-        std::string str = stringPool.getStringAt(val);
-        OS << "\"" << str << "\" (strp offset: 0x" << format("%08x", val) << ")";
-      } else if (V.getAttribute() == dwarf::DW_AT_encoding) {
-        OS << dwarf::AttributeEncodingString(val);
-      } else {
-        OS << "0x" << format("%x", val);
-      }
-      break;
-    }
-    case DIEValue::isEntry: {
-      DIE &refDie = V.getDIEEntry().getEntry();
-      OS << "{0x" << format("%08x", refDie.getOffset()) << "}";
-      break;
-    }
-    default:
-      OS << "<unknown type>";
-      break;
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "DIE-based DWARF generator\n");
+  startPhaseTiming(argv[0], getPhaseTimingSettingsFromOptions());
+  auto start = std::chrono::steady_clock::now();
+
+  DwarfGeneratorOptions options = getGeneratorOptions();
+  if (Error err = options.validate()) {
+    errs() << toString(std::move(err)) << "\n";
+    return 1;
+  }
+
+  if (!Serve.empty()) {
+    // The server never finishes phase timing, so a trace would keep every worker's events forever
+    if (StreamChunk || !WasmOutput.empty() || !WasmAppend.empty() || getPhaseTimingSettingsFromOptions().isEnabled() ||
+        getSectionCompressionType() != SectionCompressionType::None) {
+      errs() << "--serve returns the sections over the socket; it cannot be combined with --stream-chunk, --wasm-output, "
+                "--wasm-append, --time-phases, --time-trace or --compress-debug-sections\n";
+      return 1;
     }
+    Error err = runDwarfServer(Serve, options, ServeConnections, [] {
+      outs() << "✓ Serving DWARF requests on " << Serve << "\n";
+      outs().flush();
+    });
+    errs() << "Server stopped: " << toString(std::move(err)) << "\n";
+    return 1;
+  }
 
-    OS << " [" << dwarf::FormEncodingString(V.getForm()) << "]\n";
+  // Load the batch layout table, or fall back to the built-in MyClass example
+  LayoutTable table;
+  if (LayoutFile.empty()) {
+    makeSampleLayout(table);
+  } else {
+    PhaseScope phase("Load layout", LayoutFile);
+    if (Error err = readLayoutFile(LayoutFile, table)) {
+      errs() << "Failed to load " << LayoutFile << ": " << toString(std::move(err)) << "\n";
+      return 1;
+    }
   }
 
-  // Print children recursively
-  for (auto &child : die.children()) {
-    printDIE(OS, child, stringPool, indent + 2);
+  if (StreamChunk && (TypeUnits || CompileUnits != 1 || (!WasmOutput.empty() && !WasmAppend.empty()) ||
+                      getSectionCompressionType() != SectionCompressionType::None || StringIndices || TailMergeStrings ||
+                      NameIndex || ShareAbbrevs || NarrowRefs || ImplicitConsts || DumpJobs != 1)) {
+    errs() << "--stream-chunk emits one uncompressed DWARF 4 compile unit into at most one wasm module, with strings as they "
+              "come; it cannot be combined with --type-units, --compile-units, --compress-debug-sections, --strx, "
+              "--tail-merge-strings, --debug-names, --share-abbrevs, --narrow-refs, --implicit-const or --dump-jobs\n";
+    return 1;
   }
 
-  if (die.hasChildren()) {
-    OS << indentStr << "NULL\n";
+  // Look up the output of an identical earlier run before building anything.
+  // Streaming never holds the sections in memory, so it bypasses the cache.
+  Expected<std::unique_ptr<DwarfCache>> cacheOrErr = openDwarfCacheFromOptions();
+  if (!cacheOrErr) {
+    errs() << toString(cacheOrErr.takeError()) << "\n";
+    return 1;
+  }
+  std::unique_ptr<DwarfCache> cache = StreamChunk ? nullptr : std::move(*cacheOrErr);
+  std::string cacheKey;
+  if (cache) {
+    cacheKey = computeDwarfCacheKey(table, getCacheConfig(options));
+    std::optional<DwarfCacheEntry> entry = [&] {
+      PhaseScope phase("Cache lookup");
+      return cache->lookup(cacheKey);
+    }();
+    DwarfSectionsRef sections;
+    uint64_t numTypeDIEs, numUnits;
+    StringRef dump;
+    if (entry && decodeCacheEntry(*entry, sections, numTypeDIEs, numUnits, dump)) {
+      outs() << "✓ Cache hit " << cacheKey << "\n";
+      if (!writeCachedOutputs(table, sections, numTypeDIEs, numUnits, dump, start))
+        return 1;
+      printDwarfCacheStats(outs(), *cache);
+      if (Error err = finishPhaseTiming()) {
+        errs() << "Failed to write the time trace: " << toString(std::move(err)) << "\n";
+        return 1;
+      }
+      return 0;
+    }
   }
-}
 
-int main() {
-  // Create allocator for DIE objects
-  BumpPtrAllocator allocator;
-  DIEAbbrevSet abbrevSet(allocator);
-  SimpleStringPool stringPool;
-
-  // Create compile unit DIE
-  DIE *cu = DIE::get(allocator, dwarf::DW_TAG_compile_unit);
-  cu->addValue(allocator, dwarf::DW_AT_producer, dwarf::DW_FORM_strp, DIEInteger(stringPool.add("warpo")));
-  cu->addValue(allocator, dwarf::DW_AT_language, dwarf::DW_FORM_data2, DIEInteger(dwarf::DW_LANG_C_plus_plus));
-
-  // Create int base type
-  DIE *intType = DIE::get(allocator, dwarf::DW_TAG_base_type);
-  intType->addValue(allocator, dwarf::DW_AT_name, dwarf::DW_FORM_strp, DIEInteger(stringPool.add("int")));
-  intType->addValue(allocator, dwarf::DW_AT_encoding, dwarf::DW_FORM_data1, DIEInteger(dwarf::DW_ATE_signed));
-  intType->addValue(allocator, dwarf::DW_AT_byte_size, dwarf::DW_FORM_data1, DIEInteger(4));
-  cu->addChild(intType);
-
-  // Create char base type
-  DIE *charType = DIE::get(allocator, dwarf::DW_TAG_base_type);
-  charType->addValue(allocator, dwarf::DW_AT_name, dwarf::DW_FORM_strp, DIEInteger(stringPool.add("char")));
-  charType->addValue(allocator, dwarf::DW_AT_encoding, dwarf::DW_FORM_data1, DIEInteger(dwarf::DW_ATE_signed_char));
-  charType->addValue(allocator, dwarf::DW_AT_byte_size, dwarf::DW_FORM_data1, DIEInteger(1));
-  cu->addChild(charType);
-
-  // Create char* pointer type
-  DIE *charPtrType = DIE::get(allocator, dwarf::DW_TAG_pointer_type);
-  charPtrType->addValue(allocator, dwarf::DW_AT_byte_size, dwarf::DW_FORM_data1, DIEInteger(8));
-  charPtrType->addValue(allocator, dwarf::DW_AT_type, dwarf::DW_FORM_ref4,
-                        DIEEntry(*charType)); // Automatic reference!
-  cu->addChild(charPtrType);
-
-  // Create MyClass structure
-  DIE *classType = DIE::get(allocator, dwarf::DW_TAG_structure_type);
-  classType->addValue(allocator, dwarf::DW_AT_name, dwarf::DW_FORM_strp, DIEInteger(stringPool.add("MyClass")));
-  classType->addValue(allocator, dwarf::DW_AT_byte_size, dwarf::DW_FORM_data1, DIEInteger(24));
-  cu->addChild(classType);
-
-  // Add member 'x' (int)
-  DIE *memberX = DIE::get(allocator, dwarf::DW_TAG_member);
-  memberX->addValue(allocator, dwarf::DW_AT_name, dwarf::DW_FORM_strp, DIEInteger(stringPool.add("x")));
-  memberX->addValue(allocator, dwarf::DW_AT_type, dwarf::DW_FORM_ref4,
-                    DIEEntry(*intType)); // Automatic reference!
-  memberX->addValue(allocator, dwarf::DW_AT_data_member_location, dwarf::DW_FORM_data1, DIEInteger(0));
-  classType->addChild(memberX);
-
-  // Add member 'y' (int)
-  DIE *memberY = DIE::get(allocator, dwarf::DW_TAG_member);
-  memberY->addValue(allocator, dwarf::DW_AT_name, dwarf::DW_FORM_strp, DIEInteger(stringPool.add("y")));
-  memberY->addValue(allocator, dwarf::DW_AT_type, dwarf::DW_FORM_ref4,
-                    DIEEntry(*intType)); // Same type reference!
-  memberY->addValue(allocator, dwarf::DW_AT_data_member_location, dwarf::DW_FORM_data1, DIEInteger(4));
-  classType->addChild(memberY);
-
-  // Add member 'name' (char*)
-  DIE *memberName = DIE::get(allocator, dwarf::DW_TAG_member);
-  memberName->addValue(allocator, dwarf::DW_AT_name, dwarf::DW_FORM_strp, DIEInteger(stringPool.add("name")));
-  memberName->addValue(allocator, dwarf::DW_AT_type, dwarf::DW_FORM_ref4,
-                       DIEEntry(*charPtrType)); // Automatic reference!
-  memberName->addValue(allocator, dwarf::DW_AT_data_member_location, dwarf::DW_FORM_data1, DIEInteger(8));
-  classType->addChild(memberName);
-
-  // Compute offsets and assign abbreviation numbers
-  dwarf::FormParams formParams = {4, 4, dwarf::DWARF32};
-  cu->computeOffsetsAndAbbrevs(formParams, abbrevSet, 11);
+  if (StreamChunk) {
+    std::optional<PhaseScope> planPhase(std::in_place, "Plan units");
+    LayoutUnitPlan plan(table, CompileUnits, DedupTypes, TypeUnits);
+    planPhase.reset();
+    if (int status = runStreaming(plan, options.getFormParams(), start))
+      return status;
+    if (Error err = finishPhaseTiming()) {
+      errs() << "Failed to write the time trace: " << toString(std::move(err)) << "\n";
+      return 1;
+    }
+    return 0;
+  }
+  // Build, lay out (in parallel) and serialize the compile units, keeping the DIE tree for the dump
+  options.keepDIEs = true;
+  Expected<std::unique_ptr<GeneratedDwarf>> generated = generateDwarf(table, options);
+  if (!generated) {
+    errs() << "Failed to generate DWARF: " << toString(generated.takeError()) << "\n";
+    return 1;
+  }
+  LayoutCompileUnits &units = *(*generated)->units;
+  SimpleStringPool &stringPool = (*generated)->stringPool;
+  const DwarfUnitOffsets &unitOffsets = (*generated)->unitOffsets;
+  unsigned numUnits = (*generated)->numCompileUnits;
 
   outs() << "✓ DIE tree built with automatic reference management\n";
   outs() << "✓ computeOffsetsAndAbbrevs() resolved all DIEEntry references\n";
-  outs() << "✓ Producer: warpo\n";
-  outs() << "✓ Class: MyClass with members (x:int, y:int, name:char*)\n\n";
+  printTypeStats(table, units.getNumTypeDIEs(), numUnits);
+  if (TailMergeStrings) {
+    uint64_t sizeBefore = stringPool.getSize() + units.tailMergeSavedBytes;
+    outs() << "✓ Tail merging: " << units.numTailMergedStrings << " of " << stringPool.getNumStrings()
+           << " strings stored inside another, .debug_str " << sizeBefore << " -> " << stringPool.getSize() << " bytes (-"
+           << format("%.1f", sizeBefore ? 100.0 * units.tailMergeSavedBytes / sizeBefore : 0.0) << "%) in "
+           << format("%.3f", units.tailMergeSeconds * 1e3) << " ms\n\n";
+  }
+
+  if (NarrowRefs)
+    outs() << "✓ Reference forms narrowed, fixpoint after " << units.numLayoutPasses << " layout passes\n\n";
+  if (ImplicitConsts)
+    outs() << "✓ Implicit constants: " << units.numImplicitConstValues << " values moved into " << units.numImplicitConstAbbrevs
+           << " split-off abbreviations, " << int64_t(units.implicitConstSavedBytes) - units.implicitConstAbbrevBytes
+           << " bytes saved (.debug_info -" << units.implicitConstSavedBytes << ", .debug_abbrev +" << units.implicitConstAbbrevBytes << ")\n\n";
+  if (ShareAbbrevs)
+    outs() << "✓ Shared abbreviations: " << units.numSharedAbbrevs << " in one table for " << numUnits
+           << " compile units, numbered by use count\n\n";
+
+  // The sections were serialized straight from the DIE tree (kept in memory)
+  DwarfSections &sections = (*generated)->sections;
+  printSectionStats(table, sections, start);
+  if (!writeSectionOutputs(sections))
+    return 1;
 
   // Write to file
-  std::error_code EC;
-  raw_fd_ostream dumpFile("debug.txt", EC, sys::fs::OF_None);
-  if (EC) {
+  int dumpFd;
+  if (std::error_code EC = sys::fs::openFileForWrite("debug.txt", dumpFd)) {
     errs() << "Error opening debug.txt: " << EC.message() << "\n";
     return 1;
   }
+  raw_fd_ostream dumpFile(dumpFd, /*shouldClose=*/true);
+  // With a cache the dump is also kept in memory, to be stored with the sections
+  SmallVector<char, 0> dumpBuffer;
+  raw_svector_ostream dumpBufferOS(dumpBuffer);
+  // With --dump-jobs (more than one thread), the compile units are rendered on a thread pool and everything is
+  // written out at the end
+  std::optional<ParallelDIEDump> parallelDump;
+  if (ParallelDIEDump::getNumThreads(DumpJobs) > 1)
+    parallelDump.emplace(DumpJobs);
+  raw_ostream &dumpOS = parallelDump ? *parallelDump : cache ? static_cast<raw_ostream &>(dumpBufferOS) : dumpFile;
+
+  writeDumpHeader(dumpOS, table);
+  std::optional<PhaseScope> printPhase(std::in_place, "printDIE");
+  for (const std::unique_ptr<LayoutCompileUnit> &unit : units.units) {
+    uint64_t unitOffset = unitOffsets.lookup(unit->unitDie);
+    if (numUnits > 1)
+      dumpOS << "Compile Unit: offset = 0x" << format("%08x", unitOffset) << "\n";
+    if (parallelDump)
+      parallelDump->printDIE(*unit->unitDie, stringPool, unitOffset, unitOffsets);
+    else
+      printDIE(dumpOS, *unit->unitDie, stringPool, unitOffset, unitOffsets);
+  }
 
-  dumpFile << "=== DWARF Debug Information ===\n";
-  dumpFile << "Producer: warpo\n";
-  dumpFile << "Language: C++\n\n";
+  if (TypeUnits) {
+    dumpOS << "\n.debug_types contents:\n";
+    for (const std::unique_ptr<LayoutCompileUnit> &unit : units.units) {
+      for (const LayoutTypeUnit &typeUnit : unit->typeUnits) {
+        dumpOS << "Type Unit: signature = 0x" << format_hex_no_prefix(typeUnit.signature, 16) << ", type_offset = 0x"
+               << format("%08x", typeUnit.typeDie->getOffset()) << "\n";
+        printDIE(dumpOS, *typeUnit.unitDie, stringPool, 0, unitOffsets);
+      }
+    }
+  }
 
-  dumpFile << ".debug_info contents:\n";
-  printDIE(dumpFile, *cu, stringPool);
+  printPhase.reset();
 
-  dumpFile << "\n.debug_str contents:\n";
-  uint32_t offset = 0;
-  const std::string &strData = stringPool.getData();
-  while (offset < strData.size()) {
-    std::string str = stringPool.getStringAt(offset);
-    dumpFile << "0x" << format("%08x", offset) << ": \"" << str << "\"\n";
-    offset += str.size() + 1;
+  dumpOS << "\n.debug_str contents:\n";
+  {
+    PhaseScope phase("String table dump");
+    printStringPool(dumpOS, stringPool);
+    if (stringPool.getNumIndices()) {
+      dumpOS << "\n.debug_str_offsets contents:\n";
+      printStringOffsets(dumpOS, stringPool);
+    }
   }
 
+  if (parallelDump) {
+    PhaseScope phase("Dump write");
+    if (cache) {
+      parallelDump->writeTo(dumpBufferOS);
+    } else if (Error err = parallelDump->writeTo(dumpFd)) {
+      errs() << "Failed to write debug.txt: " << toString(std::move(err)) << "\n";
+      return 1;
+    }
+  }
+  if (cache)
+    dumpFile << dumpBuffer;
   dumpFile.close();
   outs() << "✓ Human-readable DWARF dump written to debug.txt\n";
 
+  if (cache) {
+    PhaseScope phase("Cache store");
+    uint8_t meta[24];
+    writeLE(meta, units.getNumTypeDIEs(), 8);
+    writeLE(meta + 8, sections.typeUnits.size(), 8);
+    writeLE(meta + 16, numUnits, 8);
+    SmallVector<ArrayRef<uint8_t>, 8> parts = {meta, sections.info, sections.abbrev, arrayRefFromStringRef(sections.str),
+                                               sections.strOffsets, sections.names};
+    for (const DwarfTypeUnitSection &unit : sections.typeUnits)
+      parts.push_back(unit.bytes);
+    parts.push_back(arrayRefFromStringRef(StringRef(dumpBuffer.data(), dumpBuffer.size())));
+    if (Error err = cache->store(cacheKey, parts))
+      errs() << "warning: " << toString(std::move(err)) << "\n";
+    else
+      outs() << "✓ Cache miss, stored " << cacheKey << "\n";
+    printDwarfCacheStats(outs(), *cache);
+  }
+
+  if (Error err = finishPhaseTiming()) {
+    errs() << "Failed to write the time trace: " << toString(std::move(err)) << "\n";
+    return 1;
+  }
+
   return 0;
 }